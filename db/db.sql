@@ -1,10 +1,11 @@
-PRAGMA journal_mode = PERSIST;
+PRAGMA journal_mode = WAL;
 PRAGMA foreign_keys = ON;
 PRAGMA auto_vacuum = NONE;
 
 BEGIN EXCLUSIVE TRANSACTION;
 
-PRAGMA user_version = 0;
+-- Keep in sync with migrations in src/common/privilege_db.cpp
+PRAGMA user_version = 2;
 
 CREATE TABLE IF NOT EXISTS pkg (
 pkg_id INTEGER PRIMARY KEY,
@@ -21,6 +22,9 @@ UNIQUE (name, uid),
 FOREIGN KEY (pkg_id) REFERENCES pkg (pkg_id)
 );
 
+CREATE INDEX IF NOT EXISTS app_uid_index ON app (uid);
+CREATE INDEX IF NOT EXISTS app_pkg_id_index ON app (pkg_id);
+
 CREATE TABLE IF NOT EXISTS privilege (
 privilege_id INTEGER PRIMARY KEY,
 name VARCHAR NOT NULL ,
@@ -42,6 +46,18 @@ PRIMARY KEY (privilege_id, group_name),
 FOREIGN KEY (privilege_id) REFERENCES privilege (privilege_id)
 );
 
+-- Smack rules applied to the kernel, owner is the name of the rules file
+-- in accesses.d: app_<appId> or pkg_<pkgId>
+CREATE TABLE IF NOT EXISTS smack_rule (
+owner VARCHAR NOT NULL,
+subject VARCHAR NOT NULL,
+object VARCHAR NOT NULL,
+access VARCHAR NOT NULL,
+PRIMARY KEY (owner, subject, object)
+);
+
+CREATE INDEX IF NOT EXISTS smack_rule_object_index ON smack_rule (owner, object);
+
 DROP VIEW IF EXISTS app_privilege_view;
 CREATE VIEW app_privilege_view AS
 SELECT
@@ -98,7 +114,7 @@ CREATE TRIGGER app_pkg_view_delete_trigger
 INSTEAD OF DELETE ON app_pkg_view
 BEGIN
     DELETE FROM app WHERE app_id=OLD.app_id AND uid=OLD.uid;
-    DELETE FROM pkg WHERE pkg_id NOT IN (SELECT DISTINCT pkg_id from app);
+    DELETE FROM pkg WHERE pkg_id=OLD.pkg_id AND NOT EXISTS (SELECT 1 FROM app WHERE pkg_id=OLD.pkg_id);
 END;
 
 DROP VIEW IF EXISTS privilege_group_view;
@@ -21,6 +21,7 @@ BuildRequires: pkgconfig(sqlite3)
 BuildRequires: pkgconfig(db-util)
 BuildRequires: pkgconfig(cynara-admin)
 BuildRequires: pkgconfig(cynara-client)
+BuildRequires: pkgconfig(cynara-client-async)
 BuildRequires: boost-devel
 %{?systemd_requires}
 
@@ -87,6 +88,8 @@ cp LICENSE %{buildroot}%{_datadir}/license/libsecurity-manager-client
 
 mkdir -p %{buildroot}/%{_unitdir}/sockets.target.wants
 ln -s ../security-manager.socket %{buildroot}/%{_unitdir}/sockets.target.wants/security-manager.socket
+mkdir -p %{buildroot}/%{_unitdir}/basic.target.wants
+ln -s ../security-manager-rules-loader.service %{buildroot}/%{_unitdir}/basic.target.wants/security-manager-rules-loader.service
 
 %clean
 rm -rf %{buildroot}
@@ -104,7 +107,6 @@ if [ $1 = 2 ]; then
     systemctl restart security-manager.service
 fi
 chsmack -a System %{TZ_SYS_DB}/.security-manager.db
-chsmack -a System %{TZ_SYS_DB}/.security-manager.db-journal
 
 %preun
 if [ $1 = 0 ]; then
@@ -137,8 +139,9 @@ fi
 %{_libdir}/libsecurity-manager-commons.so.*
 %attr(-,root,root) %{_unitdir}/security-manager.*
 %attr(-,root,root) %{_unitdir}/sockets.target.wants/security-manager.*
+%attr(-,root,root) %{_unitdir}/security-manager-rules-loader.service
+%attr(-,root,root) %{_unitdir}/basic.target.wants/security-manager-rules-loader.service
 %config(noreplace) %attr(0600,root,root) %{TZ_SYS_DB}/.security-manager.db
-%config(noreplace) %attr(0600,root,root) %{TZ_SYS_DB}/.security-manager.db-journal
 %{_datadir}/license/%{name}
 
 %files -n libsecurity-manager-client
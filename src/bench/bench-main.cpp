@@ -0,0 +1,91 @@
+/*
+ *  Copyright (c) 2014 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *  Contact: Rafal Krypa <r.krypa@samsung.com>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License
+ */
+/*
+ * @file        bench-main.cpp
+ * @brief       Entry point of security-manager-bench
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include <smack-backend.h>
+
+#include <bench.h>
+
+using namespace SecurityManager;
+
+static void usage(const char *name)
+{
+    std::cerr << "Usage: " << name << " [--filter <substring>] [--min-time <seconds>]"
+        " [--output <file>] [--smack-backend kernel|memory|user-xattr]" << std::endl
+        << "Results are printed in JSON format." << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+    Bench::Runner runner;
+    std::string output;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--filter") && i + 1 < argc)
+            runner.setFilter(argv[++i]);
+        else if (!strcmp(argv[i], "--min-time") && i + 1 < argc)
+            runner.setMinTime(atof(argv[++i]));
+        else if (!strcmp(argv[i], "--output") && i + 1 < argc)
+            output = argv[++i];
+        else if (!strcmp(argv[i], "--smack-backend") && i + 1 < argc) {
+            // Smack benchmarks run without Smack in the kernel with the other backends
+            std::unique_ptr<SmackBackend> backend = SmackBackend::create(argv[++i]);
+            if (!backend) {
+                usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+            SmackBackend::set(std::move(backend));
+        } else {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    Bench::registerSerializationBench(runner);
+    Bench::registerPrivilegeIndexBench(runner);
+    Bench::registerPrivilegeDbBench(runner);
+    Bench::registerGroupCacheBench(runner);
+    Bench::registerSmackLabelsBench(runner);
+    Bench::registerSmackRulesBench(runner);
+#ifdef CYNARA_STUB
+    Bench::registerCynaraBench(runner);
+#endif
+
+    runner.run();
+
+    if (output.empty()) {
+        runner.writeJson(std::cout);
+    } else {
+        std::ofstream out(output);
+        if (!out) {
+            std::cerr << "Cannot open " << output << std::endl;
+            return EXIT_FAILURE;
+        }
+        runner.writeJson(out);
+    }
+
+    return EXIT_SUCCESS;
+}
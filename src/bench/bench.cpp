@@ -0,0 +1,144 @@
+/*
+ *  Copyright (c) 2014 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *  Contact: Rafal Krypa <r.krypa@samsung.com>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License
+ */
+/*
+ * @file        bench.cpp
+ * @brief       Minimal microbenchmark runner used by security-manager-bench
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+
+#include <bench.h>
+
+namespace SecurityManager {
+namespace Bench {
+
+namespace {
+
+std::string jsonEscape(const std::string &str)
+{
+    std::string ret;
+    for (char c : str) {
+        if (c == '"' || c == '\\')
+            ret += '\\';
+        ret += c;
+    }
+    return ret;
+}
+
+} // namespace anonymous
+
+Runner::Runner()
+  : m_minTime(0.5)
+{
+}
+
+void Runner::add(const std::string &name, Body body, size_t bytesPerOp)
+{
+    m_cases.push_back({name, body, bytesPerOp});
+}
+
+void Runner::addMetric(const std::string &name, double value, const std::string &unit)
+{
+    m_metrics.push_back({name, value, unit});
+}
+
+void Runner::setFilter(const std::string &filter)
+{
+    m_filter = filter;
+}
+
+void Runner::setMinTime(double seconds)
+{
+    m_minTime = seconds;
+}
+
+Result Runner::runCase(const std::string &name, const Body &body, size_t bytesPerOp)
+{
+    typedef std::chrono::steady_clock Clock;
+
+    // warm up caches and lazy initializations
+    body();
+
+    size_t iterations = 1;
+    double elapsed = 0;
+    for (;;) {
+        auto start = Clock::now();
+        for (size_t i = 0; i < iterations; ++i)
+            body();
+        elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+        if (elapsed >= m_minTime)
+            break;
+
+        // aim slightly above minimal time to avoid another round
+        size_t next = iterations * 2;
+        if (elapsed > 0.01)
+            next = static_cast<size_t>(iterations * m_minTime * 1.2 / elapsed) + 1;
+        iterations = std::max(next, iterations + 1);
+    }
+
+    return Result{name, iterations, elapsed * 1e9 / iterations, bytesPerOp};
+}
+
+void Runner::run()
+{
+    m_results.clear();
+    for (const auto &c : m_cases) {
+        if (!m_filter.empty() && c.name.find(m_filter) == std::string::npos)
+            continue;
+        m_results.push_back(runCase(c.name, c.body, c.bytesPerOp));
+    }
+}
+
+void Runner::writeJson(std::ostream &out) const
+{
+    out << "{\n  \"benchmarks\": [";
+    bool first = true;
+    for (const auto &r : m_results) {
+        out << (first ? "\n" : ",\n");
+        first = false;
+        out << "    {\"name\": \"" << jsonEscape(r.name) << "\""
+            << ", \"iterations\": " << r.iterations
+            << std::fixed << std::setprecision(1)
+            << ", \"ns_per_op\": " << r.nsPerOp
+            << ", \"ops_per_s\": " << (r.nsPerOp > 0 ? 1e9 / r.nsPerOp : 0);
+        if (r.bytesPerOp)
+            out << ", \"bytes_per_op\": " << r.bytesPerOp
+                << std::setprecision(2)
+                << ", \"mb_per_s\": " << r.bytesPerOp * 1e3 / r.nsPerOp;
+        out << "}";
+    }
+    out << "\n  ],\n  \"metrics\": [";
+    first = true;
+    for (const auto &m : m_metrics) {
+        if (!m_filter.empty() && m.name.find(m_filter) == std::string::npos)
+            continue;
+        out << (first ? "\n" : ",\n");
+        first = false;
+        out << "    {\"name\": \"" << jsonEscape(m.name) << "\""
+            << std::fixed << std::setprecision(1)
+            << ", \"value\": " << m.value
+            << ", \"unit\": \"" << jsonEscape(m.unit) << "\"}";
+    }
+    out << "\n  ]\n}\n";
+}
+
+} // namespace Bench
+} // namespace SecurityManager
@@ -0,0 +1,132 @@
+/*
+ *  Copyright (c) 2014 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *  Contact: Rafal Krypa <r.krypa@samsung.com>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License
+ */
+/*
+ * @file        cynara-bench.cpp
+ * @brief       Benchmarks of Cynara usage, run against in-process Cynara stand-in
+ */
+
+#include <string>
+#include <vector>
+
+#include <cynara-stub.h>
+
+#include <cynara.h>
+
+#include <bench.h>
+
+namespace SecurityManager {
+namespace Bench {
+
+namespace {
+
+/* Modeled cost of a round trip to Cynara service */
+const unsigned int LATENCY_US = 100;
+
+const size_t PRIVILEGE_COUNT = 20;
+const char *const LABEL = "User::App::bench";
+const char *const USER = "5001";
+const char *const SESSION = "1";
+
+std::vector<std::string> privileges()
+{
+    std::vector<std::string> result;
+    for (size_t i = 0; i < PRIVILEGE_COUNT; ++i)
+        result.push_back("http://tizen.org/privilege/bench" + std::to_string(i));
+    return result;
+}
+
+/* Bucket layout created by security-manager-policy-reload */
+void setupPolicy()
+{
+    cynara_stub_reset();
+    cynara_stub_set_latency(0);
+
+    struct cynara_admin *admin;
+    cynara_admin_initialize(&admin);
+    for (const auto &bucket : CynaraAdmin::Buckets) {
+        int defaultPolicy = CYNARA_ADMIN_DENY;
+        if (bucket.first == Bucket::ADMIN)
+            defaultPolicy = CYNARA_ADMIN_NONE;
+        cynara_admin_set_bucket(admin, bucket.second.c_str(), defaultPolicy, nullptr);
+    }
+    cynara_admin_finish(admin);
+
+    CynaraAdminPolicyBatch batch;
+    batch.add(CYNARA_ADMIN_WILDCARD, CYNARA_ADMIN_WILDCARD, CYNARA_ADMIN_WILDCARD,
+        CynaraAdmin::Buckets.at(Bucket::MAIN),
+        CynaraAdmin::Buckets.at(Bucket::PRIVACY_MANAGER));
+    batch.add(CYNARA_ADMIN_WILDCARD, CYNARA_ADMIN_WILDCARD, CYNARA_ADMIN_WILDCARD,
+        CynaraAdmin::Buckets.at(Bucket::MANIFESTS), CynaraAdmin::Buckets.at(Bucket::MAIN));
+    batch.add(CYNARA_ADMIN_WILDCARD, CYNARA_ADMIN_WILDCARD, CYNARA_ADMIN_WILDCARD,
+        CynaraAdmin::Buckets.at(Bucket::ADMIN),
+        CynaraAdmin::Buckets.at(Bucket::USER_TYPE_NORMAL));
+    // User type profile allows all privileges used by the benchmarks
+    for (const auto &privilege : privileges())
+        batch.add(CYNARA_ADMIN_WILDCARD, CYNARA_ADMIN_WILDCARD, privilege, CYNARA_ADMIN_ALLOW,
+            CynaraAdmin::Buckets.at(Bucket::USER_TYPE_NORMAL));
+    CynaraAdmin::getInstance().SetPolicies(batch);
+
+    CynaraAdmin::getInstance().UserInit(static_cast<uid_t>(std::stoul(USER)),
+        SM_USER_TYPE_NORMAL);
+    CynaraAdmin::getInstance().UpdateAppPolicy(LABEL, USER, std::vector<std::string>(),
+        privileges());
+
+    cynara_stub_set_latency(LATENCY_US);
+}
+
+} // namespace anonymous
+
+void registerCynaraBench(Runner &runner)
+{
+    setupPolicy();
+    std::vector<std::string> privs = privileges();
+    std::string suffix = "/" + std::to_string(PRIVILEGE_COUNT) + "x" +
+        std::to_string(LATENCY_US) + "us";
+
+    runner.add("cynara/check-privileges/sync" + suffix, [=] {
+        size_t allowed = 0;
+        for (const auto &privilege : privs)
+            allowed += Cynara::getInstance().check(LABEL, privilege, USER, SESSION);
+        doNotOptimize(allowed);
+    });
+
+    runner.add("cynara/check-privileges/async" + suffix, [=] {
+        std::vector<bool> results;
+        Cynara::getInstance().check(LABEL, privs, USER, SESSION, results);
+        doNotOptimize(results);
+    });
+
+    runner.add("cynara/max-level/admin-check" + suffix, [=] {
+        int level = 0;
+        for (const auto &privilege : privs)
+            level |= CynaraAdmin::getInstance().GetPrivilegeManagerMaxLevel(LABEL, USER,
+                privilege);
+        doNotOptimize(level);
+    });
+
+    runner.add("cynara/max-level/snapshot" + suffix, [=] {
+        CynaraPolicySnapshot snapshot(USER);
+        int level = 0;
+        for (const auto &privilege : privs)
+            level |= snapshot.GetPrivilegeManagerMaxLevel(LABEL, USER, privilege);
+        doNotOptimize(level);
+    });
+}
+
+} // namespace Bench
+} // namespace SecurityManager
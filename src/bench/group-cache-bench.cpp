@@ -0,0 +1,55 @@
+/*
+ *  Copyright (c) 2014 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *  Contact: Rafal Krypa <r.krypa@samsung.com>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License
+ */
+/*
+ * @file        group-cache-bench.cpp
+ * @brief       Benchmarks of group name to gid translation
+ */
+
+#include <grp.h>
+
+#include <group_cache.h>
+
+#include <bench.h>
+
+namespace SecurityManager {
+namespace Bench {
+
+namespace {
+
+/* Present on every system */
+const char *const GROUP = "root";
+
+} // namespace anonymous
+
+void registerGroupCacheBench(Runner &runner)
+{
+    runner.add("group/getgrnam", [] {
+        struct group *grp = getgrnam(GROUP);
+        doNotOptimize(grp);
+    });
+
+    runner.add("group/cache-hit", [] {
+        GroupCache::getInstance().enable();
+        gid_t gid;
+        bool found = GroupCache::getInstance().getGid(GROUP, gid);
+        doNotOptimize(found);
+    });
+}
+
+} // namespace Bench
+} // namespace SecurityManager
@@ -0,0 +1,116 @@
+/*
+ *  Copyright (c) 2014 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *  Contact: Rafal Krypa <r.krypa@samsung.com>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License
+ */
+/*
+ * @file        bench.h
+ * @brief       Minimal microbenchmark runner used by security-manager-bench
+ */
+
+#ifndef _SECURITY_MANAGER_BENCH_
+#define _SECURITY_MANAGER_BENCH_
+
+#include <cstddef>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace SecurityManager {
+namespace Bench {
+
+/*
+ * Prevent the compiler from optimizing away computation of a value that
+ * is otherwise unused by the benchmark body.
+ */
+template <typename T>
+inline void doNotOptimize(const T &value)
+{
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+struct Result {
+    std::string name;
+    size_t iterations;
+    double nsPerOp;
+    size_t bytesPerOp;
+};
+
+/* Single measured value that is not a timing, e.g. memory footprint */
+struct Metric {
+    std::string name;
+    double value;
+    std::string unit;
+};
+
+class Runner {
+public:
+    typedef std::function<void()> Body;
+
+    Runner();
+
+    /*
+     * Register benchmark case. Body performs a single operation, bytesPerOp
+     * (if non-zero) is used to compute throughput.
+     */
+    void add(const std::string &name, Body body, size_t bytesPerOp = 0);
+
+    /* Record a metric, reported if its name matches the filter */
+    void addMetric(const std::string &name, double value, const std::string &unit);
+
+    /* Run only cases with name containing given substring */
+    void setFilter(const std::string &filter);
+
+    /* Minimal measured time per case, in seconds */
+    void setMinTime(double seconds);
+
+    /* Run all registered cases matching the filter */
+    void run();
+
+    /* Write results as JSON document */
+    void writeJson(std::ostream &out) const;
+
+private:
+    Result runCase(const std::string &name, const Body &body, size_t bytesPerOp);
+
+    struct Case {
+        std::string name;
+        Body body;
+        size_t bytesPerOp;
+    };
+
+    std::vector<Case> m_cases;
+    std::vector<Result> m_results;
+    std::vector<Metric> m_metrics;
+    std::string m_filter;
+    double m_minTime;
+};
+
+/* Benchmark suites, each registers its cases in the runner */
+void registerSerializationBench(Runner &runner);
+void registerPrivilegeIndexBench(Runner &runner);
+void registerPrivilegeDbBench(Runner &runner);
+void registerGroupCacheBench(Runner &runner);
+void registerSmackLabelsBench(Runner &runner);
+void registerSmackRulesBench(Runner &runner);
+#ifdef CYNARA_STUB
+void registerCynaraBench(Runner &runner);
+#endif
+
+} // namespace Bench
+} // namespace SecurityManager
+
+#endif // _SECURITY_MANAGER_BENCH_
@@ -0,0 +1,181 @@
+/*
+ *  Copyright (c) 2014 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *  Contact: Rafal Krypa <r.krypa@samsung.com>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License
+ */
+/*
+ * @file        privilege-db-bench.cpp
+ * @brief       Benchmarks of privilege database reads concurrent with installation
+ */
+
+#include <sqlite3.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <privilege_db.h>
+
+#include <bench.h>
+
+namespace SecurityManager {
+namespace Bench {
+
+namespace {
+
+const size_t APP_COUNT = 1000;
+const size_t PRIVILEGES_PER_APP = 20;
+const size_t READER_THREADS = 4;
+const size_t LOOKUPS_PER_READER = 250;
+const uid_t GLOBAL_UID = 0;
+
+std::string appName(size_t i)
+{
+    return "org.tizen.bench.app" + std::to_string(i);
+}
+
+std::string pkgName(size_t i)
+{
+    return "org.tizen.bench.package" + std::to_string(i);
+}
+
+std::vector<std::string> privileges(size_t i)
+{
+    std::vector<std::string> result;
+    for (size_t p = 0; p < PRIVILEGES_PER_APP; ++p)
+        result.push_back("http://tizen.org/privilege/bench." + std::to_string((i + p) % 150));
+    return result;
+}
+
+void install(PrivilegeDb &db, size_t i)
+{
+    db.BeginTransaction();
+    db.AddApplication(appName(i), pkgName(i), GLOBAL_UID);
+    db.UpdateAppPrivileges(appName(i), GLOBAL_UID, privileges(i));
+    db.CommitTransaction();
+}
+
+/* Temporary database created from db.sql, removed on destruction */
+class BenchDb {
+public:
+    BenchDb()
+    {
+        char path[] = "/tmp/security-manager-bench-XXXXXX";
+        int fd = mkstemp(path);
+        if (fd < 0)
+            throw std::runtime_error("Cannot create temporary database");
+        close(fd);
+        m_path = path;
+
+        std::ifstream file(DB_SQL_PATH);
+        std::stringstream script;
+        script << file.rdbuf();
+        sqlite3 *connection;
+        if (sqlite3_open(m_path.c_str(), &connection) != SQLITE_OK) {
+            sqlite3_close(connection);
+            throw std::runtime_error("Cannot open temporary database");
+        }
+        int ret = sqlite3_exec(connection, script.str().c_str(), NULL, NULL, NULL);
+        sqlite3_close(connection);
+        if (ret != SQLITE_OK)
+            throw std::runtime_error("Cannot create database schema from " DB_SQL_PATH);
+
+        m_db.reset(new PrivilegeDb(m_path));
+        for (size_t i = 0; i < APP_COUNT; ++i)
+            install(*m_db, i);
+    }
+
+    ~BenchDb()
+    {
+        m_db.reset();
+        for (const char *suffix : {"", "-wal", "-shm", "-journal"})
+            unlink((m_path + suffix).c_str());
+    }
+
+    PrivilegeDb &db() { return *m_db; }
+
+private:
+    std::string m_path;
+    std::unique_ptr<PrivilegeDb> m_db;
+};
+
+/*
+ * Single operation: READER_THREADS threads doing LOOKUPS_PER_READER
+ * GetAppPkgId calls each, optionally with another thread installing
+ * applications for the whole time.
+ */
+void readRound(BenchDb &benchDb, bool withInstaller)
+{
+    PrivilegeDb &db = benchDb.db();
+    std::atomic<bool> done(false);
+    std::thread installer;
+
+    static size_t installed = APP_COUNT;
+    if (withInstaller)
+        installer = std::thread([&] {
+            while (!done)
+                install(db, installed++);
+        });
+
+    std::vector<std::thread> readers;
+    for (size_t t = 0; t < READER_THREADS; ++t)
+        readers.emplace_back([&db, t] {
+            std::string pkgId;
+            for (size_t i = 0; i < LOOKUPS_PER_READER; ++i) {
+                bool found = db.GetAppPkgId(appName((t * 7919 + i * 31) % APP_COUNT), pkgId);
+                doNotOptimize(found);
+            }
+        });
+
+    for (auto &reader : readers)
+        reader.join();
+    done = true;
+    if (installer.joinable())
+        installer.join();
+}
+
+} // namespace anonymous
+
+void registerPrivilegeDbBench(Runner &runner)
+{
+    /* Database is created on first use, only if any of the cases is run */
+    auto benchDb = std::make_shared<std::unique_ptr<BenchDb>>();
+    auto getDb = [benchDb]() -> BenchDb & {
+        if (!*benchDb)
+            benchDb->reset(new BenchDb);
+        return **benchDb;
+    };
+
+    std::string name = "privilege-db/get-app-pkgid/" + std::to_string(READER_THREADS) +
+        "x" + std::to_string(LOOKUPS_PER_READER);
+
+    runner.add(name, [getDb] {
+        readRound(getDb(), false);
+    });
+
+    runner.add(name + "/during-install", [getDb] {
+        readRound(getDb(), true);
+    });
+}
+
+} // namespace Bench
+} // namespace SecurityManager
@@ -0,0 +1,123 @@
+/*
+ *  Copyright (c) 2014 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *  Contact: Rafal Krypa <r.krypa@samsung.com>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License
+ */
+/*
+ * @file        privilege-index-bench.cpp
+ * @brief       Benchmarks and memory accounting of the in-memory privilege index
+ */
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <privilege_db_index.h>
+
+#include <bench.h>
+
+namespace SecurityManager {
+namespace Bench {
+
+namespace {
+
+const size_t APPS_PER_PKG = 2;
+const size_t PRIVILEGES_PER_APP = 20;
+const size_t PRIVILEGE_COUNT = 150;
+const uid_t GLOBAL_UID = 0;
+
+std::string appName(size_t i)
+{
+    return "org.tizen.bench.package" + std::to_string(i / APPS_PER_PKG) + ".app" + std::to_string(i);
+}
+
+std::string pkgName(size_t i)
+{
+    return "org.tizen.bench.package" + std::to_string(i / APPS_PER_PKG);
+}
+
+std::string privilegeName(size_t i)
+{
+    return "http://tizen.org/privilege/bench.privilege." + std::to_string(i % PRIVILEGE_COUNT);
+}
+
+/* Index with a realistic shape: every app has 20 of 150 known privileges */
+std::shared_ptr<PrivilegeDbIndex> makeIndex(size_t apps)
+{
+    auto index = std::make_shared<PrivilegeDbIndex>();
+    for (size_t p = 0; p < PRIVILEGE_COUNT; p += 5)
+        index->addPrivilegeGroup(privilegeName(p), "bench_group" + std::to_string(p));
+
+    for (size_t i = 0; i < apps; ++i) {
+        index->addApplication(appName(i), pkgName(i), GLOBAL_UID);
+        std::vector<std::string> privileges;
+        for (size_t p = 0; p < PRIVILEGES_PER_APP; ++p)
+            privileges.push_back(privilegeName(i * 7 + p));
+        index->setAppPrivileges(appName(i), GLOBAL_UID, privileges);
+    }
+    return index;
+}
+
+} // namespace anonymous
+
+void registerPrivilegeIndexBench(Runner &runner)
+{
+    for (size_t apps : {1000, 10000}) {
+        auto index = makeIndex(apps);
+        std::string suffix = "/" + std::to_string(apps);
+
+        runner.addMetric("privilege-index/memory" + suffix, index->memoryUsage(), "bytes");
+        runner.addMetric("privilege-index/memory-per-app" + suffix,
+            static_cast<double>(index->memoryUsage()) / apps, "bytes");
+
+        runner.add("privilege-index/load" + suffix,
+            [apps]() {
+                auto loaded = makeIndex(apps);
+                doNotOptimize(loaded);
+            });
+
+        std::string app = appName(apps / 2);
+        std::string pkg = pkgName(apps / 2);
+
+        runner.add("privilege-index/get-app-pkgid" + suffix,
+            [index, app]() {
+                std::string pkgId;
+                index->getAppPkgId(app, pkgId);
+                doNotOptimize(pkgId);
+            });
+
+        // Lookups done by ServiceImpl::getAppGroups()
+        runner.add("privilege-index/get-app-groups" + suffix,
+            [index, app]() {
+                std::string pkgId;
+                std::vector<std::string> privileges, groups;
+                index->getAppPkgId(app, pkgId);
+                index->getPkgPrivileges(pkgId, GLOBAL_UID, privileges);
+                for (const auto &privilege : privileges)
+                    index->getPrivilegeGroups(privilege, groups);
+                doNotOptimize(groups);
+            });
+
+        runner.add("privilege-index/get-apps-in-pkg" + suffix,
+            [index, pkg]() {
+                std::vector<std::string> appIds;
+                index->getAppIdsForPkgId(pkg, appIds);
+                doNotOptimize(appIds);
+            });
+    }
+}
+
+} // namespace Bench
+} // namespace SecurityManager
@@ -0,0 +1,470 @@
+/*
+ *  Copyright (c) 2014 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *  Contact: Rafal Krypa <r.krypa@samsung.com>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License
+ */
+/*
+ * @file        serialization-bench.cpp
+ * @brief       Benchmarks of protocol serialization, MessageBuffer and BinaryQueue
+ */
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <dpl/binary_queue.h>
+#include <dpl/serialization.h>
+#include <message-buffer.h>
+#include <protocols.h>
+
+#include <bench.h>
+
+namespace SecurityManager {
+namespace Bench {
+
+namespace {
+
+const uid_t BENCH_UID = 5001;
+
+app_inst_req makeAppInstReq()
+{
+    app_inst_req req;
+    req.appId = "org.tizen.bench.application";
+    req.pkgId = "org.tizen.bench";
+    for (int i = 0; i < 24; ++i)
+        req.privileges.push_back("http://tizen.org/privilege/bench.privilege." + std::to_string(i));
+    req.appPaths.push_back({"/opt/usr/apps/org.tizen.bench/data", SECURITY_MANAGER_PATH_PRIVATE});
+    req.appPaths.push_back({"/opt/usr/apps/org.tizen.bench/cache", SECURITY_MANAGER_PATH_PRIVATE});
+    req.appPaths.push_back({"/opt/usr/apps/org.tizen.bench/shared", SECURITY_MANAGER_PATH_PUBLIC});
+    req.appPaths.push_back({"/opt/usr/apps/org.tizen.bench/res", SECURITY_MANAGER_PATH_PUBLIC_RO});
+    req.uid = BENCH_UID;
+    return req;
+}
+
+policy_entry makePolicyEntry(size_t i)
+{
+    policy_entry entry;
+    entry.user = std::to_string(BENCH_UID + i % 4);
+    entry.appId = "org.tizen.bench.application" + std::to_string(i / 32);
+    entry.privilege = "http://tizen.org/privilege/bench.privilege." + std::to_string(i % 32);
+    entry.currentLevel = "Allow";
+    entry.maxLevel = "Allow";
+    return entry;
+}
+
+std::vector<policy_entry> makePolicyEntries(size_t count)
+{
+    std::vector<policy_entry> entries;
+    entries.reserve(count);
+    for (size_t i = 0; i < count; ++i)
+        entries.push_back(makePolicyEntry(i));
+    return entries;
+}
+
+/*
+ * Encode and decode functions of a single protocol message, written the same
+ * way client and service do it.
+ */
+struct Message {
+    std::string name;
+    std::function<void(MessageBuffer &)> encode;
+    std::function<void(MessageBuffer &)> decode;
+};
+
+void encodePolicyReply(MessageBuffer &send, const std::vector<policy_entry> &entries)
+{
+    Serialization::Serialize(send, static_cast<int>(SECURITY_MANAGER_API_SUCCESS));
+    Serialization::Serialize(send, static_cast<int>(entries.size()));
+    for (const auto &entry : entries)
+        Serialization::Serialize(send, entry);
+}
+
+void decodePolicyReply(MessageBuffer &recv)
+{
+    int ret, count;
+    Deserialization::Deserialize(recv, ret);
+    Deserialization::Deserialize(recv, count);
+    std::vector<policy_entry> entries;
+    entries.reserve(count);
+    for (int i = 0; i < count; ++i)
+        entries.emplace_back(recv);
+    doNotOptimize(entries);
+}
+
+std::vector<Message> protocolMessages()
+{
+    static const app_inst_req req = makeAppInstReq();
+    static const policy_entry filter = makePolicyEntry(0);
+    static const std::vector<policy_entry> update = makePolicyEntries(16);
+    static const std::vector<policy_entry> policy100 = makePolicyEntries(100);
+    static const std::vector<policy_entry> policy10k = makePolicyEntries(10000);
+
+    auto decodeCall = [](MessageBuffer &buffer) {
+        int call;
+        Deserialization::Deserialize(buffer, call);
+        doNotOptimize(call);
+    };
+
+    std::vector<Message> messages;
+
+    messages.push_back({"NOOP",
+        [](MessageBuffer &send) {
+            Serialization::Serialize(send, static_cast<int>(SecurityModuleCall::NOOP));
+        },
+        decodeCall});
+
+    messages.push_back({"APP_INSTALL",
+        [](MessageBuffer &send) {
+            Serialization::Serialize(send, static_cast<int>(SecurityModuleCall::APP_INSTALL));
+            Serialization::Serialize(send, req.appId);
+            Serialization::Serialize(send, req.pkgId);
+            Serialization::Serialize(send, req.privileges);
+            Serialization::Serialize(send, req.appPaths);
+            Serialization::Serialize(send, req.uid);
+        },
+        [decodeCall](MessageBuffer &buffer) {
+            app_inst_req r;
+            decodeCall(buffer);
+            Deserialization::Deserialize(buffer, r.appId);
+            Deserialization::Deserialize(buffer, r.pkgId);
+            Deserialization::Deserialize(buffer, r.privileges);
+            Deserialization::Deserialize(buffer, r.appPaths);
+            Deserialization::Deserialize(buffer, r.uid);
+            doNotOptimize(r);
+        }});
+
+    const std::vector<std::pair<SecurityModuleCall, std::string>> appIdCalls = {
+        {SecurityModuleCall::APP_UNINSTALL, "APP_UNINSTALL"},
+        {SecurityModuleCall::APP_GET_PKGID, "APP_GET_PKGID"},
+        {SecurityModuleCall::APP_GET_GROUPS, "APP_GET_GROUPS"},
+    };
+    for (const auto &appIdCall : appIdCalls) {
+        SecurityModuleCall call = appIdCall.first;
+        messages.push_back({appIdCall.second,
+            [call](MessageBuffer &send) {
+                Serialization::Serialize(send, static_cast<int>(call));
+                Serialization::Serialize(send, req.appId);
+            },
+            [decodeCall](MessageBuffer &buffer) {
+                std::string appId;
+                decodeCall(buffer);
+                Deserialization::Deserialize(buffer, appId);
+                doNotOptimize(appId);
+            }});
+    }
+
+    messages.push_back({"USER_ADD",
+        [](MessageBuffer &send) {
+            Serialization::Serialize(send, static_cast<int>(SecurityModuleCall::USER_ADD));
+            Serialization::Serialize(send, BENCH_UID);
+            Serialization::Serialize(send, static_cast<int>(SM_USER_TYPE_NORMAL));
+        },
+        [decodeCall](MessageBuffer &buffer) {
+            uid_t uid;
+            int userType;
+            decodeCall(buffer);
+            Deserialization::Deserialize(buffer, uid);
+            Deserialization::Deserialize(buffer, userType);
+            doNotOptimize(uid);
+            doNotOptimize(userType);
+        }});
+
+    messages.push_back({"USER_DELETE",
+        [](MessageBuffer &send) {
+            Serialization::Serialize(send, static_cast<int>(SecurityModuleCall::USER_DELETE));
+            Serialization::Serialize(send, BENCH_UID);
+        },
+        [decodeCall](MessageBuffer &buffer) {
+            uid_t uid;
+            decodeCall(buffer);
+            Deserialization::Deserialize(buffer, uid);
+            doNotOptimize(uid);
+        }});
+
+    messages.push_back({"POLICY_UPDATE",
+        [](MessageBuffer &send) {
+            std::vector<const policy_entry *> units;
+            for (const auto &entry : update)
+                units.push_back(&entry);
+            Serialization::Serialize(send, static_cast<int>(SecurityModuleCall::POLICY_UPDATE));
+            Serialization::Serialize(send, units);
+        },
+        [decodeCall](MessageBuffer &buffer) {
+            std::vector<policy_entry> entries;
+            decodeCall(buffer);
+            Deserialization::Deserialize(buffer, entries);
+            doNotOptimize(entries);
+        }});
+
+    const std::vector<std::pair<SecurityModuleCall, std::string>> filterCalls = {
+        {SecurityModuleCall::GET_POLICY, "GET_POLICY"},
+        {SecurityModuleCall::GET_CONF_POLICY_ADMIN, "GET_CONF_POLICY_ADMIN"},
+        {SecurityModuleCall::GET_CONF_POLICY_SELF, "GET_CONF_POLICY_SELF"},
+    };
+    for (const auto &filterCall : filterCalls) {
+        SecurityModuleCall call = filterCall.first;
+        messages.push_back({filterCall.second,
+            [call](MessageBuffer &send) {
+                Serialization::Serialize(send, static_cast<int>(call));
+                Serialization::Serialize(send, filter);
+            },
+            [decodeCall](MessageBuffer &buffer) {
+                decodeCall(buffer);
+                policy_entry f(buffer);
+                doNotOptimize(f);
+            }});
+    }
+
+    messages.push_back({"POLICY_GET_DESCRIPTIONS",
+        [](MessageBuffer &send) {
+            Serialization::Serialize(send, static_cast<int>(SecurityModuleCall::POLICY_GET_DESCRIPTIONS));
+        },
+        decodeCall});
+
+    messages.push_back({"reply/APP_GET_PKGID",
+        [](MessageBuffer &send) {
+            Serialization::Serialize(send, static_cast<int>(SECURITY_MANAGER_API_SUCCESS));
+            Serialization::Serialize(send, req.pkgId);
+        },
+        [](MessageBuffer &recv) {
+            int ret;
+            std::string pkgId;
+            Deserialization::Deserialize(recv, ret);
+            Deserialization::Deserialize(recv, pkgId);
+            doNotOptimize(pkgId);
+        }});
+
+    messages.push_back({"reply/APP_GET_GROUPS",
+        [](MessageBuffer &send) {
+            Serialization::Serialize(send, static_cast<int>(SECURITY_MANAGER_API_SUCCESS));
+            Serialization::Serialize(send, 16);
+            for (int gid = 100; gid < 116; ++gid)
+                Serialization::Serialize(send, gid);
+        },
+        [](MessageBuffer &recv) {
+            int ret, count;
+            Deserialization::Deserialize(recv, ret);
+            Deserialization::Deserialize(recv, count);
+            std::vector<gid_t> gids(count);
+            for (int i = 0; i < count; ++i)
+                Deserialization::Deserialize(recv, gids[i]);
+            doNotOptimize(gids);
+        }});
+
+    messages.push_back({"reply/GET_POLICY/100",
+        [](MessageBuffer &send) { encodePolicyReply(send, policy100); },
+        decodePolicyReply});
+
+    messages.push_back({"reply/GET_POLICY/10000",
+        [](MessageBuffer &send) { encodePolicyReply(send, policy10k); },
+        decodePolicyReply});
+
+    return messages;
+}
+
+void registerProtocolCases(Runner &runner)
+{
+    for (const auto &message : protocolMessages()) {
+        MessageBuffer sample;
+        message.encode(sample);
+        RawBuffer raw = sample.Pop();
+
+        auto encode = message.encode;
+        runner.add("protocol/" + message.name + "/encode",
+            [encode]() {
+                MessageBuffer send;
+                encode(send);
+                RawBuffer out = send.Pop();
+                doNotOptimize(out);
+            }, raw.size());
+
+        auto decode = message.decode;
+        runner.add("protocol/" + message.name + "/decode",
+            [decode, raw]() {
+                MessageBuffer recv;
+                recv.Push(raw);
+                if (recv.Ready())
+                    decode(recv);
+            }, raw.size());
+    }
+}
+
+void registerMessageBufferCases(Runner &runner)
+{
+    for (size_t size : {64, 4096, 65536, 1048576}) {
+        RawBuffer payload(size, 0x5a);
+        MessageBuffer framed;
+        framed.Write(payload.size(), payload.data());
+        RawBuffer raw = framed.Pop();
+        std::string suffix = "/" + std::to_string(size);
+
+        runner.add("message-buffer/push-pop" + suffix,
+            [payload]() {
+                MessageBuffer buffer;
+                buffer.Push(payload);
+                RawBuffer out = buffer.Pop();
+                doNotOptimize(out);
+            }, size);
+
+        // The way sendToServer() receives a reply: 2048 byte reads, Ready() after each
+        runner.add("message-buffer/chunked-receive" + suffix,
+            [raw]() {
+                MessageBuffer recv;
+                size_t done = 0;
+                do {
+                    size_t chunk = std::min<size_t>(2048, raw.size() - done);
+                    RawBuffer part(raw.begin() + done, raw.begin() + done + chunk);
+                    recv.Push(part);
+                    done += chunk;
+                } while (!recv.Ready() && done < raw.size());
+                doNotOptimize(recv);
+            }, raw.size());
+
+        runner.add("message-buffer/ready-read" + suffix,
+            [raw, size]() {
+                MessageBuffer recv;
+                recv.Push(raw);
+                RawBuffer out(size);
+                if (recv.Ready())
+                    recv.Read(size, out.data());
+                doNotOptimize(out);
+            }, size);
+    }
+}
+
+void registerBinaryQueueCases(Runner &runner)
+{
+    static const unsigned char data[4096] = {};
+
+    runner.add("binary-queue/append-copy-small/1024x16",
+        []() {
+            BinaryQueue queue;
+            for (int i = 0; i < 1024; ++i)
+                queue.AppendCopy(data, 16);
+            doNotOptimize(queue);
+        }, 1024 * 16);
+
+    runner.add("binary-queue/append-copy-large/16x4096",
+        []() {
+            BinaryQueue queue;
+            for (int i = 0; i < 16; ++i)
+                queue.AppendCopy(data, sizeof(data));
+            doNotOptimize(queue);
+        }, 16 * sizeof(data));
+
+    runner.add("binary-queue/append-unmanaged/1024x16",
+        []() {
+            BinaryQueue queue;
+            for (int i = 0; i < 1024; ++i)
+                queue.AppendUnmanaged(data, 16, [](const void *, size_t, void *) {});
+            doNotOptimize(queue);
+        }, 1024 * 16);
+
+    runner.add("binary-queue/flatten/16x4096",
+        []() {
+            BinaryQueue queue;
+            for (int i = 0; i < 16; ++i)
+                queue.AppendCopy(data, sizeof(data));
+            std::vector<unsigned char> out(queue.Size());
+            queue.Flatten(out.data(), out.size());
+            doNotOptimize(out);
+        }, 16 * sizeof(data));
+
+    // Deserialization reads buckets in small pieces, e.g. an int at a time
+    runner.add("binary-queue/consume-int/1024x16",
+        []() {
+            BinaryQueue queue;
+            for (int i = 0; i < 1024; ++i)
+                queue.AppendCopy(data, 16);
+            int value;
+            while (!queue.Empty())
+                queue.FlattenConsume(&value, sizeof(value));
+            doNotOptimize(value);
+        }, 1024 * 16);
+
+    runner.add("binary-queue/consume-all/16x4096",
+        []() {
+            BinaryQueue queue;
+            for (int i = 0; i < 16; ++i)
+                queue.AppendCopy(data, sizeof(data));
+            std::vector<unsigned char> out(queue.Size());
+            queue.FlattenConsume(out.data(), out.size());
+            doNotOptimize(out);
+        }, 16 * sizeof(data));
+
+    runner.add("binary-queue/append-move-from/1024x16",
+        []() {
+            BinaryQueue source, target;
+            for (int i = 0; i < 1024; ++i)
+                source.AppendCopy(data, 16);
+            target.AppendMoveFrom(source);
+            doNotOptimize(target);
+        }, 1024 * 16);
+}
+
+void registerRoundTripCases(Runner &runner)
+{
+    static const app_inst_req req = makeAppInstReq();
+
+    runner.add("round-trip/app_inst_req",
+        []() {
+            MessageBuffer send;
+            Serialization::Serialize(send, req.appId);
+            Serialization::Serialize(send, req.pkgId);
+            Serialization::Serialize(send, req.privileges);
+            Serialization::Serialize(send, req.appPaths);
+            Serialization::Serialize(send, req.uid);
+
+            MessageBuffer recv;
+            recv.Push(send.Pop());
+            recv.Ready();
+
+            app_inst_req r;
+            Deserialization::Deserialize(recv, r.appId);
+            Deserialization::Deserialize(recv, r.pkgId);
+            Deserialization::Deserialize(recv, r.privileges);
+            Deserialization::Deserialize(recv, r.appPaths);
+            Deserialization::Deserialize(recv, r.uid);
+            doNotOptimize(r);
+        });
+
+    for (size_t count : {1000, 10000, 100000}) {
+        auto entries = std::make_shared<std::vector<policy_entry>>(makePolicyEntries(count));
+        runner.add("round-trip/policy_entry/" + std::to_string(count),
+            [entries]() {
+                MessageBuffer send;
+                encodePolicyReply(send, *entries);
+
+                MessageBuffer recv;
+                recv.Push(send.Pop());
+                recv.Ready();
+                decodePolicyReply(recv);
+            });
+    }
+}
+
+} // namespace anonymous
+
+void registerSerializationBench(Runner &runner)
+{
+    registerProtocolCases(runner);
+    registerMessageBufferCases(runner);
+    registerBinaryQueueCases(runner);
+    registerRoundTripCases(runner);
+}
+
+} // namespace Bench
+} // namespace SecurityManager
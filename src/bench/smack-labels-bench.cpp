@@ -0,0 +1,147 @@
+/*
+ *  Copyright (c) 2014 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *  Contact: Rafal Krypa <r.krypa@samsung.com>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License
+ */
+/*
+ * @file        smack-labels-bench.cpp
+ * @brief       Benchmarks of labeling application directory trees
+ */
+
+#include <fcntl.h>
+#include <ftw.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+#include <smack-backend.h>
+#include <smack-check.h>
+#include <smack-labels.h>
+
+#include <bench.h>
+
+namespace SecurityManager {
+namespace Bench {
+
+namespace {
+
+/* 10 * 10 * 10 leaf directories with 100 files each, every 10th executable */
+const size_t TREE_FANOUT = 10;
+const size_t TREE_DEPTH = 3;
+const size_t FILES_PER_LEAF = 100;
+const char *const APP_ID = "org.tizen.bench.labels";
+
+void makeDir(const std::string &path)
+{
+    if (mkdir(path.c_str(), 0755))
+        throw std::runtime_error("Cannot create directory " + path);
+}
+
+void makeTree(const std::string &path, size_t depth)
+{
+    if (!depth) {
+        for (size_t i = 0; i < FILES_PER_LEAF; ++i) {
+            std::string file = path + "/file" + std::to_string(i);
+            int fd = open(file.c_str(), O_CREAT | O_WRONLY | O_CLOEXEC, i % 10 ? 0644 : 0755);
+            if (fd < 0)
+                throw std::runtime_error("Cannot create file " + file);
+            close(fd);
+        }
+        return;
+    }
+
+    for (size_t i = 0; i < TREE_FANOUT; ++i) {
+        std::string dir = path + "/dir" + std::to_string(i);
+        makeDir(dir);
+        makeTree(dir, depth - 1);
+    }
+}
+
+int removeEntry(const char *path, const struct stat *, int, struct FTW *)
+{
+    return remove(path);
+}
+
+/* Temporary directory tree, removed on destruction */
+class BenchTree {
+public:
+    BenchTree()
+    {
+        char path[] = "/tmp/security-manager-bench-XXXXXX";
+        if (!mkdtemp(path))
+            throw std::runtime_error("Cannot create temporary directory");
+        m_path = path;
+        makeTree(m_path, TREE_DEPTH);
+    }
+
+    ~BenchTree()
+    {
+        nftw(m_path.c_str(), removeEntry, 64, FTW_DEPTH | FTW_PHYS);
+    }
+
+    const std::string &path() const { return m_path; }
+
+private:
+    std::string m_path;
+};
+
+} // namespace anonymous
+
+void registerSmackLabelsBench(Runner &runner)
+{
+    // Kernel labels can only be set on a Smack enabled system, by a privileged user
+    if (!strcmp(SmackBackend::get().name(), "kernel") && !smack_check()) {
+        std::cerr << "Smack is not available, skipping smack-labels benchmarks, "
+            "use --smack-backend user-xattr or memory to run them" << std::endl;
+        return;
+    }
+
+    /* Tree is created on first use, only if any of the cases is run */
+    auto benchTree = std::make_shared<std::unique_ptr<BenchTree>>();
+    auto getTree = [benchTree]() -> BenchTree & {
+        if (!*benchTree)
+            benchTree->reset(new BenchTree);
+        return **benchTree;
+    };
+
+    for (unsigned threads : {1, 4}) {
+        std::string name = "smack-labels/setup-path/" + std::to_string(threads) +
+            "-threads/100k-files";
+        runner.add(name, [getTree, threads] {
+            SmackLabels::setLabelingThreads(threads);
+            SmackLabels::setupPath(APP_ID, getTree().path(), SECURITY_MANAGER_PATH_RW);
+            SmackLabels::setLabelingThreads(1);
+        });
+    }
+
+    // Reinstall, labels are already in place and only read
+    auto labeled = std::make_shared<bool>(false);
+    runner.add("smack-labels/setup-path/incremental/100k-files", [getTree, labeled] {
+        if (!*labeled) {
+            SmackLabels::setupPath(APP_ID, getTree().path(), SECURITY_MANAGER_PATH_RW);
+            *labeled = true;
+        }
+        SmackLabels::setupPath(APP_ID, getTree().path(), SECURITY_MANAGER_PATH_RW, true);
+    });
+}
+
+} // namespace Bench
+} // namespace SecurityManager
@@ -0,0 +1,152 @@
+/*
+ *  Copyright (c) 2014 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *  Contact: Rafal Krypa <r.krypa@samsung.com>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License
+ */
+/*
+ * @file        smack-rules-bench.cpp
+ * @brief       Benchmarks of loading Smack rules of installed applications on boot
+ */
+
+#include <dirent.h>
+#include <sys/smack.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+#include <smack-backend.h>
+#include <smack-check.h>
+#include <smack-rules.h>
+#include <smack-rules-store.h>
+
+#include <bench.h>
+
+namespace SecurityManager {
+namespace Bench {
+
+namespace {
+
+/* Rule files as left by installation of 100 packages, 10 applications each */
+const size_t PACKAGES = 100;
+const size_t APPS_PER_PACKAGE = 10;
+const size_t RULES_PER_APP = 50;
+
+std::string appLabel(size_t pkg, size_t app)
+{
+    return "User::App::bench.pkg" + std::to_string(pkg) + ".app" + std::to_string(app);
+}
+
+/* Temporary accesses.d and store built from it, removed on destruction */
+class BenchRules {
+public:
+    BenchRules()
+    {
+        char path[] = "/tmp/security-manager-bench-XXXXXX";
+        if (!mkdtemp(path))
+            throw std::runtime_error("Cannot create temporary directory");
+        m_dir = path;
+        m_store = m_dir + "/store";
+
+        for (size_t pkg = 0; pkg < PACKAGES; ++pkg) {
+            SmackRules pkgRules;
+            for (size_t app = 0; app < APPS_PER_PACKAGE; ++app) {
+                SmackRules appRules;
+                std::string label = appLabel(pkg, app);
+                for (size_t i = 0; i < RULES_PER_APP; ++i)
+                    appRules.add(label, "bench.object" + std::to_string(i), "rwxat");
+                appRules.saveToFile(m_dir + "/app_bench.pkg" + std::to_string(pkg) +
+                    ".app" + std::to_string(app));
+
+                for (size_t other = 0; other < APPS_PER_PACKAGE; ++other)
+                    if (other != app)
+                        pkgRules.add(label, appLabel(pkg, other), "rwxat");
+            }
+            pkgRules.saveToFile(m_dir + "/pkg_bench.pkg" + std::to_string(pkg));
+        }
+
+        SmackRulesStore::build(m_dir, m_store);
+    }
+
+    ~BenchRules()
+    {
+        std::unique_ptr<DIR, int (*)(DIR *)> dir(opendir(m_dir.c_str()), closedir);
+        struct dirent *entry;
+        while (dir && (entry = readdir(dir.get())) != nullptr)
+            unlink((m_dir + "/" + entry->d_name).c_str());
+        rmdir(m_dir.c_str());
+    }
+
+    const std::string &dir() const { return m_dir; }
+    const std::string &store() const { return m_store; }
+
+private:
+    std::string m_dir;
+    std::string m_store;
+};
+
+} // namespace anonymous
+
+void registerSmackRulesBench(Runner &runner)
+{
+    // Without Smack rules are only parsed, or written to /dev/null, unless
+    // another backend simulates the policy
+    bool simulated = strcmp(SmackBackend::get().name(), "kernel") != 0;
+    bool kernel = !simulated && smack_check();
+    if (!kernel && !simulated)
+        std::cerr << "Smack is not available, smack-rules benchmarks don't load rules "
+            "to the kernel" << std::endl;
+
+    /* Rules are created on first use, only if any of the cases is run */
+    auto benchRules = std::make_shared<std::unique_ptr<BenchRules>>();
+    auto getRules = [benchRules]() -> BenchRules & {
+        if (!*benchRules)
+            benchRules->reset(new BenchRules);
+        return **benchRules;
+    };
+
+    // What the boot loader of accesses.d does: one file and one write per rule at a time
+    runner.add("smack-rules/boot-load/per-file/1k-apps", [getRules, kernel, simulated] {
+        const std::string &dir = getRules().dir();
+        for (size_t pkg = 0; pkg < PACKAGES; ++pkg) {
+            std::string pkgName = "bench.pkg" + std::to_string(pkg);
+            for (size_t app = 0; app < APPS_PER_PACKAGE; ++app) {
+                SmackRules rules;
+                rules.loadFromFile(dir + "/app_" + pkgName + ".app" + std::to_string(app));
+                if (kernel || simulated)
+                    rules.apply();
+            }
+            SmackRules rules;
+            rules.loadFromFile(dir + "/pkg_" + pkgName);
+            if (kernel || simulated)
+                rules.apply();
+        }
+    });
+
+    runner.add("smack-rules/boot-load/store/1k-apps", [getRules, kernel] {
+        std::string loadPath = kernel ? std::string(smack_smackfs_path()) + "/load2" :
+            "/dev/null";
+        size_t rules = SmackRulesStore::load(getRules().store(), loadPath);
+        doNotOptimize(rules);
+    });
+}
+
+} // namespace Bench
+} // namespace SecurityManager
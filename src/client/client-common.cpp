@@ -24,6 +24,8 @@
 
 #include <fcntl.h>
 #include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/un.h>
@@ -167,6 +169,48 @@ private:
     int m_sock;
 };
 
+void unmapReply(const void *buffer, size_t bufferSize, void *)
+{
+    munmap(const_cast<void *>(buffer), bufferSize);
+}
+
+/*
+ * Server passes large replies in a sealed memory file. Map it and hand the
+ * mapping to the message buffer, so the reply is deserialized in place.
+ */
+int pushReplyFromFd(int fd, SecurityManager::MessageBuffer &recv)
+{
+    struct stat st;
+    if (-1 == fstat(fd, &st)) {
+        int err = errno;
+        LogError("Error in fstat on reply descriptor: " << strerror(err));
+        return SECURITY_MANAGER_API_ERROR_SOCKET;
+    }
+
+#ifdef F_GET_SEALS
+    // Without these seals the server could truncate the file under our mapping
+    const int requiredSeals = F_SEAL_SHRINK | F_SEAL_WRITE;
+    int seals = fcntl(fd, F_GET_SEALS);
+    if (-1 == seals || (seals & requiredSeals) != requiredSeals) {
+        LogError("Reply descriptor is not sealed");
+        return SECURITY_MANAGER_API_ERROR_SOCKET;
+    }
+#endif
+
+    if (st.st_size <= 0)
+        return SECURITY_MANAGER_API_SUCCESS;
+
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (MAP_FAILED == data) {
+        int err = errno;
+        LogError("Error in mmap on reply descriptor: " << strerror(err));
+        return SECURITY_MANAGER_API_ERROR_SOCKET;
+    }
+
+    recv.PushUnmanaged(data, st.st_size, &unmapReply);
+    return SECURITY_MANAGER_API_SUCCESS;
+}
+
 } // namespace anonymous
 
 namespace SecurityManager {
@@ -201,10 +245,22 @@ int sendToServer(char const * const interface, const RawBuffer &send, MessageBuf
             LogError("Error in poll(POLLIN)");
             return SECURITY_MANAGER_API_ERROR_SOCKET;
         }
-        ssize_t temp = TEMP_FAILURE_RETRY(read(sock.Get(), buffer, 2048));
+
+        unsigned char cmsgbuf[CMSG_SPACE(sizeof(int))];
+        iovec iov;
+        msghdr hdr;
+        memset(&hdr, 0, sizeof(hdr));
+        iov.iov_base = buffer;
+        iov.iov_len = sizeof(buffer);
+        hdr.msg_iov = &iov;
+        hdr.msg_iovlen = 1;
+        hdr.msg_control = cmsgbuf;
+        hdr.msg_controllen = sizeof(cmsgbuf);
+
+        ssize_t temp = TEMP_FAILURE_RETRY(recvmsg(sock.Get(), &hdr, MSG_CMSG_CLOEXEC));
         if (-1 == temp) {
             int err = errno;
-            LogError("Error in read: " << strerror(err));
+            LogError("Error in recvmsg: " << strerror(err));
             return SECURITY_MANAGER_API_ERROR_SOCKET;
         }
 
@@ -213,6 +269,22 @@ int sendToServer(char const * const interface, const RawBuffer &send, MessageBuf
             return SECURITY_MANAGER_API_ERROR_SOCKET;
         }
 
+        cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr);
+        if (cmsg && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+            // Whole reply is in the passed descriptor, data bytes are only a marker
+            int fd;
+            memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+            ret = pushReplyFromFd(fd, recv);
+            close(fd);
+            if (SECURITY_MANAGER_API_SUCCESS != ret)
+                return ret;
+            if (!recv.Ready()) {
+                LogError("Incomplete reply received in descriptor");
+                return SECURITY_MANAGER_API_ERROR_SOCKET;
+            }
+            break;
+        }
+
         RawBuffer raw(buffer, buffer+temp);
         recv.Push(raw);
     } while(!recv.Ready());
@@ -33,6 +33,8 @@
 #include <dpl/singleton_safe_impl.h>
 #include <protocols.h>
 #include <security-manager.h>
+#include <smack-exceptions.h>
+#include <smack-rules-store.h>
 
 #include <boost/program_options.hpp>
 namespace po = boost::program_options;
@@ -58,6 +60,7 @@ static po::options_description getGenericOptions()
          ("help,h", "produce help message")
          ("install,i", "install an application")
          ("manage-users,m", po::value<std::string>(), "add or remove user, parameter is 'a' or 'add' (for add) and 'r' or 'remove' (for remove)")
+         ("load-rules,l", "load Smack rules of all applications to the kernel, meant for boot")
          ;
     return opts;
 }
@@ -305,6 +308,20 @@ static int manageUserOperation(const struct user_req &req, std::string operation
     return ret;
 }
 
+static int loadRules()
+{
+    try {
+        SecurityManager::SmackRulesStore::loadToKernel();
+    } catch (const SecurityManager::SmackException::Base &e) {
+        std::cout << "Failed to load Smack rules: " << e.GetMessage() << std::endl;
+        LogError("Failed to load Smack rules: " << e.DumpToString());
+        return EXIT_FAILURE;
+    }
+
+    LogDebug("Smack rules loaded successfully.");
+    return EXIT_SUCCESS;
+}
+
 int main(int argc, char *argv[])
 {
     po::variables_map vm;
@@ -346,6 +363,9 @@ int main(int argc, char *argv[])
                 return EXIT_FAILURE;
             parseUserOptions(argc, argv, *req, vm);
             return manageUserOperation(*req, operation);
+        } else if (vm.count("load-rules")) {
+            LogDebug("Load rules command.");
+            return loadRules();
         } else {
             std::cout << "No command argument was given." << std::endl;
             usage(std::string(argv[0]));
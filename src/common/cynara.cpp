@@ -21,6 +21,10 @@
  * @brief       Wrapper class for Cynara interface
  */
 
+#include <poll.h>
+#include <unistd.h>
+
+#include <algorithm>
 #include <cstring>
 #include "cynara.h"
 
@@ -32,7 +36,7 @@ namespace SecurityManager {
  * Rules for apps and users are organized into set of buckets stored in Cynara.
  * Bucket is set of rules (app, uid, privilege) -> (DENY, ALLOW, BUCKET, ...).
  *  |------------------------|
- *  |      <<allow>>         |
+ *  |       <<deny>>         |
  *  |   PRIVACY_MANAGER      |
  *  |------------------------|
  *  |  A    U   P      policy|
@@ -64,7 +68,7 @@ namespace SecurityManager {
  * Below is basic layout of buckets:
  *
  *  |------------------------|
- *  |      <<allow>>         |
+ *  |       <<deny>>         |
  *  |   PRIVACY_MANAGER      |
  *  |                        |
  *  |  * * *      Bucket:MAIN|                         |------------------|
@@ -111,6 +115,36 @@ CynaraAdmin::BucketsMap CynaraAdmin::Buckets =
     { Bucket::MANIFESTS, std::string("MANIFESTS")},
 };
 
+/* Default policies of buckets, Cynara doesn't list them. Buckets are created
+ * by policy/security-manager-policy-reload, keep both in sync. */
+static const std::map<Bucket, int> BucketDefaultPolicies =
+{
+    { Bucket::PRIVACY_MANAGER, CYNARA_ADMIN_DENY},
+    { Bucket::MAIN, CYNARA_ADMIN_DENY},
+    { Bucket::USER_TYPE_ADMIN, CYNARA_ADMIN_DENY},
+    { Bucket::USER_TYPE_NORMAL, CYNARA_ADMIN_DENY},
+    { Bucket::USER_TYPE_GUEST, CYNARA_ADMIN_DENY},
+    { Bucket::USER_TYPE_SYSTEM, CYNARA_ADMIN_DENY},
+    { Bucket::ADMIN, CYNARA_ADMIN_NONE},
+    { Bucket::MANIFESTS, CYNARA_ADMIN_DENY},
+};
+
+static const std::string CYNARA_ADMIN_WILDCARD_STR(CYNARA_ADMIN_WILDCARD);
+
+/* Guards against redirection loops in locally evaluated buckets */
+static const unsigned MAX_BUCKET_DEPTH = 16;
+
+static std::string makePolicyKey(const std::string &client, const std::string &user,
+    const std::string &privilege)
+{
+    std::string key;
+    key.reserve(client.size() + user.size() + privilege.size() + 2);
+    key.append(client).push_back('\0');
+    key.append(user).push_back('\0');
+    key.append(privilege);
+    return key;
+}
+
 
 CynaraAdminPolicy::CynaraAdminPolicy(const std::string &client, const std::string &user,
         const std::string &privilege, int operation,
@@ -225,11 +259,93 @@ static bool checkCynaraError(int result, const std::string &msg)
     }
 }
 
+const size_t CynaraAdminPolicyBatch::ARENA_BLOCK_SIZE;
+
+CynaraAdminPolicyBatch::CynaraAdminPolicyBatch()
+    : m_blockUsed(ARENA_BLOCK_SIZE)
+{
+}
+
+size_t CynaraAdminPolicyBatch::StringHash::operator()(const char *str) const
+{
+    size_t hash = 0;
+    for (; *str; ++str)
+        hash = hash * 131 + static_cast<unsigned char>(*str);
+    return hash;
+}
+
+bool CynaraAdminPolicyBatch::StringEqual::operator()(const char *a, const char *b) const
+{
+    return !strcmp(a, b);
+}
+
+char *CynaraAdminPolicyBatch::intern(const char *str)
+{
+    auto it = m_strings.find(const_cast<char *>(str));
+    if (it != m_strings.end())
+        return *it;
+
+    size_t size = strlen(str) + 1;
+    char *copy;
+    if (size > ARENA_BLOCK_SIZE / 4) {
+        // Long strings get a block of their own, current block stays last
+        m_blocks.emplace_back(new char[size]);
+        copy = m_blocks.back().get();
+        if (m_blocks.size() > 1)
+            std::swap(m_blocks.back(), m_blocks[m_blocks.size() - 2]);
+    } else {
+        if (m_blockUsed + size > ARENA_BLOCK_SIZE) {
+            m_blocks.emplace_back(new char[ARENA_BLOCK_SIZE]);
+            m_blockUsed = 0;
+        }
+        copy = m_blocks.back().get() + m_blockUsed;
+        m_blockUsed += size;
+    }
+
+    memcpy(copy, str, size);
+    m_strings.insert(copy);
+    return copy;
+}
+
+void CynaraAdminPolicyBatch::add(const std::string &client, const std::string &user,
+    const std::string &privilege, int operation, const std::string &bucket)
+{
+    struct cynara_admin_policy policy;
+    policy.bucket = intern(bucket.c_str());
+    policy.client = intern(client.c_str());
+    policy.user = intern(user.c_str());
+    policy.privilege = intern(privilege.c_str());
+    policy.result = operation;
+    policy.result_extra = nullptr;
+    m_policies.push_back(policy);
+}
+
+void CynaraAdminPolicyBatch::add(const std::string &client, const std::string &user,
+    const std::string &privilege, const std::string &goToBucket, const std::string &bucket)
+{
+    add(client, user, privilege, CYNARA_ADMIN_BUCKET, bucket);
+    m_policies.back().result_extra = intern(goToBucket.c_str());
+}
+
+void CynaraAdminPolicyBatch::add(const struct cynara_admin_policy &policy)
+{
+    struct cynara_admin_policy copy;
+    copy.bucket = intern(policy.bucket);
+    copy.client = intern(policy.client);
+    copy.user = intern(policy.user);
+    copy.privilege = intern(policy.privilege);
+    copy.result = policy.result;
+    copy.result_extra = policy.result_extra ? intern(policy.result_extra) : nullptr;
+    m_policies.push_back(copy);
+}
+
+const size_t CynaraAdmin::MAX_POLICIES_PER_CALL;
 CynaraAdmin::TypeToDescriptionMap CynaraAdmin::TypeToDescription;
 CynaraAdmin::DescriptionToTypeMap CynaraAdmin::DescriptionToType;
 
 CynaraAdmin::CynaraAdmin()
-    : m_policyDescriptionsInitialized(false)
+    : m_deferred(nullptr)
+    , m_policyDescriptionsInitialized(false)
 {
     checkCynaraError(
         cynara_admin_initialize(&m_CynaraAdmin),
@@ -247,32 +363,77 @@ CynaraAdmin &CynaraAdmin::getInstance()
     return cynaraAdmin;
 }
 
-void CynaraAdmin::SetPolicies(const std::vector<CynaraAdminPolicy> &policies)
+void CynaraAdmin::SetPolicies(const struct cynara_admin_policy *const *policies,
+    size_t count)
 {
-    if (policies.empty()) {
+    if (!count) {
         LogDebug("no policies to set in Cynara.");
         return;
     }
 
-    std::vector<const struct cynara_admin_policy *> pp_policies(policies.size() + 1);
-
-    LogDebug("Sending " << policies.size() << " policies to Cynara");
-    for (std::size_t i = 0; i < policies.size(); ++i) {
-        pp_policies[i] = static_cast<const struct cynara_admin_policy *>(&policies[i]);
-        LogDebug("policies[" << i << "] = {" <<
-            ".bucket = " << pp_policies[i]->bucket << ", " <<
-            ".client = " << pp_policies[i]->client << ", " <<
-            ".user = " << pp_policies[i]->user << ", " <<
-            ".privilege = " << pp_policies[i]->privilege << ", " <<
-            ".result = " << pp_policies[i]->result << ", " <<
-            ".result_extra = " << pp_policies[i]->result_extra << "}");
+    if (m_deferred) {
+        LogDebug("Deferring " << count << " policies");
+        for (std::size_t i = 0; i < count; ++i)
+            m_deferred->add(*policies[i]);
+        return;
     }
 
-    pp_policies[policies.size()] = nullptr;
+    std::vector<const struct cynara_admin_policy *> pp_policies;
+    pp_policies.reserve(std::min(count, MAX_POLICIES_PER_CALL) + 1);
+
+    LogDebug("Sending " << count << " policies to Cynara");
+    for (std::size_t start = 0; start < count; start += MAX_POLICIES_PER_CALL) {
+        std::size_t end = std::min(count, start + MAX_POLICIES_PER_CALL);
+
+        pp_policies.clear();
+        for (std::size_t i = start; i < end; ++i) {
+            pp_policies.push_back(policies[i]);
+            LogDebug("policies[" << i << "] = {" <<
+                ".bucket = " << policies[i]->bucket << ", " <<
+                ".client = " << policies[i]->client << ", " <<
+                ".user = " << policies[i]->user << ", " <<
+                ".privilege = " << policies[i]->privilege << ", " <<
+                ".result = " << policies[i]->result << ", " <<
+                ".result_extra = " << policies[i]->result_extra << "}");
+        }
+        pp_policies.push_back(nullptr);
+
+        int ret = cynara_admin_set_policies(m_CynaraAdmin, pp_policies.data());
+        // Flush even on error, part of the policies might have been set
+        CynaraCheckCache::getInstance().flush();
+        checkCynaraError(ret, "Error while updating Cynara policy.");
+    }
+}
 
-    checkCynaraError(
-        cynara_admin_set_policies(m_CynaraAdmin, pp_policies.data()),
-        "Error while updating Cynara policy.");
+void CynaraAdmin::SetPolicies(const std::vector<CynaraAdminPolicy> &policies)
+{
+    std::vector<const struct cynara_admin_policy *> pp_policies;
+    pp_policies.reserve(policies.size());
+    for (const auto &policy : policies)
+        pp_policies.push_back(static_cast<const struct cynara_admin_policy *>(&policy));
+
+    SetPolicies(pp_policies.data(), pp_policies.size());
+}
+
+void CynaraAdmin::SetPolicies(const CynaraAdminPolicyBatch &batch)
+{
+    const auto &policies = batch.policies();
+    std::vector<const struct cynara_admin_policy *> pp_policies;
+    pp_policies.reserve(policies.size());
+    for (const auto &policy : policies)
+        pp_policies.push_back(&policy);
+
+    SetPolicies(pp_policies.data(), pp_policies.size());
+}
+
+void CynaraAdmin::BeginDeferredUpdate(CynaraAdminPolicyBatch &batch)
+{
+    m_deferred = &batch;
+}
+
+void CynaraAdmin::EndDeferredUpdate()
+{
+    m_deferred = nullptr;
 }
 
 void CynaraAdmin::UpdateAppPolicy(
@@ -281,7 +442,8 @@ void CynaraAdmin::UpdateAppPolicy(
     const std::vector<std::string> &oldPrivileges,
     const std::vector<std::string> &newPrivileges)
 {
-    std::vector<CynaraAdminPolicy> policies;
+    CynaraAdminPolicyBatch policies;
+    const std::string &bucket = Buckets.at(Bucket::MANIFESTS);
 
     // Perform sort-merge join on oldPrivileges and newPrivileges.
     // Assume that they are already sorted and without duplicates.
@@ -299,16 +461,14 @@ void CynaraAdmin::UpdateAppPolicy(
         } else if (compare < 0) {
             LogDebug("(user = " << user << " label = " << label << ") " <<
                 "removing privilege " << *oldIter);
-            policies.push_back(CynaraAdminPolicy(label, user, *oldIter,
-                    static_cast<int>(CynaraAdminPolicy::Operation::Delete),
-                    Buckets.at(Bucket::MANIFESTS)));
+            policies.add(label, user, *oldIter,
+                    static_cast<int>(CynaraAdminPolicy::Operation::Delete), bucket);
             ++oldIter;
         } else {
             LogDebug("(user = " << user << " label = " << label << ") " <<
                 "adding privilege " << *newIter);
-            policies.push_back(CynaraAdminPolicy(label, user, *newIter,
-                    static_cast<int>(CynaraAdminPolicy::Operation::Allow),
-                    Buckets.at(Bucket::MANIFESTS)));
+            policies.add(label, user, *newIter,
+                    static_cast<int>(CynaraAdminPolicy::Operation::Allow), bucket);
             ++newIter;
         }
     }
@@ -316,17 +476,15 @@ void CynaraAdmin::UpdateAppPolicy(
     for (; oldIter != oldPrivileges.end(); ++oldIter) {
         LogDebug("(user = " << user << " label = " << label << ") " <<
             "removing privilege " << *oldIter);
-        policies.push_back(CynaraAdminPolicy(label, user, *oldIter,
-                    static_cast<int>(CynaraAdminPolicy::Operation::Delete),
-                    Buckets.at(Bucket::MANIFESTS)));
+        policies.add(label, user, *oldIter,
+                    static_cast<int>(CynaraAdminPolicy::Operation::Delete), bucket);
     }
 
     for (; newIter != newPrivileges.end(); ++newIter) {
         LogDebug("(user = " << user << " label = " << label << ") " <<
             "adding privilege " << *newIter);
-        policies.push_back(CynaraAdminPolicy(label, user, *newIter,
-                    static_cast<int>(CynaraAdminPolicy::Operation::Allow),
-                    Buckets.at(Bucket::MANIFESTS)));
+        policies.add(label, user, *newIter,
+                    static_cast<int>(CynaraAdminPolicy::Operation::Allow), bucket);
     }
 
     SetPolicies(policies);
@@ -335,7 +493,7 @@ void CynaraAdmin::UpdateAppPolicy(
 void CynaraAdmin::UserInit(uid_t uid, security_manager_user_type userType)
 {
     Bucket bucket;
-    std::vector<CynaraAdminPolicy> policies;
+    CynaraAdminPolicyBatch policies;
 
     switch (userType) {
         case SM_USER_TYPE_SYSTEM:
@@ -357,11 +515,11 @@ void CynaraAdmin::UserInit(uid_t uid, security_manager_user_type userType)
             ThrowMsg(CynaraException::InvalidParam, "User type incorrect");
     }
 
-    policies.push_back(CynaraAdminPolicy(CYNARA_ADMIN_WILDCARD,
-                                            std::to_string(static_cast<unsigned int>(uid)),
-                                            CYNARA_ADMIN_WILDCARD,
-                                            Buckets.at(bucket),
-                                            Buckets.at(Bucket::MAIN)));
+    policies.add(CYNARA_ADMIN_WILDCARD,
+                 std::to_string(static_cast<unsigned int>(uid)),
+                 CYNARA_ADMIN_WILDCARD,
+                 Buckets.at(bucket),
+                 Buckets.at(Bucket::MAIN));
 
     CynaraAdmin::getInstance().SetPolicies(policies);
 }
@@ -392,9 +550,11 @@ void CynaraAdmin::ListUsers(std::vector<uid_t> &listOfUsers)
 
 void CynaraAdmin::UserRemove(uid_t uid)
 {
-    std::vector<CynaraAdminPolicy> policies;
     std::string user = std::to_string(static_cast<unsigned int>(uid));
 
+    // Privileges of all user's applications, set by UpdateAppPolicy
+    EmptyBucket(Buckets.at(Bucket::MANIFESTS), false,
+            CYNARA_ADMIN_ANY, user, CYNARA_ADMIN_ANY);
     EmptyBucket(Buckets.at(Bucket::PRIVACY_MANAGER),true,
             CYNARA_ADMIN_ANY, user, CYNARA_ADMIN_ANY);
 }
@@ -426,9 +586,10 @@ void CynaraAdmin::ListPolicies(
 void CynaraAdmin::EmptyBucket(const std::string &bucketName, bool recursive, const std::string &client,
     const std::string &user, const std::string &privilege)
 {
-    checkCynaraError(
-        cynara_admin_erase(m_CynaraAdmin, bucketName.c_str(), static_cast<int>(recursive),
-            client.c_str(), user.c_str(), privilege.c_str()),
+    int ret = cynara_admin_erase(m_CynaraAdmin, bucketName.c_str(), static_cast<int>(recursive),
+            client.c_str(), user.c_str(), privilege.c_str());
+    CynaraCheckCache::getInstance().flush();
+    checkCynaraError(ret,
         "Error while emptying bucket: " + bucketName + ", filter (C, U, P): " +
             client + ", " + user + ", " + privilege);
 }
@@ -534,7 +695,201 @@ int CynaraAdmin::GetPrivilegeManagerMaxLevel(const std::string &label, const std
     return result;
 }
 
+CynaraPolicySnapshot::CynaraPolicySnapshot(const std::string &user)
+{
+    for (const auto &bucket : CynaraAdmin::Buckets) {
+        BucketRules &rules = m_buckets[bucket.second];
+        rules.defaultResult = BucketDefaultPolicies.at(bucket.first);
+        fetchBucket(bucket.second, user, rules);
+    }
+}
+
+void CynaraPolicySnapshot::fetchBucket(const std::string &bucketName,
+    const std::string &user, BucketRules &bucket)
+{
+    std::vector<CynaraAdminPolicy> policies;
+
+    CynaraAdmin::getInstance().ListPolicies(bucketName, CYNARA_ADMIN_ANY, user,
+        CYNARA_ADMIN_ANY, policies);
+    // Filter matches user literally, wildcard rules apply to the user too
+    if (user != CYNARA_ADMIN_ANY && user != CYNARA_ADMIN_WILDCARD)
+        CynaraAdmin::getInstance().ListPolicies(bucketName, CYNARA_ADMIN_ANY,
+            CYNARA_ADMIN_WILDCARD, CYNARA_ADMIN_ANY, policies);
+
+    for (const auto &policy : policies)
+        bucket.rules[makePolicyKey(policy.client, policy.user, policy.privilege)] =
+            Rule{policy.result, policy.result_extra ? policy.result_extra : ""};
+
+    LogDebug("Fetched " << policies.size() << " policies from bucket: " << bucketName);
+}
+
+int CynaraPolicySnapshot::evaluate(const std::string &bucketName, const std::string &label,
+    const std::string &user, const std::string &privilege, unsigned depth)
+{
+    auto bucketIt = m_buckets.find(bucketName);
+    if (bucketIt == m_buckets.end() || depth > MAX_BUCKET_DEPTH) {
+        int result;
+        std::string resultExtra;
+        CynaraAdmin::getInstance().Check(label, user, privilege, bucketName,
+            result, resultExtra, true);
+        return result;
+    }
+
+    const BucketRules &bucket = bucketIt->second;
+    const std::string *clients[] = {&label, &CYNARA_ADMIN_WILDCARD_STR};
+    const std::string *users[] = {&user, &CYNARA_ADMIN_WILDCARD_STR};
+    const std::string *privileges[] = {&privilege, &CYNARA_ADMIN_WILDCARD_STR};
+    bool matched = false;
+    int minimal = bucket.defaultResult;
+
+    for (const std::string *client : clients)
+        for (const std::string *usr : users)
+            for (const std::string *priv : privileges) {
+                auto it = bucket.rules.find(makePolicyKey(*client, *usr, *priv));
+                if (it == bucket.rules.end())
+                    continue;
+
+                int result = it->second.result;
+                if (result == CYNARA_ADMIN_BUCKET)
+                    result = evaluate(it->second.resultExtra, label, user, privilege,
+                        depth + 1);
+                if (result == CYNARA_ADMIN_NONE)
+                    continue;
+
+                if (!matched || result < minimal)
+                    minimal = result;
+                matched = true;
+            }
+
+    return minimal;
+}
+
+int CynaraPolicySnapshot::GetPrivilegeManagerCurrLevel(const std::string &label,
+    const std::string &user, const std::string &privilege)
+{
+    return evaluate(CynaraAdmin::Buckets.at(Bucket::PRIVACY_MANAGER), label, user,
+        privilege, 0);
+}
+
+int CynaraPolicySnapshot::GetPrivilegeManagerMaxLevel(const std::string &label,
+    const std::string &user, const std::string &privilege)
+{
+    return evaluate(CynaraAdmin::Buckets.at(Bucket::MAIN), label, user, privilege, 0);
+}
+
+CynaraCheckCache::CynaraCheckCache()
+    : m_capacity(0)
+    , m_lifetime(0)
+    , m_statistics()
+{
+}
+
+CynaraCheckCache &CynaraCheckCache::getInstance()
+{
+    static CynaraCheckCache cache;
+    return cache;
+}
+
+std::string CynaraCheckCache::makeKey(const std::string &label,
+    const std::string &privilege, const std::string &user)
+{
+    std::string key;
+    key.reserve(label.size() + privilege.size() + user.size() + 2);
+    key.append(label).push_back('\0');
+    key.append(privilege).push_back('\0');
+    key.append(user);
+    return key;
+}
+
+void CynaraCheckCache::enable(size_t capacity, std::chrono::milliseconds lifetime)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_capacity = capacity;
+    m_lifetime = lifetime;
+    m_entries.clear();
+    m_lookup.clear();
+}
+
+bool CynaraCheckCache::isEnabled()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_capacity;
+}
+
+bool CynaraCheckCache::get(const std::string &label, const std::string &privilege,
+    const std::string &user, bool &allowed)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_capacity)
+        return false;
+
+    auto it = m_lookup.find(makeKey(label, privilege, user));
+    if (it == m_lookup.end()) {
+        ++m_statistics.misses;
+        return false;
+    }
+
+    if (it->second->expires <= std::chrono::steady_clock::now()) {
+        m_entries.erase(it->second);
+        m_lookup.erase(it);
+        ++m_statistics.misses;
+        return false;
+    }
+
+    m_entries.splice(m_entries.begin(), m_entries, it->second);
+    allowed = it->second->allowed;
+    ++m_statistics.hits;
+    return true;
+}
+
+void CynaraCheckCache::put(const std::string &label, const std::string &privilege,
+    const std::string &user, bool allowed)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_capacity)
+        return;
+
+    std::string key = makeKey(label, privilege, user);
+    auto expires = std::chrono::steady_clock::now() + m_lifetime;
+    auto it = m_lookup.find(key);
+    if (it != m_lookup.end()) {
+        it->second->allowed = allowed;
+        it->second->expires = expires;
+        m_entries.splice(m_entries.begin(), m_entries, it->second);
+        return;
+    }
+
+    if (m_entries.size() >= m_capacity) {
+        m_lookup.erase(m_entries.back().key);
+        m_entries.pop_back();
+    }
+
+    m_entries.push_front(Entry{key, allowed, expires});
+    m_lookup.emplace(std::move(key), m_entries.begin());
+}
+
+void CynaraCheckCache::flush()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_entries.empty())
+        return;
+
+    LogDebug("Flushing " << m_entries.size() << " cached Cynara results");
+    m_entries.clear();
+    m_lookup.clear();
+    ++m_statistics.flushes;
+}
+
+CynaraCheckCache::Statistics CynaraCheckCache::getStatistics()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_statistics;
+}
+
 Cynara::Cynara()
+    : m_CynaraAsync(nullptr)
+    , m_asyncFd(-1)
+    , m_asyncStatus(CYNARA_STATUS_FOR_READ)
 {
     checkCynaraError(
         cynara_initialize(&m_Cynara, nullptr),
@@ -543,6 +898,7 @@ Cynara::Cynara()
 
 Cynara::~Cynara()
 {
+    finishAsync();
     cynara_finish(m_Cynara);
 }
 
@@ -552,13 +908,174 @@ Cynara &Cynara::getInstance()
     return cynara;
 }
 
+bool Cynara::checkCached(const std::string &label, const std::string &privilege,
+    const std::string &user, bool &allowed)
+{
+    CynaraCheckCache &cache = CynaraCheckCache::getInstance();
+    if (!cache.isEnabled())
+        return false;
+    if (cache.get(label, privilege, user, allowed))
+        return true;
+
+    // Client checks start in the default bucket, PRIVACY_MANAGER
+    int result = CynaraAdmin::getInstance().GetPrivilegeManagerCurrLevel(label, user,
+        privilege);
+    if (result != CYNARA_ADMIN_ALLOW && result != CYNARA_ADMIN_DENY)
+        return false;
+
+    allowed = result == CYNARA_ADMIN_ALLOW;
+    cache.put(label, privilege, user, allowed);
+    return true;
+}
+
 bool Cynara::check(const std::string &label, const std::string &privilege,
         const std::string &user, const std::string &session)
 {
+    bool allowed;
+    if (checkCached(label, privilege, user, allowed))
+        return allowed;
+
     return checkCynaraError(
         cynara_check(m_Cynara,
             label.c_str(), session.c_str(), user.c_str(), privilege.c_str()),
         "Cannot check permission with Cynara.");
 }
 
+void Cynara::asyncStatusCallback(int oldFd, int newFd, cynara_async_status status,
+    void *data)
+{
+    (void) oldFd;
+    Cynara *cynara = static_cast<Cynara *>(data);
+    cynara->m_asyncFd = newFd;
+    cynara->m_asyncStatus = status;
+}
+
+void Cynara::asyncResponseCallback(cynara_check_id checkId,
+    cynara_async_call_cause cause, int response, void *data)
+{
+    (void) checkId;
+    AsyncRequest *request = static_cast<AsyncRequest *>(data);
+    request->answered = true;
+    request->cause = cause;
+    request->response = response;
+}
+
+void Cynara::initAsync()
+{
+    if (m_CynaraAsync)
+        return;
+
+    checkCynaraError(
+        cynara_async_initialize(&m_CynaraAsync, nullptr, &Cynara::asyncStatusCallback, this),
+        "Cannot connect to Cynara asynchronous policy interface.");
+}
+
+void Cynara::finishAsync()
+{
+    if (!m_CynaraAsync)
+        return;
+
+    cynara_async_finish(m_CynaraAsync);
+    m_CynaraAsync = nullptr;
+    m_asyncFd = -1;
+}
+
+void Cynara::processAsync()
+{
+    if (m_asyncFd < 0)
+        ThrowMsg(CynaraException::ServiceNotAvailable,
+            "Lost connection to Cynara asynchronous policy interface.");
+
+    struct pollfd pfd;
+    pfd.fd = m_asyncFd;
+    pfd.events = POLLIN;
+    if (m_asyncStatus == CYNARA_STATUS_FOR_RW)
+        pfd.events |= POLLOUT;
+
+    if (TEMP_FAILURE_RETRY(poll(&pfd, 1, -1)) < 0)
+        ThrowMsg(CynaraException::UnknownError,
+            "Error while waiting for Cynara: " << strerror(errno));
+
+    checkCynaraError(cynara_async_process(m_CynaraAsync),
+        "Error while processing Cynara answers.");
+}
+
+void Cynara::sendAsyncRequest(const std::string &label, const std::string &privilege,
+    const std::string &user, const std::string &session, AsyncRequest &request,
+    size_t &pending)
+{
+    for (;;) {
+        cynara_check_id checkId;
+        int ret = cynara_async_create_request(m_CynaraAsync,
+            label.c_str(), session.c_str(), user.c_str(), privilege.c_str(),
+            &checkId, &Cynara::asyncResponseCallback, &request);
+
+        if (ret == CYNARA_API_SUCCESS) {
+            ++pending;
+            return;
+        }
+
+        if (ret != CYNARA_API_MAX_PENDING_REQUESTS || !pending)
+            checkCynaraError(ret, "Cannot send permission check to Cynara.");
+
+        processAsync();
+    }
+}
+
+void Cynara::check(const std::string &label, const std::vector<std::string> &privileges,
+    const std::string &user, const std::string &session, std::vector<bool> &results)
+{
+    results.assign(privileges.size(), false);
+
+    // Requests are referred to from callbacks, vector must not be reallocated
+    std::vector<AsyncRequest> requests(privileges.size(), AsyncRequest{true,
+        CYNARA_CALL_CAUSE_ANSWER, CYNARA_API_ACCESS_DENIED});
+    size_t pending = 0;
+
+    try {
+        for (size_t i = 0; i < privileges.size(); ++i) {
+            bool allowed;
+            if (checkCached(label, privileges[i], user, allowed)) {
+                results[i] = allowed;
+                continue;
+            }
+
+            initAsync();
+            int ret = cynara_async_check_cache(m_CynaraAsync,
+                label.c_str(), session.c_str(), user.c_str(), privileges[i].c_str());
+            if (ret != CYNARA_API_CACHE_MISS) {
+                requests[i].response = ret;
+                continue;
+            }
+
+            requests[i].answered = false;
+            sendAsyncRequest(label, privileges[i], user, session, requests[i], pending);
+        }
+
+        while (pending) {
+            processAsync();
+            pending = std::count_if(requests.begin(), requests.end(),
+                [] (const AsyncRequest &request) { return !request.answered; });
+        }
+    } catch (...) {
+        // Finish pending requests while their state is still alive
+        finishAsync();
+        throw;
+    }
+
+    for (size_t i = 0; i < privileges.size(); ++i) {
+        if (requests[i].cause != CYNARA_CALL_CAUSE_ANSWER) {
+            finishAsync();
+            ThrowMsg(CynaraException::ServiceNotAvailable,
+                "Cynara check for " << privileges[i] << " not answered.");
+        }
+
+        if (results[i] || requests[i].response == CYNARA_API_ACCESS_DENIED)
+            continue;
+
+        results[i] = checkCynaraError(requests[i].response,
+            "Cannot check permission with Cynara.");
+    }
+}
+
 } // namespace SecurityManager
@@ -0,0 +1,184 @@
+/*
+ *  Copyright (c) 2014 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *  Contact: Rafal Krypa <r.krypa@samsung.com>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License
+ */
+/*
+ * @file        group_cache.cpp
+ * @brief       Cache of group name to gid translations
+ */
+
+#include <errno.h>
+#include <grp.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <vector>
+
+#include <dpl/errno_string.h>
+#include <dpl/log/log.h>
+
+#include "group_cache.h"
+
+namespace SecurityManager {
+
+namespace {
+
+/* /etc/group is usually replaced by rename(), so the directory is watched */
+const char *const GROUP_FILE_DIR = "/etc";
+const char *const GROUP_FILE_NAME = "group";
+
+} // namespace anonymous
+
+GroupCache::GroupCache()
+  : m_inotifyFd(-1)
+  , m_statistics()
+{
+}
+
+GroupCache::~GroupCache()
+{
+    if (m_inotifyFd >= 0) {
+        LogDebug("Group cache statistics: hits " << m_statistics.hits <<
+            ", misses " << m_statistics.misses <<
+            ", invalidations " << m_statistics.invalidations);
+        close(m_inotifyFd);
+    }
+}
+
+GroupCache &GroupCache::getInstance()
+{
+    static GroupCache cache;
+    return cache;
+}
+
+void GroupCache::enable()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_inotifyFd >= 0)
+        return;
+
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0) {
+        LogWarning("inotify_init1 failed, group cache disabled: " << GetErrnoString(errno));
+        return;
+    }
+
+    if (inotify_add_watch(fd, GROUP_FILE_DIR,
+            IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE) < 0) {
+        LogWarning("Unable to watch " << GROUP_FILE_DIR << ", group cache disabled: " <<
+            GetErrnoString(errno));
+        close(fd);
+        return;
+    }
+
+    m_inotifyFd = fd;
+    m_gids.clear();
+}
+
+void GroupCache::checkChanges()
+{
+    alignas(struct inotify_event) char buffer[4096];
+    bool changed = false;
+
+    for (;;) {
+        ssize_t len = read(m_inotifyFd, buffer, sizeof(buffer));
+        if (len <= 0)
+            break;
+
+        for (char *ptr = buffer; ptr < buffer + len;) {
+            const struct inotify_event *event = reinterpret_cast<struct inotify_event *>(ptr);
+            if ((event->mask & IN_Q_OVERFLOW) ||
+                (event->len && !strcmp(event->name, GROUP_FILE_NAME)))
+                changed = true;
+            ptr += sizeof(struct inotify_event) + event->len;
+        }
+    }
+
+    if (changed) {
+        LogDebug("Group file modified, dropping " << m_gids.size() << " cached groups");
+        m_gids.clear();
+        ++m_statistics.invalidations;
+    }
+}
+
+int GroupCache::resolve(const std::string &group, gid_t &gid, bool &found)
+{
+    long size = sysconf(_SC_GETGR_R_SIZE_MAX);
+    std::vector<char> buffer(size > 0 ? size : 1024);
+    struct group grp;
+    struct group *result;
+    int ret;
+
+    while ((ret = getgrnam_r(group.c_str(), &grp, buffer.data(), buffer.size(),
+            &result)) == ERANGE)
+        buffer.resize(buffer.size() * 2);
+
+    if (ret) {
+        LogError("getgrnam_r failed for group " << group << ": " << GetErrnoString(ret));
+        found = false;
+        return ret;
+    }
+
+    found = (result != NULL);
+    if (found)
+        gid = grp.gr_gid;
+    return 0;
+}
+
+bool GroupCache::getGid(const std::string &group, gid_t &gid)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    bool found;
+    if (m_inotifyFd < 0) {
+        ++m_statistics.misses;
+        resolve(group, gid, found);
+        return found;
+    }
+
+    checkChanges();
+
+    auto it = m_gids.find(group);
+    if (it != m_gids.end()) {
+        ++m_statistics.hits;
+        if (it->second < 0)
+            return false;
+        gid = static_cast<gid_t>(it->second);
+        return true;
+    }
+
+    ++m_statistics.misses;
+    // Lookup errors (e.g. unavailable NSS backend) are not remembered
+    if (!resolve(group, gid, found))
+        m_gids[group] = found ? static_cast<long>(gid) : -1;
+    return found;
+}
+
+void GroupCache::preload(const std::vector<std::string> &groups)
+{
+    gid_t gid;
+    for (const auto &group : groups)
+        getGid(group, gid);
+    LogDebug("Preloaded " << groups.size() << " groups");
+}
+
+GroupCache::Statistics GroupCache::getStatistics()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_statistics;
+}
+
+} // namespace SecurityManager
@@ -25,9 +25,16 @@
 #define _SECURITY_MANAGER_CYNARA_
 
 #include <cynara-client.h>
+#include <cynara-client-async.h>
 #include <cynara-admin.h>
 #include <dpl/exception.h>
+#include <chrono>
+#include <list>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 #include <map>
 
@@ -85,6 +92,60 @@ struct CynaraAdminPolicy : cynara_admin_policy
     ~CynaraAdminPolicy();
 };
 
+/**
+ * Batch of policies to be set in Cynara with as few allocations as possible.
+ * Strings are copied into an arena once, a label, user or bucket repeated
+ * across policies shares a single copy. Policies in the batch point into
+ * the arena, so the batch can't be copied.
+ */
+class CynaraAdminPolicyBatch
+{
+public:
+    CynaraAdminPolicyBatch();
+    CynaraAdminPolicyBatch(const CynaraAdminPolicyBatch &that) = delete;
+    CynaraAdminPolicyBatch &operator=(const CynaraAdminPolicyBatch &that) = delete;
+
+    void add(const std::string &client, const std::string &user,
+        const std::string &privilege, int operation,
+        const std::string &bucket = std::string(CYNARA_ADMIN_DEFAULT_BUCKET));
+
+    void add(const std::string &client, const std::string &user,
+        const std::string &privilege, const std::string &goToBucket,
+        const std::string &bucket = std::string(CYNARA_ADMIN_DEFAULT_BUCKET));
+
+    /* Add a copy of the policy, its strings are copied into the arena */
+    void add(const struct cynara_admin_policy &policy);
+
+    const std::vector<struct cynara_admin_policy> &policies() const
+    {
+        return m_policies;
+    }
+
+    bool empty() const
+    {
+        return m_policies.empty();
+    }
+
+private:
+    static const size_t ARENA_BLOCK_SIZE = 16384;
+
+    /* Return arena copy of the string, shared with earlier equal strings */
+    char *intern(const char *str);
+
+    /* Strings in the arena compared by contents, looked up without copying */
+    struct StringHash {
+        size_t operator()(const char *str) const;
+    };
+    struct StringEqual {
+        bool operator()(const char *a, const char *b) const;
+    };
+
+    std::vector<std::unique_ptr<char[]>> m_blocks;
+    size_t m_blockUsed;
+    std::unordered_set<char *, StringHash, StringEqual> m_strings;
+    std::vector<struct cynara_admin_policy> m_policies;
+};
+
 class CynaraAdmin
 {
 public:
@@ -107,6 +168,36 @@ public:
      */
     void SetPolicies(const std::vector<CynaraAdminPolicy> &policies);
 
+    /**
+     * Update Cynara policies from a batch.
+     * Large batches are sent in several calls, if one of them fails policies
+     * sent by earlier calls stay in place.
+     *
+     * @param batch policies to send to Cynara
+     */
+    void SetPolicies(const CynaraAdminPolicyBatch &batch);
+
+    /**
+     * Send policies to Cynara in chunks of at most MAX_POLICIES_PER_CALL,
+     * e.g. a part of a batch.
+     */
+    void SetPolicies(const struct cynara_admin_policy *const *policies, size_t count);
+
+    /**
+     * Add policies passed to SetPolicies() to the batch instead of sending
+     * them, until EndDeferredUpdate(). Lets a commit group send policies of
+     * all its requests together.
+     *
+     * @param batch policies collected so far, must outlive the deferral
+     */
+    void BeginDeferredUpdate(CynaraAdminPolicyBatch &batch);
+
+    /**
+     * Send policies passed to SetPolicies() again. Policies collected in the
+     * batch are left to the caller.
+     */
+    void EndDeferredUpdate();
+
     /**
      * Update Cynara policies for the package and the user, using two vectors
      * of privileges: privileges set before (and already enabled in Cynara)
@@ -148,7 +239,8 @@ public:
     void ListUsers(std::vector<uid_t> &listOfUsers);
 
     /**
-     * Removes all entries for a user from cynara database
+     * Removes all entries for a user from cynara database,
+     * including privileges of all user's applications
      *
      * @param uid removed user uid
      */
@@ -260,6 +352,9 @@ public:
 private:
     CynaraAdmin();
 
+    /* Upper bound on number of policies sent with one cynara_admin_set_policies call */
+    static const size_t MAX_POLICIES_PER_CALL = 1024;
+
     /**
      * Empty bucket using filter - matching rules will be removed
      *
@@ -281,11 +376,134 @@ private:
 
     struct cynara_admin *m_CynaraAdmin;
 
+    /* Batch collecting policies since BeginDeferredUpdate(), NULL if not deferring */
+    CynaraAdminPolicyBatch *m_deferred;
+
     static TypeToDescriptionMap TypeToDescription;
     static DescriptionToTypeMap DescriptionToType;
     bool m_policyDescriptionsInitialized;
 };
 
+/**
+ * Local copy of Security Manager buckets, fetched once with ListPolicies
+ * and evaluated in memory the same way Cynara evaluates them: the most
+ * restrictive of all matching rules wins, bucket redirections are followed
+ * and the default policy of a bucket applies when no rule matches.
+ * Meant for handlers that would otherwise issue an administrative check
+ * for each (application, user, privilege) triple. Changes made after
+ * the snapshot is taken are not visible.
+ */
+class CynaraPolicySnapshot
+{
+public:
+    /**
+     * Fetch policies of all Security Manager buckets.
+     *
+     * @param user limit policies to those of given user (and wildcard ones),
+     *        CYNARA_ADMIN_ANY to fetch policies of all users
+     */
+    explicit CynaraPolicySnapshot(const std::string &user = CYNARA_ADMIN_ANY);
+
+    /**
+     * Local counterpart of CynaraAdmin::GetPrivilegeManagerCurrLevel
+     */
+    int GetPrivilegeManagerCurrLevel(const std::string &label, const std::string &user,
+        const std::string &privilege);
+
+    /**
+     * Local counterpart of CynaraAdmin::GetPrivilegeManagerMaxLevel
+     */
+    int GetPrivilegeManagerMaxLevel(const std::string &label, const std::string &user,
+        const std::string &privilege);
+
+private:
+    struct Rule {
+        int result;
+        std::string resultExtra;
+    };
+
+    struct BucketRules {
+        int defaultResult;
+        std::unordered_map<std::string, Rule> rules;
+    };
+
+    void fetchBucket(const std::string &bucketName, const std::string &user,
+        BucketRules &bucket);
+
+    /**
+     * Find the policy result for a triple starting at the given bucket.
+     * Buckets not fetched in the snapshot are checked with Cynara.
+     */
+    int evaluate(const std::string &bucketName, const std::string &label,
+        const std::string &user, const std::string &privilege, unsigned depth);
+
+    std::unordered_map<std::string, BucketRules> m_buckets;
+};
+
+/**
+ * Least recently used cache of Cynara check results, keyed by
+ * (label, privilege, user). Only results of plain allow and deny policies
+ * are stored, they don't depend on the session. Policies handled by
+ * plugins are always asked to Cynara with the session.
+ * Flushed whenever policy is modified through CynaraAdmin. Changes made
+ * by other Cynara administrators are noticed after entries expire.
+ * Disabled by default.
+ */
+class CynaraCheckCache
+{
+public:
+    struct Statistics {
+        unsigned long hits;
+        unsigned long misses;
+        unsigned long flushes;
+    };
+
+    static CynaraCheckCache &getInstance();
+
+    /**
+     * Start caching results.
+     *
+     * @param capacity maximum number of remembered results
+     * @param lifetime time after which a result is asked again
+     */
+    void enable(size_t capacity, std::chrono::milliseconds lifetime);
+
+    bool isEnabled();
+
+    /**
+     * @return true if result is known, stored in allowed
+     */
+    bool get(const std::string &label, const std::string &privilege,
+        const std::string &user, bool &allowed);
+
+    void put(const std::string &label, const std::string &privilege,
+        const std::string &user, bool allowed);
+
+    void flush();
+
+    Statistics getStatistics();
+
+private:
+    CynaraCheckCache();
+
+    struct Entry {
+        std::string key;
+        bool allowed;
+        std::chrono::steady_clock::time_point expires;
+    };
+
+    static std::string makeKey(const std::string &label, const std::string &privilege,
+        const std::string &user);
+
+    /* Most recently used entries at front */
+    std::list<Entry> m_entries;
+    std::unordered_map<std::string, std::list<Entry>::iterator> m_lookup;
+    size_t m_capacity;
+    std::chrono::milliseconds m_lifetime;
+    Statistics m_statistics;
+    std::mutex m_mutex;
+};
+
 class Cynara
 {
 public:
@@ -305,9 +523,72 @@ public:
     bool check(const std::string &label, const std::string &privilege,
         const std::string &user, const std::string &session);
 
+    /**
+     * Ask Cynara for many permissions at once.
+     * All questions are sent before waiting for the first answer, so the
+     * total latency is close to a single check.
+     *
+     * @param label application Smack label
+     * @param privileges privilege identifiers
+     * @param user user identifier (uid)
+     * @param session session identifier
+     * @param[out] results true for each permitted privilege, in order of privileges
+     */
+    void check(const std::string &label, const std::vector<std::string> &privileges,
+        const std::string &user, const std::string &session, std::vector<bool> &results);
+
 private:
     Cynara();
+
+    /* State of a single asynchronous check */
+    struct AsyncRequest {
+        bool answered;
+        cynara_async_call_cause cause;
+        int response;
+    };
+
+    /**
+     * Answer from CynaraCheckCache. On a miss the policy is checked through
+     * CynaraAdmin and its result is cached, unless a plugin handles it.
+     *
+     * @return false if the answer must be asked to Cynara with the session
+     */
+    bool checkCached(const std::string &label, const std::string &privilege,
+        const std::string &user, bool &allowed);
+
+    /**
+     * Connect asynchronous client, unless already connected
+     */
+    void initAsync();
+
+    /**
+     * Disconnect asynchronous client. Pending requests are finished,
+     * their AsyncRequest structures must still be valid.
+     */
+    void finishAsync();
+
+    /**
+     * Send a check request, waiting for answers to earlier ones
+     * if there are too many pending requests.
+     */
+    void sendAsyncRequest(const std::string &label, const std::string &privilege,
+        const std::string &user, const std::string &session, AsyncRequest &request,
+        size_t &pending);
+
+    /**
+     * Wait for the connection to be ready and process incoming answers.
+     */
+    void processAsync();
+
+    static void asyncStatusCallback(int oldFd, int newFd, cynara_async_status status,
+        void *data);
+    static void asyncResponseCallback(cynara_check_id checkId,
+        cynara_async_call_cause cause, int response, void *data);
+
     struct cynara *m_Cynara;
+    struct cynara_async *m_CynaraAsync;
+    int m_asyncFd;
+    cynara_async_status m_asyncStatus;
 };
 
 
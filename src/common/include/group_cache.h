@@ -0,0 +1,98 @@
+/*
+ *  Copyright (c) 2014 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *  Contact: Rafal Krypa <r.krypa@samsung.com>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License
+ */
+/*
+ * @file        group_cache.h
+ * @brief       Cache of group name to gid translations
+ */
+
+#ifndef _SECURITY_MANAGER_GROUP_CACHE_
+#define _SECURITY_MANAGER_GROUP_CACHE_
+
+#include <sys/types.h>
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace SecurityManager {
+
+/**
+ * Translates group names to gids with getgrnam_r(), remembering results
+ * (including nonexistent groups) until /etc/group is modified.
+ * Modifications are detected with inotify, so caching is enabled only after
+ * a successful enable() call. Until then every lookup goes to NSS.
+ * Groups provided by network NSS modules are not watched for changes.
+ */
+class GroupCache {
+public:
+    struct Statistics {
+        unsigned long hits;
+        unsigned long misses;
+        unsigned long invalidations;
+    };
+
+    static GroupCache &getInstance();
+
+    ~GroupCache();
+
+    /**
+     * Start watching /etc/group and caching lookup results.
+     * Failure to set up the watch is logged, cache stays disabled then.
+     */
+    void enable();
+
+    /**
+     * Resolve groups in advance, so that first lookups are hits.
+     */
+    void preload(const std::vector<std::string> &groups);
+
+    /**
+     * Translate group name to gid.
+     *
+     * @param group group name
+     * @param[out] gid group id
+     * @return false if there is no such group
+     */
+    bool getGid(const std::string &group, gid_t &gid);
+
+    Statistics getStatistics();
+
+private:
+    GroupCache();
+
+    /* Drop cached entries if /etc/group changed since last call */
+    void checkChanges();
+
+    /**
+     * Ask NSS for the group.
+     *
+     * @return 0 on success (also if group doesn't exist), error code otherwise
+     */
+    int resolve(const std::string &group, gid_t &gid, bool &found);
+
+    /* Cached gids, -1 marks a nonexistent group */
+    std::unordered_map<std::string, long> m_gids;
+    int m_inotifyFd;
+    Statistics m_statistics;
+    std::mutex m_mutex;
+};
+
+} // namespace SecurityManager
+
+#endif // _SECURITY_MANAGER_GROUP_CACHE_
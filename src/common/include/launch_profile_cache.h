@@ -0,0 +1,92 @@
+/*
+ *  Copyright (c) 2014 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *  Contact: Rafal Krypa <r.krypa@samsung.com>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License
+ */
+/*
+ * @file        launch_profile_cache.h
+ * @brief       Precomputed per application data needed at application launch
+ */
+
+#ifndef _SECURITY_MANAGER_LAUNCH_PROFILE_CACHE_
+#define _SECURITY_MANAGER_LAUNCH_PROFILE_CACHE_
+
+#include <sys/types.h>
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace SecurityManager {
+
+/**
+ * Everything getAppGroups needs from the database for an (appId, uid) pair.
+ * Only privileges mapped to groups are kept, together with names of these
+ * groups. Cynara is still asked about each of them at launch, its answer
+ * may depend on the session. Group names are translated to gids by GroupCache,
+ * which tracks modifications of /etc/group.
+ */
+struct LaunchProfile {
+    std::string pkgId;
+    std::string label;
+    std::vector<std::pair<std::string, std::vector<std::string>>> privilegeGroups;
+};
+
+/**
+ * Launch profiles of applications, computed on first launch and kept until
+ * the package is reinstalled or the database is modified by somebody else.
+ * Disabled by default, it is only correct in the daemon, which sees
+ * all installations.
+ */
+class LaunchProfileCache {
+public:
+    static LaunchProfileCache &getInstance();
+
+    void enable();
+
+    /**
+     * Find profile of the application.
+     *
+     * @return false if cache is disabled or profile is not computed yet
+     * @exception PrivilegeDb::Exception::Base on database error
+     */
+    bool get(const std::string &appId, uid_t uid, LaunchProfile &profile);
+
+    void put(const std::string &appId, uid_t uid, const LaunchProfile &profile);
+
+    /**
+     * Drop profiles of all applications in the package, for all users.
+     * Profile depends on privileges of the whole package.
+     */
+    void invalidatePkg(const std::string &pkgId);
+
+    void invalidateAll();
+
+private:
+    LaunchProfileCache();
+
+    typedef std::pair<std::string, uid_t> Key;
+
+    bool m_enabled;
+    unsigned m_dbGeneration;
+    std::map<Key, LaunchProfile> m_profiles;
+    std::mutex m_mutex;
+};
+
+} // namespace SecurityManager
+
+#endif // _SECURITY_MANAGER_LAUNCH_PROFILE_CACHE_
@@ -50,6 +50,13 @@ public:
 
     void Push(const RawBuffer &data);
 
+    /*
+     * Append data without copying it. Memory is released with the deleter
+     * once the data is consumed or the buffer is destroyed.
+     */
+    void PushUnmanaged(const void *data, size_t size,
+        BinaryQueue::BufferDeleter deleter, void *userParam = NULL);
+
     RawBuffer Pop();
 
     bool Ready();
@@ -27,15 +27,27 @@
  * @brief       This file contains declaration of the API to privilges database.
  */
 
+#include <atomic>
+#include <cstdint>
+#include <condition_variable>
 #include <cstdio>
+#include <functional>
 #include <list>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <stdbool.h>
 #include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
 #include <dpl/db/sql_connection.h>
 #include <tzplatform_config.h>
 
+#include "privilege_db_index.h"
+#include "smack-rules.h"
+
 #ifndef PRIVILEGE_DB_H_
 #define PRIVILEGE_DB_H_
 
@@ -46,15 +58,30 @@ const char *const PRIVILEGE_DB_PATH = tzplatform_mkpath(TZ_SYS_DB, ".security-ma
 enum class QueryType {
     EGetPkgPrivileges,
     EGetAppPrivileges,
+    EAddPkg,
     EAddApplication,
+    EGetAppRowIds,
     ERemoveApplication,
-    EAddAppPrivileges,
+    EPkgHasApps,
+    ERemovePkg,
     ERemoveAppPrivileges,
+    EGetPrivilegeId,
+    EAddPrivilege,
     EPkgIdExists,
     EGetPkgId,
     EGetPrivilegeGroups,
+    EGetGroups,
     EGetUserApps,
-    EGetAppsInPkg
+    EGetAppsInPkg,
+    EGetAllApps,
+    EGetAllAppPrivileges,
+    EGetAllPrivilegeGroups,
+    EGetDataVersion,
+    EGetSmackRules,
+    EGetLabelSmackRules,
+    EAddSmackRule,
+    ERemoveSmackRules,
+    ERemoveLabelSmackRules
 };
 
 class PrivilegeDb {
@@ -63,51 +90,183 @@ class PrivilegeDb {
      */
 
 private:
-    /**
-     * Constructor
-     * @exception DB::SqlConnection::Exception::IOError on problems with database access
-     *
-     */
-    PrivilegeDb(const std::string &path = std::string(PRIVILEGE_DB_PATH));
-
-    SecurityManager::DB::SqlConnection *mSqlConnection;
     const std::map<QueryType, const char * const > Queries = {
         { QueryType::EGetPkgPrivileges, "SELECT DISTINCT privilege_name FROM app_privilege_view WHERE pkg_name=? AND uid=? ORDER BY privilege_name"},
         { QueryType::EGetAppPrivileges, "SELECT DISTINCT privilege_name FROM app_privilege_view WHERE app_name=? AND uid=? ORDER BY privilege_name"},
-        { QueryType::EAddApplication, "INSERT INTO app_pkg_view (app_name, pkg_name, uid) VALUES (?, ?, ?)" },
-        { QueryType::ERemoveApplication, "DELETE FROM app_pkg_view WHERE app_name=? AND uid=?" },
-        { QueryType::EAddAppPrivileges, "INSERT INTO app_privilege_view (app_name, uid, privilege_name) VALUES (?, ?, ?)" },
-        { QueryType::ERemoveAppPrivileges, "DELETE FROM app_privilege_view WHERE app_name=? AND uid=?" },
+        { QueryType::EAddPkg, "INSERT OR IGNORE INTO pkg (name) VALUES (?)" },
+        { QueryType::EAddApplication, "INSERT OR IGNORE INTO app (pkg_id, name, uid) SELECT pkg_id, ?, ? FROM pkg WHERE name=?" },
+        { QueryType::EGetAppRowIds, "SELECT app_id, pkg_id FROM app WHERE name=? AND uid=?" },
+        { QueryType::ERemoveApplication, "DELETE FROM app WHERE app_id=?" },
+        { QueryType::EPkgHasApps, "SELECT 1 FROM app WHERE pkg_id=? LIMIT 1" },
+        { QueryType::ERemovePkg, "DELETE FROM pkg WHERE pkg_id=?" },
+        { QueryType::ERemoveAppPrivileges, "DELETE FROM app_privilege WHERE app_id=?" },
+        { QueryType::EGetPrivilegeId, "SELECT privilege_id FROM privilege WHERE name=?" },
+        { QueryType::EAddPrivilege, "INSERT OR IGNORE INTO privilege (name) VALUES (?)" },
         { QueryType::EPkgIdExists, "SELECT * FROM pkg WHERE name=?" },
         { QueryType::EGetPkgId, " SELECT pkg_name FROM app_pkg_view WHERE app_name = ?" },
         { QueryType::EGetPrivilegeGroups, " SELECT group_name FROM privilege_group_view WHERE privilege_name = ?" },
+        { QueryType::EGetGroups, "SELECT DISTINCT group_name FROM privilege_group" },
         { QueryType::EGetUserApps, "SELECT name FROM app WHERE uid=?" },
         { QueryType::EGetAppsInPkg, " SELECT app_name FROM app_pkg_view WHERE pkg_name = ?" },
+        { QueryType::EGetAllApps, "SELECT app_name, pkg_name, uid FROM app_pkg_view" },
+        { QueryType::EGetAllAppPrivileges, "SELECT app_name, uid, privilege_name FROM app_privilege_view" },
+        { QueryType::EGetAllPrivilegeGroups, "SELECT privilege_name, group_name FROM privilege_group_view" },
+        { QueryType::EGetDataVersion, "PRAGMA data_version" },
+        { QueryType::EGetSmackRules, "SELECT subject, object, access FROM smack_rule WHERE owner=?" },
+        { QueryType::EGetLabelSmackRules, "SELECT subject, object, access FROM smack_rule WHERE owner=?1 AND (subject=?2 OR object=?2)" },
+        { QueryType::EAddSmackRule, "INSERT OR REPLACE INTO smack_rule (owner, subject, object, access) VALUES (?, ?, ?, ?)" },
+        { QueryType::ERemoveSmackRules, "DELETE FROM smack_rule WHERE owner=?" },
+        { QueryType::ERemoveLabelSmackRules, "DELETE FROM smack_rule WHERE owner=?1 AND (subject=?2 OR object=?2)" },
+    };
+
+    /**
+     * Database connection together with its prepared queries.
+     * Commands are declared after the connection, so they are finalized first.
+     */
+    struct Connection {
+        std::unique_ptr<DB::SqlConnection> sql;
+        std::vector<DB::SqlConnection::DataCommandAutoPtr> commands;
+        /* Multi-row app_privilege inserts, by number of rows */
+        std::map<size_t, DB::SqlConnection::DataCommandAutoPtr> addAppPrivileges;
     };
 
     /**
-     * Container for initialized DataCommands, prepared for binding.
+     * Maximum number of rows inserted into app_privilege by one statement.
+     * Keeps number of bound parameters below SQLITE_MAX_VARIABLE_NUMBER.
+     */
+    static const size_t PRIVILEGES_PER_STATEMENT = 128;
+
+    /**
+     * Integer ids of privileges, by name. Privileges are never removed from
+     * the database, so the ids stay valid until a transaction that added
+     * some of them is rolled back, which clears the cache.
+     * Used by writers only, guarded by m_writerMutex.
+     */
+    std::unordered_map<std::string, int64_t> m_privilegeIds;
+
+    /**
+     * Return integer id of the privilege, adding it to the database if needed.
+     */
+    int64_t GetPrivilegeId(const std::string &privilege);
+
+    /**
+     * Return statement inserting given number of (app_id, privilege_id) rows
+     * into app_privilege. Parameter 1 is app_id, following are privilege ids.
      */
-    std::vector<DB::SqlConnection::DataCommandAutoPtr> m_commands;
+    DB::SqlConnection::DataCommandAutoPtr & getAddAppPrivilegesQuery(size_t rows);
 
     /**
-     * Fills empty m_commands map with sql commands prepared for binding.
+     * Find app_id and pkg_id of the application installed for the user.
+     *
+     * @return false if there is no such application
+     */
+    bool GetAppRowIds(const std::string &appId, uid_t uid, int64_t &appRowId,
+        int64_t &pkgRowId);
+
+    /**
+     * Connection used by readers that are not in a transaction.
+     * Borrowed from the pool for the duration of a single query, returned
+     * on destruction. Thread owning the transaction reads through the
+     * writer connection to see its own changes.
+     * Query is reset on destruction to end the implicit read transaction,
+     * otherwise the connection would stay on an old snapshot.
+     */
+    class ReadConnection {
+    public:
+        explicit ReadConnection(PrivilegeDb &db);
+        ~ReadConnection();
+        DB::SqlConnection::DataCommandAutoPtr & getQuery(QueryType queryType);
+    private:
+        PrivilegeDb &m_db;
+        bool m_pooled;
+        Connection *m_connection;
+        DB::SqlConnection::DataCommand *m_command;
+    };
+
+    /**
+     * Maximum number of read only connections opened in addition
+     * to the writer connection.
+     */
+    static const size_t READ_POOL_SIZE = 3;
+
+    std::string m_path;
+
+    /**
+     * The only read-write connection, guarded by m_writerMutex.
+     * Mutex is held by the transaction owner from BeginTransaction()
+     * until CommitTransaction() or RollbackTransaction().
+     */
+    Connection m_writer;
+    std::recursive_mutex m_writerMutex;
+    std::atomic<std::thread::id> m_transactionOwner;
+
+    /**
+     * Transaction group state, guarded by m_writerMutex. While a group is
+     * open, transactions of its owner are savepoints inside the group
+     * transaction. m_savepointIndexUpdates is the size of
+     * m_pendingIndexUpdates when the current savepoint was set.
+     */
+    bool m_inGroup;
+    bool m_inSavepoint;
+    size_t m_savepointIndexUpdates;
+
+    std::vector<std::unique_ptr<Connection>> m_readers;
+    std::vector<Connection*> m_freeReaders;
+    std::mutex m_readersMutex;
+    std::condition_variable m_readersCond;
+
+    /**
+     * Switch existing database to write-ahead log journal, so that readers
+     * are not blocked by the writer. Failure is not fatal.
+     */
+    void EnableWal();
+
+    /**
+     * Upgrade database schema to the version created by db.sql, applying
+     * migration steps one by one, starting from stored "PRAGMA user_version".
+     * All steps are done in a single transaction.
+     * @exception DB::SqlConnection::Exception::Base on database error
+     */
+    void Migrate();
+
+    /**
+     * Fills empty commands vector of the connection with sql commands
+     * prepared for binding.
      *
      * Because the "sqlite3_prepare_v2" function takes many cpu cycles, the PrivilegeDb
-     * is optimized to call it only once for one query type.
-     * Designed to be used in the singleton contructor.
+     * is optimized to call it only once for one query type on each connection.
      */
-    void initDataCommands();
+    void initDataCommands(Connection &connection);
 
     /**
      * Return prepared query for given query type.
      * The query will be reset before returning.
      *
      * @param queryType query identifier
+     * @param connection connection the query was prepared on, writer by default
      * @return reference to prepared, reset query
      */
+    DB::SqlConnection::DataCommandAutoPtr & getQuery(QueryType queryType,
+        Connection &connection);
     DB::SqlConnection::DataCommandAutoPtr & getQuery(QueryType queryType);
 
+    /**
+     * Take read only connection from the pool, opening a new one if the pool
+     * is not full yet. Blocks when all READ_POOL_SIZE connections are in use.
+     */
+    Connection *AcquireReader();
+    void ReleaseReader(Connection *connection);
+
+    /**
+     * @return true if calling thread has an open transaction
+     */
+    bool InTransaction() const;
+
+    /**
+     * Release the writer if calling thread owns the transaction.
+     */
+    void EndTransaction();
+
     /**
      * Check if pkgId is already registered in database
      *
@@ -118,6 +277,57 @@ private:
      */
     bool PkgIdExists(const std::string &pkgId);
 
+    /**
+     * In-memory copy of the database, NULL if not enabled.
+     * Contains committed data only, guarded by m_indexMutex.
+     */
+    std::unique_ptr<PrivilegeDbIndex> m_index;
+    std::mutex m_indexMutex;
+
+    /**
+     * Index changes made by the open transaction, applied on commit.
+     */
+    std::vector<std::function<void(PrivilegeDbIndex &)>> m_pendingIndexUpdates;
+
+    /**
+     * Value of "PRAGMA data_version" at the time index was loaded.
+     * It changes when other connection (e.g. policy reload script) commits.
+     */
+    int m_dataVersion;
+
+    /**
+     * Number of times the index was (re)loaded from the database.
+     */
+    unsigned m_indexLoads;
+
+    /**
+     * Fill the index with current content of the database.
+     * @exception DB::SqlConnection::Exception::InternalError on internal error
+     */
+    void LoadIndex();
+
+    /**
+     * Reload the index if the database was modified outside of this object.
+     * Must be called with m_indexMutex held.
+     */
+    void RefreshIndex();
+
+    /**
+     * Answer read query from the index.
+     *
+     * @param read function called with up to date index
+     * @return false if index can't be used (not enabled or calling thread is
+     *         in a transaction), database must be queried then
+     * @exception DB::SqlConnection::Exception::InternalError on internal error
+     */
+    bool ReadIndex(const std::function<void(const PrivilegeDbIndex &)> &read);
+
+    /**
+     * Apply a change to the index, deferring it until commit if calling
+     * thread is in a transaction.
+     */
+    void UpdateIndex(const std::function<void(PrivilegeDbIndex &)> &update);
+
 public:
     class Exception
     {
@@ -127,12 +337,49 @@ public:
         DECLARE_EXCEPTION_TYPE(Base, InternalError)
     };
 
+    /**
+     * Constructor
+     * Use getInstance(), other instances are meant for tools and benchmarks.
+     * @exception PrivilegeDb::Exception::IOError on problems with database access
+     *
+     */
+    PrivilegeDb(const std::string &path = std::string(PRIVILEGE_DB_PATH));
+
     ~PrivilegeDb(void);
 
     static PrivilegeDb &getInstance();
 
+    /**
+     * SQL of the queries, by type. Meant for tests of their query plans.
+     */
+    const std::map<QueryType, const char * const> &GetQueries(void) const
+    {
+        return Queries;
+    }
+
+    /**
+     * Keep whole database content in memory and answer all read queries
+     * from it. Intended for the daemon, which is the only writer.
+     *
+     * @exception PrivilegeDb::Exception::InternalError on internal error
+     */
+    void EnableIndex(void);
+
+    /**
+     * Return a counter increased each time the index is reloaded because
+     * the database was modified outside of this object (e.g. privilege-group
+     * mappings reload). Caches derived from the database content can use it
+     * to detect such modifications.
+     *
+     * @return the counter, always 0 if index is not enabled
+     * @exception PrivilegeDb::Exception::InternalError on internal error
+     */
+    unsigned GetIndexGeneration(void);
+
     /**
      * Begin transaction
+     * Other threads can read committed data during the transaction,
+     * but their writes wait until it ends.
      * @exception DB::SqlConnection::Exception::InternalError on internal error
      *
      */
@@ -152,6 +399,32 @@ public:
      */
     void RollbackTransaction(void);
 
+    /**
+     * Begin transaction shared by several requests, committed together.
+     * Until the group ends, BeginTransaction() called by the same thread sets
+     * a savepoint, CommitTransaction() releases it and RollbackTransaction()
+     * undoes changes made since it was set, leaving changes of other requests
+     * in the group intact. Changes are neither durable nor visible to other
+     * threads before CommitTransactionGroup().
+     * @exception PrivilegeDb::Exception::InternalError on internal error
+     *
+     */
+    void BeginTransactionGroup(void);
+
+    /**
+     * Commit all requests of the transaction group
+     * @exception PrivilegeDb::Exception::InternalError on internal error
+     *
+     */
+    void CommitTransactionGroup(void);
+
+    /**
+     * Rollback all requests of the transaction group
+     * @exception PrivilegeDb::Exception::InternalError on internal error
+     *
+     */
+    void RollbackTransactionGroup(void);
+
     /**
      * Return package id associated with a given application id
      *
@@ -236,6 +509,14 @@ public:
     void GetPrivilegeGroups(const std::string &privilege,
         std::vector<std::string> &grp_names);
 
+    /**
+     * Retrieve names of all groups assigned to any privilege
+     *
+     * @param[out] groups - list of group names
+     * @exception DB::SqlConnection::Exception::InternalError on internal error
+     */
+    void GetGroups(std::vector<std::string> &groups);
+
     /**
      * Retrieve list of apps assigned to user
      *
@@ -255,6 +536,53 @@ public:
      */
     void GetAppIdsForPkgId (const std::string &pkgId,
         std::vector<std::string> &appIds);
+
+    /**
+     * Retrieve Smack rules recorded for the owner
+     *
+     * @param owner - name of the rules file: app_<appId> or pkg_<pkgId>
+     * @param[out] rules - rules of the owner
+     * @exception DB::SqlConnection::Exception::InternalError on internal error
+     */
+    void GetSmackRules(const std::string &owner, std::vector<SmackRule> &rules);
+
+    /**
+     * Retrieve Smack rules of the owner with given subject or object label
+     *
+     * @param owner - name of the rules file: app_<appId> or pkg_<pkgId>
+     * @param label - Smack label
+     * @param[out] rules - rules of the owner with the label
+     * @exception DB::SqlConnection::Exception::InternalError on internal error
+     */
+    void GetLabelSmackRules(const std::string &owner, const std::string &label,
+        std::vector<SmackRule> &rules);
+
+    /**
+     * Record Smack rules of the owner, replacing access of rules
+     * with the same subject and object
+     *
+     * @param owner - name of the rules file: app_<appId> or pkg_<pkgId>
+     * @param rules - rules to add
+     * @exception DB::SqlConnection::Exception::InternalError on internal error
+     */
+    void AddSmackRules(const std::string &owner, const std::vector<SmackRule> &rules);
+
+    /**
+     * Remove all Smack rules of the owner
+     *
+     * @param owner - name of the rules file: app_<appId> or pkg_<pkgId>
+     * @exception DB::SqlConnection::Exception::InternalError on internal error
+     */
+    void RemoveSmackRules(const std::string &owner);
+
+    /**
+     * Remove Smack rules of the owner with given subject or object label
+     *
+     * @param owner - name of the rules file: app_<appId> or pkg_<pkgId>
+     * @param label - Smack label
+     * @exception DB::SqlConnection::Exception::InternalError on internal error
+     */
+    void RemoveLabelSmackRules(const std::string &owner, const std::string &label);
 };
 
 } //namespace SecurityManager
@@ -0,0 +1,132 @@
+/*
+ * security-manager, database access
+ *
+ * Copyright (c) 2000 - 2014 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ * Contact: Rafal Krypa <r.krypa@samsung.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * @file        privilege_db_index.h
+ * @version     1.0
+ * @brief       In-memory copy of the privileges database used to serve read queries.
+ */
+
+#include <map>
+#include <string>
+#include <sys/types.h>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#ifndef PRIVILEGE_DB_INDEX_H_
+#define PRIVILEGE_DB_INDEX_H_
+
+namespace SecurityManager {
+
+/**
+ * Hash maps mirroring content of the privileges database.
+ *
+ * Modifications must follow semantics of the corresponding database views,
+ * so that queries answered from the index give the same results as SQL.
+ * Package and privilege names are interned, each distinct string is stored
+ * once no matter how many applications refer to it. Interned strings are
+ * reference counted, a string is freed with the last application using it.
+ */
+class PrivilegeDbIndex {
+public:
+    void clear();
+
+    /**
+     * Add application, ignored if appId is already installed for the uid
+     * (like INSERT OR IGNORE on app_pkg_view).
+     */
+    void addApplication(const std::string &appId, const std::string &pkgId, uid_t uid);
+
+    void removeApplication(const std::string &appId, uid_t uid);
+
+    /**
+     * Add single privilege of an application, ignored for unknown application.
+     */
+    void addAppPrivilege(const std::string &appId, uid_t uid, const std::string &privilege);
+
+    /**
+     * Replace all privileges of an application, ignored for unknown application.
+     */
+    void setAppPrivileges(const std::string &appId, uid_t uid,
+        const std::vector<std::string> &privileges);
+
+    void addPrivilegeGroup(const std::string &privilege, const std::string &groupName);
+
+    bool getAppPkgId(const std::string &appId, std::string &pkgId) const;
+
+    bool pkgIdExists(const std::string &pkgId) const;
+
+    /* Privileges are returned sorted and without duplicates */
+    void getPkgPrivileges(const std::string &pkgId, uid_t uid,
+        std::vector<std::string> &privileges) const;
+
+    /* Privileges are returned sorted and without duplicates */
+    void getAppPrivileges(const std::string &appId, uid_t uid,
+        std::vector<std::string> &privileges) const;
+
+    void getPrivilegeGroups(const std::string &privilege,
+        std::vector<std::string> &groups) const;
+
+    void getUserApps(uid_t uid, std::vector<std::string> &apps) const;
+
+    void getAppIdsForPkgId(const std::string &pkgId,
+        std::vector<std::string> &appIds) const;
+
+    /* Number of (application, user) entries */
+    size_t appCount() const;
+
+    /**
+     * Approximate heap memory used by the index, in bytes.
+     * Counts string payloads, container nodes and bucket arrays.
+     */
+    size_t memoryUsage() const;
+
+private:
+    typedef const std::string *Str;
+
+    struct AppEntry {
+        Str pkgId;
+        std::vector<Str> privileges;  // sorted by value
+    };
+
+    typedef std::map<uid_t, AppEntry> UserAppEntries;
+    typedef std::pair<Str, uid_t> AppRef;    // appId points to key in m_apps
+
+    /* Reference to the interned copy of the string, dropped by release() */
+    Str intern(const std::string &str);
+    void release(Str str);
+    void releaseApp(const AppEntry &entry);
+    AppEntry *findApp(const std::string &appId, uid_t uid);
+    const AppEntry *findApp(const std::string &appId, uid_t uid) const;
+
+    /* Interned strings and numbers of their references */
+    std::unordered_map<std::string, size_t> m_strings;
+    std::unordered_map<std::string, UserAppEntries> m_apps;
+    std::unordered_map<Str, std::vector<AppRef>> m_pkgApps;
+    std::unordered_map<uid_t, std::vector<Str>> m_userApps;
+    std::unordered_map<Str, std::vector<Str>> m_privilegeGroups;
+    size_t m_appCount = 0;
+};
+
+} //namespace SecurityManager
+
+#endif // PRIVILEGE_DB_INDEX_H_
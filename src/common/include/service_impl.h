@@ -27,6 +27,7 @@
 #include <unistd.h>
 #include <sys/types.h>
 
+#include <functional>
 #include <unordered_set>
 
 #include "security-manager.h"
@@ -39,20 +40,28 @@ namespace ServiceImpl {
  *
  * @param[in] req installation request
  * @param[in] uid id of the requesting user
+ * @param[out] afterCommit if given, labels and Smack rules are not set, but
+ *             left to this function to be called once the open transaction
+ *             group is committed; it returns the final result of the request
  *
  * @return API return code, as defined in protocols.h
  */
-int appInstall(const app_inst_req &req, uid_t uid);
+int appInstall(const app_inst_req &req, uid_t uid,
+    std::function<int()> *afterCommit = nullptr);
 
 /**
  * Process application uninstallation request.
  *
  * @param[in] req uninstallation request
  * @param[in] uid id of the requesting user
+ * @param[out] afterCommit if given, Smack rules are not removed, but left to
+ *             this function as for appInstall(); it stays empty if there is
+ *             nothing to remove
  *
  * @return API return code, as defined in protocols.h
  */
-int appUninstall(const std::string &appId, uid_t uid);
+int appUninstall(const std::string &appId, uid_t uid,
+    std::function<int()> *afterCommit = nullptr);
 
 /**
  * Process package id query.
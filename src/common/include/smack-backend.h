@@ -0,0 +1,179 @@
+/*
+ *  Copyright (c) 2014 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *  Contact: Rafal Krypa <r.krypa@samsung.com>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License
+ */
+/*
+ * @file        smack-backend.h
+ * @brief       Interface between security-manager and Smack policy and labels
+ */
+
+#ifndef _SECURITY_MANAGER_SMACK_BACKEND_
+#define _SECURITY_MANAGER_SMACK_BACKEND_
+
+#include <sys/types.h>
+
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+
+namespace SecurityManager {
+
+class SmackRules;
+
+/**
+ * Where Smack rules are loaded and Smack labels of files are set.
+ *
+ * The kernel backend is the default, used by the daemon in production.
+ * The others let installation run without Smack in the kernel and without
+ * root, for benchmarking and profiling: the memory backend keeps rules and
+ * labels in memory, the user-xattr backend keeps rules in memory and sets
+ * labels as extended attributes in the user namespace (user.SMACK64 etc.),
+ * supported by tmpfs and most disk file systems.
+ */
+class SmackBackend {
+public:
+    virtual ~SmackBackend() {}
+
+    /* Name accepted by create() */
+    virtual const char *name() const = 0;
+
+    /**
+     * False if there is no policy to update, rules are only saved to files
+     * then. The kernel backend has none if smackfs is not mounted.
+     */
+    virtual bool hasPolicy() const = 0;
+
+    /**
+     * Add rules to the policy, or change access of rules already there.
+     *
+     * @exception SmackException::LibsmackError on error
+     */
+    virtual void apply(const SmackRules &rules) = 0;
+
+    /**
+     * Remove rules from the policy, their access is ignored.
+     *
+     * @exception SmackException::LibsmackError on error
+     */
+    virtual void clear(const SmackRules &rules) = 0;
+
+    /**
+     * Extended attribute holding a Smack attribute of files, e.g.
+     * XATTR_NAME_SMACK. Returned name is a string constant.
+     *
+     * @return NULL if the backend doesn't keep labels in extended attributes
+     */
+    virtual const char *xattrName(const char *attribute) const = 0;
+
+    /**
+     * Set Smack attribute of a file, symlinks are not followed.
+     *
+     * @return 0 on success, -1 with errno set on error, as lsetxattr()
+     */
+    virtual int setLabel(const char *path, const char *attribute,
+        const std::string &label) = 0;
+
+    /**
+     * Read Smack attribute of a file, symlinks are not followed.
+     *
+     * @return length of the label, -1 with errno set on error, as lgetxattr()
+     */
+    virtual ssize_t getLabel(const char *path, const char *attribute,
+        char *buffer, size_t size) = 0;
+
+    /**
+     * Backend used by SmackRules and SmackLabels, the kernel one unless
+     * another one is set.
+     */
+    static SmackBackend &get();
+
+    /**
+     * Replace the backend. Must be called before rules or labels are used,
+     * e.g. on start of the daemon.
+     */
+    static void set(std::unique_ptr<SmackBackend> backend);
+
+    /**
+     * Create backend by name: "kernel", "memory" or "user-xattr".
+     *
+     * @return NULL if the name is not known
+     */
+    static std::unique_ptr<SmackBackend> create(const std::string &name);
+};
+
+/* Smack in the kernel, through libsmack and security.SMACK64* attributes */
+class KernelSmackBackend : public SmackBackend {
+public:
+    const char *name() const;
+    bool hasPolicy() const;
+    void apply(const SmackRules &rules);
+    void clear(const SmackRules &rules);
+    const char *xattrName(const char *attribute) const;
+    int setLabel(const char *path, const char *attribute, const std::string &label);
+    ssize_t getLabel(const char *path, const char *attribute, char *buffer, size_t size);
+};
+
+/* Policy and labels simulated in memory, nothing leaves the process */
+class MemorySmackBackend : public SmackBackend {
+public:
+    const char *name() const;
+    bool hasPolicy() const;
+    void apply(const SmackRules &rules);
+    void clear(const SmackRules &rules);
+    const char *xattrName(const char *attribute) const;
+    int setLabel(const char *path, const char *attribute, const std::string &label);
+    ssize_t getLabel(const char *path, const char *attribute, char *buffer, size_t size);
+
+    /**
+     * Access of subject to object in the policy, in "rwxatlb" order.
+     *
+     * @return empty string if there is no such rule
+     */
+    std::string getAccess(const std::string &subject, const std::string &object);
+
+    /* Number of rules in the policy */
+    size_t ruleCount();
+
+private:
+    typedef std::pair<std::string, std::string> Key;
+
+    std::map<Key, std::string> m_policy;
+    std::mutex m_policyMutex;
+
+    /* Labels by path and attribute */
+    std::map<Key, std::string> m_labels;
+    std::mutex m_labelsMutex;
+};
+
+/*
+ * Policy simulated in memory, labels set in user.SMACK64* attributes.
+ * Kernel refuses user.* attributes on symlinks and special files, their
+ * labels are kept in memory as by the memory backend.
+ */
+class UserXattrSmackBackend : public MemorySmackBackend {
+public:
+    const char *name() const;
+    const char *xattrName(const char *attribute) const;
+    int setLabel(const char *path, const char *attribute, const std::string &label);
+    ssize_t getLabel(const char *path, const char *attribute, char *buffer, size_t size);
+};
+
+} // namespace SecurityManager
+
+#endif // _SECURITY_MANAGER_SMACK_BACKEND_
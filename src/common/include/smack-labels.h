@@ -26,6 +26,7 @@
 #ifndef _SMACK_LABELS_H_
 #define _SMACK_LABELS_H_
 
+#include <cstddef>
 #include <string>
 #include <utility>
 #include <smack-exceptions.h>
@@ -34,6 +35,14 @@
 namespace SecurityManager {
 namespace SmackLabels {
 
+/**
+ * Numbers of extended attributes written and left as they were by setupPath()
+ */
+struct LabelingStatistics {
+    size_t changed;
+    size_t skipped;
+};
+
 /**
  * Sets Smack labels on a directory and its contents, recursively.
  *
@@ -41,10 +50,22 @@ namespace SmackLabels {
  * @param path[in] path to a file or directory to setup
  * @param pathType[in] type of path to setup. See description of
  *         app_install_path_type in security-manager.h for details
+ * @param incremental[in] read current labels and write only those that differ,
+ *         saves inode writes when reinstalling an application
+ * @return numbers of changed and skipped attributes
+ *
+ */
+LabelingStatistics setupPath(const std::string &appId, const std::string &path,
+    app_install_path_type pathType, bool incremental = false);
+
+/**
+ * Set number of threads labeling directory trees in setupPath().
+ * Subdirectories are distributed among the threads, which helps with big
+ * application data directories. Default is 1, labeling in the calling thread.
  *
+ * @param threads[in] number of threads, 0 is treated as 1
  */
-void setupPath(const std::string &appId, const std::string &path,
-    app_install_path_type pathType);
+void setLabelingThreads(unsigned threads);
 
 /**
  * Sets Smack labels on a <ROOT_APP>/<pkg_id> and <ROOT_APP>/<pkg_id>/<app_id>
@@ -0,0 +1,109 @@
+/*
+ *  Copyright (c) 2014 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *  Contact: Rafal Krypa <r.krypa@samsung.com>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License
+ */
+/*
+ * @file        smack-rules-store.h
+ * @brief       Single file with Smack rules of all applications and packages
+ */
+
+#ifndef _SECURITY_MANAGER_SMACK_RULES_STORE_
+#define _SECURITY_MANAGER_SMACK_RULES_STORE_
+
+#include <cstddef>
+#include <map>
+#include <string>
+
+namespace SecurityManager {
+
+/**
+ * Copy of all rule files from accesses.d, kept in one binary file so that
+ * the rules can be loaded on boot without opening and parsing each of them.
+ *
+ * The file consists of a header, a table of sections, section names and
+ * rules of all sections. Each section holds rules of one rule file, named
+ * after it (app_<appId> or pkg_<pkgId>), in the text format accepted by
+ * smackfs load2. Rules of all sections are stored one after another, so
+ * the loader maps the file and writes them to the kernel as they are.
+ *
+ * Rule files remain the reference. Installation only writes them, the store
+ * is rebuilt from accesses.d when it's older than the directory or any rule
+ * file in it: by the daemon after requests changing rule files (once per
+ * commit group) and on its exit, and on boot before the rules are loaded by
+ * security-manager-rules-loader.service. A stale store is never loaded,
+ * loader falls back to accesses.d when the store can't be rebuilt. The file
+ * is replaced atomically.
+ */
+class SmackRulesStore {
+public:
+    /**
+     * Create store with rules of all rule files in the directory.
+     *
+     * @param[in] rulesDir - directory with rule files, e.g. accesses.d
+     * @param[in] storePath - path of the store file to create
+     * @exception SmackException::FileError if a file can't be read or written
+     */
+    static void build(const std::string &rulesDir, const std::string &storePath);
+
+    /**
+     * Check if the store misses changes of rule files. Modification time of
+     * the store is compared to the one of the directory, changed by creation,
+     * replacement and removal of files, and to the ones of rule files.
+     *
+     * @param[in] rulesDir - directory with rule files, e.g. accesses.d
+     * @param[in] storePath - path of the store file
+     * @return true if the store is missing or not newer than all of them
+     */
+    static bool isStale(const std::string &rulesDir, const std::string &storePath);
+
+    /**
+     * Write all rules in the store to smackfs load2 interface, or to another
+     * file accepting the same format. Rules are written in batches limited
+     * by the page size, the kernel parses at most PAGE_SIZE - 1 bytes in
+     * one write.
+     *
+     * @param[in] storePath - path of the store file
+     * @param[in] loadPath - path of the load2 file
+     * @return number of loaded rules
+     * @exception SmackException::FileError on invalid store or write error
+     */
+    static size_t load(const std::string &storePath, const std::string &loadPath);
+
+    /**
+     * Rebuild the store of the system if it's stale. Errors are logged, the
+     * store is then rebuilt on boot.
+     */
+    static void refresh();
+
+    /**
+     * Load rules of all applications and packages to the kernel, from the
+     * store rebuilt first if stale, or from accesses.d if there is no
+     * up to date store.
+     *
+     * @exception SmackException::Base on error
+     */
+    static void loadToKernel();
+
+private:
+    typedef std::map<std::string, std::string> Sections;
+
+    static void readRulesDir(const std::string &rulesDir, Sections &sections);
+    static void writeStore(const std::string &storePath, const Sections &sections);
+};
+
+} // namespace SecurityManager
+
+#endif // _SECURITY_MANAGER_SMACK_RULES_STORE_
@@ -25,14 +25,28 @@
 #ifndef _SMACK_RULES_H_
 #define _SMACK_RULES_H_
 
+#include <memory>
 #include <vector>
 #include <string>
 #include <smack-exceptions.h>
 
-struct smack_accesses;
-
 namespace SecurityManager {
 
+/* Rule as written to the kernel, access in the "rwxatl" form */
+struct SmackRule {
+    std::string subject;
+    std::string object;
+    std::string access;
+};
+
+/* Change of access of an existing rule, allowed access added, denied removed */
+struct SmackRuleModification {
+    std::string subject;
+    std::string object;
+    std::string allow;
+    std::string deny;
+};
+
 class SmackRules
 {
 public:
@@ -50,8 +64,86 @@ public:
 
     void apply() const;
     void clear() const;
+
+    /**
+     * Replace the file with the rules. The rules are written to a temporary
+     * file renamed over the old one, so the file always has either all old
+     * or all new rules. Data of the file is synced to disk before the rename,
+     * the rename itself before returning. In a batch the file is renamed at
+     * its end, reads of the file in the batch see the new rules.
+     */
     void saveToFile(const std::string &path) const;
 
+    /**
+     * Rules added with add() or loaded from a file.
+     */
+    const std::vector<SmackRule> &getRules() const;
+
+    /**
+     * Modifications added with addModify() or loaded from a file.
+     */
+    const std::vector<SmackRuleModification> &getModifications() const;
+
+    /**
+     * Append rules to the file, creating it if needed.
+     * Unlike saveToFile(), rules already in the file are kept. The file is
+     * replaced the same way as by saveToFile().
+     */
+    void appendToFile(const std::string &path) const;
+
+    /**
+     * Start a batch of rule file changes, e.g. of one request or a group
+     * of requests. Files replaced in the batch are synced to disk by
+     * flushBatch() with one syncfs() and renamed, then renames and removals
+     * are synced with one fsync() per directory instead of two syncs per
+     * file. Until then a crash may leave either version of the files, never
+     * a partially written one.
+     * Calls may be nested, the outermost flushBatch() ends the batch.
+     */
+    static void beginBatch();
+
+    /**
+     * End the batch started by beginBatch().
+     *
+     * @exception SmackException::FileError if changes could not be synced,
+     *            the batch is ended anyway
+     */
+    static void flushBatch();
+
+    /* Batch ended by flush(), or by destruction if an error left it open */
+    class ScopedBatch {
+    public:
+        ScopedBatch()
+          : m_flushed(false)
+        {
+            SmackRules::beginBatch();
+        }
+
+        /* @exception SmackException::FileError as flushBatch() */
+        void flush()
+        {
+            m_flushed = true;
+            SmackRules::flushBatch();
+        }
+
+        ~ScopedBatch()
+        {
+            if (m_flushed)
+                return;
+            // Already failing, the error being handled is the one reported
+            try {
+                SmackRules::flushBatch();
+            } catch (...) {
+            }
+        }
+
+        ScopedBatch(const ScopedBatch &) = delete;
+        ScopedBatch &operator=(const ScopedBatch &) = delete;
+
+    private:
+        bool m_flushed;
+    };
+
     /**
      * Create cross dependencies for all applications in a package
      *
@@ -62,23 +154,41 @@ public:
      */
     void generatePackageCrossDeps(const std::vector<std::string> &pkgContents);
 
+    /**
+     * Create cross dependencies between one application and all other
+     * applications in its package, 2 * (n - 1) rules.
+     *
+     * @param[in] appId - application id
+     * @param[in] pkgContents - a list of all applications inside the package
+     */
+    void generateAppCrossDeps(const std::string &appId,
+        const std::vector<std::string> &pkgContents);
+
     /**
      * Install package-specific smack rules.
      *
      * Function creates smack rules using predefined template. Rules are applied
      * to the kernel and saved on persistent storage so they are loaded on system boot.
+     * Only rules between the application and other applications in the package
+     * are added to package rules, rules among the others are left as they are.
+     * Rules are also recorded in the database, rules of a reinstalled application
+     * missing from the new set are revoked.
      *
      * @param[in] appId - application id that is beeing installed
      * @param[in] pkgId - package id that the application is in
      * @param[in] pkgContents - a list of all applications in the package
+     * @param[in] newInPackage - true if the application wasn't in the package before,
+     *            otherwise its package rules are already saved and are only
+     *            applied to the kernel again
      */
     static void installApplicationRules(const std::string &appId, const std::string &pkgId,
-        const std::vector<std::string> &pkgContents);
+        const std::vector<std::string> &pkgContents, bool newInPackage);
     /**
      * Uninstall package-specific smack rules.
      *
-     * Function loads package-specific smack rules, revokes them from the kernel
-     * and removes them from the persistent storage.
+     * Function revokes package-specific smack rules recorded in the database
+     * from the kernel and removes them from the persistent storage. Rules
+     * installed before they were recorded are loaded from the rules file.
      *
      * @param[in] pkgId - package identifier
      */
@@ -92,21 +202,34 @@ public:
     * Uninstall application-specific smack rules.
     *
     * Function removes application specific rules from the kernel, and
-    * removes them for persistent storage.
+    * removes them for persistent storage. Rules between the application
+    * and applications left in the package are removed from package rules,
+    * rules among the others are left as they are.
     *
     * @param[in] appId - application id
-    * @param[in] pkgId - package id that the application belongs to
-    * @param[in] appsInPkg - a list of other applications in the same package id that the application belongs to
+    * @param[in] pkgId - package id that the application belonged to
+    * @param[in] appsInPkg - a list of applications left in the package
     */
     static void uninstallApplicationRules(const std::string &appId, const std::string &pkgId,
             std::vector<std::string> appsInPkg);
 
+    /**
+    * Uninstall application-specific smack rules, leaving package rules intact.
+    *
+    * Meant for removing many applications at once, package rules
+    * should be updated once per package afterwards.
+    *
+    * @param[in] appId - application id
+    */
+    static void uninstallApplicationRules(const std::string &appId);
+
     /**
      * Update package specific rules
      *
      * This function regenerates all package rules that
      * need to exist currently for all application in that
-     * package
+     * package. Recorded rules that are no longer needed
+     * are revoked.
      *
      * @param[in] pkgId - id of the package to update
      * @param[in] pkgContents - a list of all applications in the package
@@ -115,27 +238,146 @@ public:
 
 private:
     /**
-     * Create a path for package rules
+     * Name of the rules file of an application or package, also the owner
+     * of its rules in the database
+     */
+    static std::string getPackageRulesName(const std::string &pkgId);
+    static std::string getApplicationRulesName(const std::string &appId);
+
+    /**
+     * Create a path for rules file with given name
+     */
+    static std::string getRulesFilePath(const std::string &name);
+
+    /**
+     * Uninstall rules of the owner
      *
+     * This is a utility function that will clear all rules
+     * of the owner recorded in the database, or in its rules
+     * file if there are none, and remove the file
+     *
+     * @param[in] name - name of the rules file
      */
-    static std::string getPackageRulesFilePath(const std::string &pkgId);
+    static void uninstallRules(const std::string &name);
 
     /**
-     * Create a path for application rules
+     * Clear all rules in the file specified by path and remove the file
+     *
+     * @param[in] path - path to the file that contains the rules
      */
-    static std::string getApplicationRulesFilePath(const std::string &appId);
+    static void uninstallRulesFile(const std::string &path);
 
     /**
-     * Uninstall rules inside a specified file path
+     * Remove rules of the owner with given subject or object label,
+     * from the kernel, database and the rules file.
      *
-     * This is a utility function that will clear all
-     * rules in the file specified by path
+     * @param[in] name - name of the rules file
+     * @param[in] label - Smack label
+     * @return false if no rules with the label are recorded in the database
+     */
+    static bool removeLabelRules(const std::string &name, const std::string &label);
+
+    /**
+     * Remove rules with given subject or object label from the file.
+     * Missing file is not an error, there is nothing to remove then.
      *
      * @param[in] path - path to the file that contains the rules
+     * @param[in] label - Smack label
+     */
+    static void removeLabelRulesFromFile(const std::string &path, const std::string &label);
+
+    /**
+     * Revoke recorded rules of the owner that are not among the new rules
+     * and record the new rules instead.
+     *
+     * @param[in] name - name of the rules file
+     * @param[in] rules - new rules of the owner
+     */
+    static void replaceRecordedRules(const std::string &name, const std::vector<SmackRule> &rules);
+
+    /**
+     * Read rules from a rules file that is not recorded in the database yet.
+     * Missing file is not an error, there are no rules then.
+     *
+     * @param[in] path - path to the file that contains the rules
+     * @param[out] rules - rules in the file
+     */
+    static void readRulesFile(const std::string &path, std::vector<SmackRule> &rules);
+
+    void writeToFile(const std::string &path, bool append) const;
+
+    /**
+     * Replace contents of the rules file through a temporary file.
+     *
+     * @param[in] path - path to the rules file
+     * @param[in] data - new contents of the file
+     */
+    static void replaceRulesFile(const std::string &path, const std::string &data);
+
+    /**
+     * Make a rename or removal of the rules file durable, now or at the end
+     * of the batch.
+     *
+     * @param[in] path - path to the rules file
+     */
+    static void syncRulesDir(const std::string &path);
+
+    std::vector<SmackRule> m_rules;
+    std::vector<SmackRuleModification> m_modifications;
+};
+
+/**
+ * Rules template parsed into subject, object and permissions, with ~APP~
+ * and ~PKG~ placeholders recognized once, at parse time.
+ */
+class SmackRulesTemplate
+{
+public:
+    /**
+     * Parse template rules, one "subject object permissions" rule per line.
+     * Empty lines are skipped.
+     *
+     * @exception SmackException::FileError on invalid rule
      */
-    static void uninstallRules (const std::string &path);
+    explicit SmackRulesTemplate(const std::vector<std::string> &templateRules);
+
+    /**
+     * Add rules of the template to rules, with placeholders replaced by labels
+     * of the application and package. Each label is generated once.
+     *
+     * @exception SmackException::InvalidLabel if label can't be generated
+     */
+    void expand(SmackRules &rules, const std::string &appId, const std::string &pkgId) const;
+
+    /**
+     * Return parsed application rules template file. The file is parsed
+     * again only when its inode, size or modification time changes.
+     * Returned template stays valid after the file is reloaded.
+     *
+     * @exception SmackException::FileError if the file can't be read or is invalid
+     */
+    static std::shared_ptr<const SmackRulesTemplate> getAppRulesTemplate();
+
+private:
+    enum class Label {
+        LITERAL,
+        APP,
+        PKG
+    };
+
+    struct Rule {
+        Label subjectType;
+        Label objectType;
+        std::string subject;
+        std::string object;
+        std::string permissions;
+    };
+
+    static Label parseLabel(const std::string &label);
 
-    smack_accesses *m_handle;
+    std::vector<Rule> m_rules;
+    bool m_usesAppLabel;
+    bool m_usesPkgLabel;
 };
 
 } // namespace SecurityManager
@@ -0,0 +1,95 @@
+/*
+ *  Copyright (c) 2014 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *  Contact: Rafal Krypa <r.krypa@samsung.com>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License
+ */
+/*
+ * @file        launch_profile_cache.cpp
+ * @brief       Precomputed per application data needed at application launch
+ */
+
+#include <dpl/log/log.h>
+
+#include "privilege_db.h"
+#include "launch_profile_cache.h"
+
+namespace SecurityManager {
+
+LaunchProfileCache::LaunchProfileCache()
+  : m_enabled(false)
+  , m_dbGeneration(0)
+{
+}
+
+LaunchProfileCache &LaunchProfileCache::getInstance()
+{
+    static LaunchProfileCache cache;
+    return cache;
+}
+
+void LaunchProfileCache::enable()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_enabled = true;
+}
+
+bool LaunchProfileCache::get(const std::string &appId, uid_t uid, LaunchProfile &profile)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_enabled)
+        return false;
+
+    unsigned generation = PrivilegeDb::getInstance().GetIndexGeneration();
+    if (generation != m_dbGeneration) {
+        LogDebug("Database modified externally, dropping " << m_profiles.size() <<
+            " launch profiles");
+        m_profiles.clear();
+        m_dbGeneration = generation;
+        return false;
+    }
+
+    auto it = m_profiles.find(Key(appId, uid));
+    if (it == m_profiles.end())
+        return false;
+
+    profile = it->second;
+    return true;
+}
+
+void LaunchProfileCache::put(const std::string &appId, uid_t uid, const LaunchProfile &profile)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_enabled)
+        m_profiles[Key(appId, uid)] = profile;
+}
+
+void LaunchProfileCache::invalidatePkg(const std::string &pkgId)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto it = m_profiles.begin(); it != m_profiles.end();) {
+        if (it->second.pkgId == pkgId)
+            it = m_profiles.erase(it);
+        else
+            ++it;
+    }
+}
+
+void LaunchProfileCache::invalidateAll()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_profiles.clear();
+}
+
+} // namespace SecurityManager
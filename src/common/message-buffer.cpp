@@ -32,6 +32,12 @@ void MessageBuffer::Push(const RawBuffer &data) {
     m_buffer.AppendCopy(&data[0], data.size());
 }
 
+void MessageBuffer::PushUnmanaged(const void *data, size_t size,
+    BinaryQueue::BufferDeleter deleter, void *userParam)
+{
+    m_buffer.AppendUnmanaged(data, size, deleter, userParam);
+}
+
 RawBuffer MessageBuffer::Pop() {
     size_t size = m_buffer.Size();
     RawBuffer buffer;
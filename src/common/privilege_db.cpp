@@ -27,6 +27,7 @@
  * @brief       This file contains declaration of the API to privileges database.
  */
 
+#include <algorithm>
 #include <cstdio>
 #include <list>
 #include <string>
@@ -37,6 +38,39 @@
 
 namespace SecurityManager {
 
+/*
+ * Schema migration steps. Entry N upgrades the database from user_version N
+ * to N + 1. db.sql creates the newest schema directly, its user_version
+ * must be equal to the number of entries.
+ */
+static const std::vector<std::vector<const char *>> Migrations = {
+    /* 0 -> 1: indexes for lookups of applications by user and by package */
+    {
+        "CREATE INDEX IF NOT EXISTS app_uid_index ON app (uid)",
+        "CREATE INDEX IF NOT EXISTS app_pkg_id_index ON app (pkg_id)",
+        "DROP TRIGGER IF EXISTS app_pkg_view_delete_trigger",
+        "CREATE TRIGGER app_pkg_view_delete_trigger "
+        "INSTEAD OF DELETE ON app_pkg_view "
+        "BEGIN "
+        "    DELETE FROM app WHERE app_id=OLD.app_id AND uid=OLD.uid; "
+        "    DELETE FROM pkg WHERE pkg_id=OLD.pkg_id AND NOT EXISTS (SELECT 1 FROM app WHERE pkg_id=OLD.pkg_id); "
+        "END",
+    },
+    /* 1 -> 2: Smack rules of applications and packages */
+    {
+        "CREATE TABLE IF NOT EXISTS smack_rule ("
+        "owner VARCHAR NOT NULL, "
+        "subject VARCHAR NOT NULL, "
+        "object VARCHAR NOT NULL, "
+        "access VARCHAR NOT NULL, "
+        "PRIMARY KEY (owner, subject, object))",
+        "CREATE INDEX IF NOT EXISTS smack_rule_object_index ON smack_rule (owner, object)",
+    },
+};
+
+const size_t PrivilegeDb::READ_POOL_SIZE;
+const size_t PrivilegeDb::PRIVILEGES_PER_STATEMENT;
+
 /* Common code for handling SqlConnection exceptions */
 template <typename T>
 T try_catch(const std::function<T()> &func)
@@ -51,16 +85,51 @@ T try_catch(const std::function<T()> &func)
         LogError("Mysterious internal error in SqlConnection class" << e.DumpToString());
         ThrowMsg(PrivilegeDb::Exception::InternalError,
             "Mysterious internal error in SqlConnection class: " << e.DumpToString());
+    } catch (DB::SqlConnection::Exception::ConnectionBroken &e) {
+        LogError("Unable to open database connection: " << e.DumpToString());
+        ThrowMsg(PrivilegeDb::Exception::IOError,
+            "Unable to open database connection: " << e.DumpToString());
     }
 }
 
+PrivilegeDb::ReadConnection::ReadConnection(PrivilegeDb &db)
+  : m_db(db)
+  , m_pooled(!db.InTransaction())
+  , m_command(nullptr)
+{
+    m_connection = m_pooled ? db.AcquireReader() : &db.m_writer;
+}
+
+PrivilegeDb::ReadConnection::~ReadConnection()
+{
+    if (m_command)
+        m_command->Reset();
+    if (m_pooled)
+        m_db.ReleaseReader(m_connection);
+}
+
+DB::SqlConnection::DataCommandAutoPtr & PrivilegeDb::ReadConnection::getQuery(QueryType queryType)
+{
+    auto &command = m_db.getQuery(queryType, *m_connection);
+    m_command = command.get();
+    return command;
+}
+
 PrivilegeDb::PrivilegeDb(const std::string &path)
+  : m_path(path)
+  , m_inGroup(false)
+  , m_inSavepoint(false)
+  , m_savepointIndexUpdates(0)
+  , m_dataVersion(0)
+  , m_indexLoads(0)
 {
     try {
-        mSqlConnection = new DB::SqlConnection(path,
+        m_writer.sql.reset(new DB::SqlConnection(path,
                 DB::SqlConnection::Flag::None,
-                DB::SqlConnection::Flag::RW);
-        initDataCommands();
+                DB::SqlConnection::Flag::RW));
+        EnableWal();
+        Migrate();
+        initDataCommands(m_writer);
     } catch (DB::SqlConnection::Exception::Base &e) {
         LogError("Database initialization error: " << e.DumpToString());
         ThrowMsg(PrivilegeDb::Exception::IOError,
@@ -69,24 +138,118 @@ PrivilegeDb::PrivilegeDb(const std::string &path)
     };
 }
 
-void PrivilegeDb::initDataCommands()
+void PrivilegeDb::EnableWal()
+{
+    // Journal mode is persistent, this only converts databases created
+    // before db.sql switched to WAL.
+    try {
+        auto command = m_writer.sql->PrepareDataCommand("PRAGMA journal_mode = WAL");
+        if (command->Step() && command->GetColumnString(0) != "wal")
+            LogWarning("Unable to switch database to WAL mode, using: " <<
+                command->GetColumnString(0));
+    } catch (DB::SqlConnection::Exception::Base &e) {
+        LogWarning("Unable to switch database to WAL mode: " << e.DumpToString());
+    }
+}
+
+void PrivilegeDb::Migrate()
+{
+    m_writer.sql->BeginTransaction();
+    try {
+        size_t version = 0;
+        auto userVersion = m_writer.sql->PrepareDataCommand("PRAGMA user_version");
+        if (userVersion->Step())
+            version = static_cast<size_t>(userVersion->GetColumnInteger(0));
+        userVersion.reset();
+
+        if (version > Migrations.size())
+            LogWarning("Database schema version " << version <<
+                " is newer than supported " << Migrations.size());
+
+        for (size_t from = version; from < Migrations.size(); ++from) {
+            LogInfo("Migrating database schema from version " << from <<
+                " to " << from + 1);
+            for (const char *statement : Migrations[from])
+                m_writer.sql->PrepareDataCommand(statement)->Step();
+        }
+
+        if (version < Migrations.size())
+            m_writer.sql->PrepareDataCommand("PRAGMA user_version = %zu",
+                Migrations.size())->Step();
+
+        m_writer.sql->CommitTransaction();
+    } catch (...) {
+        m_writer.sql->RollbackTransaction();
+        throw;
+    }
+}
+
+void PrivilegeDb::initDataCommands(Connection &connection)
 {
     for (auto &it : Queries) {
-        m_commands.push_back(mSqlConnection->PrepareDataCommand(it.second));
+        connection.commands.push_back(connection.sql->PrepareDataCommand(it.second));
     }
 }
 
-DB::SqlConnection::DataCommandAutoPtr & PrivilegeDb::getQuery(QueryType queryType)
+DB::SqlConnection::DataCommandAutoPtr & PrivilegeDb::getQuery(QueryType queryType,
+    Connection &connection)
 {
-    auto &command = m_commands.at(static_cast<size_t>(queryType));
+    auto &command = connection.commands.at(static_cast<size_t>(queryType));
     command->Reset();
     return command;
 }
 
+DB::SqlConnection::DataCommandAutoPtr & PrivilegeDb::getQuery(QueryType queryType)
+{
+    return getQuery(queryType, m_writer);
+}
+
+PrivilegeDb::Connection *PrivilegeDb::AcquireReader()
+{
+    std::unique_lock<std::mutex> lock(m_readersMutex);
+    while (m_freeReaders.empty()) {
+        if (m_readers.size() < READ_POOL_SIZE) {
+            std::unique_ptr<Connection> connection(new Connection);
+            connection->sql.reset(new DB::SqlConnection(m_path,
+                DB::SqlConnection::Flag::None,
+                DB::SqlConnection::Flag::RO));
+            initDataCommands(*connection);
+            m_readers.push_back(std::move(connection));
+            return m_readers.back().get();
+        }
+        m_readersCond.wait(lock);
+    }
+
+    Connection *connection = m_freeReaders.back();
+    m_freeReaders.pop_back();
+    return connection;
+}
+
+void PrivilegeDb::ReleaseReader(Connection *connection)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_readersMutex);
+        m_freeReaders.push_back(connection);
+    }
+    m_readersCond.notify_one();
+}
+
+bool PrivilegeDb::InTransaction() const
+{
+    return m_transactionOwner.load() == std::this_thread::get_id();
+}
+
+void PrivilegeDb::EndTransaction()
+{
+    if (!InTransaction())
+        return;
+    m_transactionOwner = std::thread::id();
+    m_writerMutex.unlock();
+}
+
 PrivilegeDb::~PrivilegeDb()
 {
-    m_commands.clear();
-    delete mSqlConnection;
+    m_readers.clear();
 }
 
 PrivilegeDb &PrivilegeDb::getInstance()
@@ -95,31 +258,215 @@ PrivilegeDb &PrivilegeDb::getInstance()
     return privilegeDb;
 }
 
-void PrivilegeDb::BeginTransaction(void)
+static int getDataVersion(DB::SqlConnection::DataCommandAutoPtr &command)
+{
+    return command->Step() ? command->GetColumnInteger(0) : 0;
+}
+
+void PrivilegeDb::LoadIndex()
+{
+    m_dataVersion = getDataVersion(getQuery(QueryType::EGetDataVersion));
+    m_index->clear();
+    ++m_indexLoads;
+
+    auto &apps = getQuery(QueryType::EGetAllApps);
+    while (apps->Step())
+        m_index->addApplication(apps->GetColumnString(0), apps->GetColumnString(1),
+            static_cast<uid_t>(apps->GetColumnInteger(2)));
+
+    auto &privileges = getQuery(QueryType::EGetAllAppPrivileges);
+    while (privileges->Step())
+        m_index->addAppPrivilege(privileges->GetColumnString(0),
+            static_cast<uid_t>(privileges->GetColumnInteger(1)),
+            privileges->GetColumnString(2));
+
+    auto &groups = getQuery(QueryType::EGetAllPrivilegeGroups);
+    while (groups->Step())
+        m_index->addPrivilegeGroup(groups->GetColumnString(0), groups->GetColumnString(1));
+
+    LogInfo("Privilege index loaded: " << m_index->appCount() << " applications, about "
+        << m_index->memoryUsage() / 1024 << " KiB");
+}
+
+void PrivilegeDb::RefreshIndex()
+{
+    // Transaction of another thread in progress, nobody else can commit
+    // until it ends and index reflects the last commit.
+    std::unique_lock<std::recursive_mutex> writer(m_writerMutex, std::try_to_lock);
+    if (!writer.owns_lock())
+        return;
+
+    if (getDataVersion(getQuery(QueryType::EGetDataVersion)) != m_dataVersion) {
+        LogDebug("Database modified by other connection, reloading index");
+        LoadIndex();
+    }
+}
+
+bool PrivilegeDb::ReadIndex(const std::function<void(const PrivilegeDbIndex &)> &read)
+{
+    // Transaction must see its own, not yet committed changes
+    if (!m_index || InTransaction())
+        return false;
+
+    std::lock_guard<std::mutex> lock(m_indexMutex);
+    RefreshIndex();
+    read(*m_index);
+    return true;
+}
+
+void PrivilegeDb::UpdateIndex(const std::function<void(PrivilegeDbIndex &)> &update)
+{
+    if (!m_index)
+        return;
+
+    if (InTransaction()) {
+        m_pendingIndexUpdates.push_back(update);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_indexMutex);
+    update(*m_index);
+}
+
+void PrivilegeDb::EnableIndex(void)
 {
     try_catch<void>([&] {
-        mSqlConnection->BeginTransaction();
+        std::lock_guard<std::recursive_mutex> writer(m_writerMutex);
+        std::lock_guard<std::mutex> lock(m_indexMutex);
+        m_index.reset(new PrivilegeDbIndex);
+        try {
+            LoadIndex();
+        } catch (...) {
+            m_index.reset();
+            throw;
+        }
+    });
+}
+
+unsigned PrivilegeDb::GetIndexGeneration(void)
+{
+    return try_catch<unsigned>([&] {
+        if (!m_index)
+            return 0u;
+
+        std::lock_guard<std::mutex> lock(m_indexMutex);
+        RefreshIndex();
+        return m_indexLoads;
     });
 }
 
+void PrivilegeDb::BeginTransaction(void)
+{
+    m_writerMutex.lock();
+    if (m_inGroup && InTransaction()) {
+        try {
+            try_catch<void>([&] {
+                m_writer.sql->PrepareDataCommand("SAVEPOINT request;")->Step();
+            });
+        } catch (...) {
+            m_writerMutex.unlock();
+            throw;
+        }
+        m_inSavepoint = true;
+        m_savepointIndexUpdates = m_pendingIndexUpdates.size();
+        return;
+    }
+    m_transactionOwner = std::this_thread::get_id();
+    try {
+        try_catch<void>([&] {
+            m_writer.sql->BeginTransaction();
+        });
+    } catch (...) {
+        EndTransaction();
+        throw;
+    }
+}
+
 void PrivilegeDb::CommitTransaction(void)
 {
+    std::lock_guard<std::recursive_mutex> writer(m_writerMutex);
+    if (m_inSavepoint) {
+        try_catch<void>([&] {
+            m_writer.sql->PrepareDataCommand("RELEASE SAVEPOINT request;")->Step();
+        });
+        // Lock taken by BeginTransaction() is released together with the guard
+        m_inSavepoint = false;
+        m_writerMutex.unlock();
+        return;
+    }
     try_catch<void>([&] {
-        mSqlConnection->CommitTransaction();
+        m_writer.sql->CommitTransaction();
     });
+
+    if (m_index && !m_pendingIndexUpdates.empty()) {
+        std::lock_guard<std::mutex> lock(m_indexMutex);
+        for (const auto &update : m_pendingIndexUpdates)
+            update(*m_index);
+    }
+    m_pendingIndexUpdates.clear();
+    EndTransaction();
 }
 
 void PrivilegeDb::RollbackTransaction(void)
 {
-    try_catch<void>([&] {
-        mSqlConnection->RollbackTransaction();
-    });
+    std::lock_guard<std::recursive_mutex> writer(m_writerMutex);
+    if (m_inSavepoint) {
+        m_writerMutex.unlock();
+        m_inSavepoint = false;
+        m_pendingIndexUpdates.resize(m_savepointIndexUpdates);
+        m_privilegeIds.clear();
+        try_catch<void>([&] {
+            m_writer.sql->PrepareDataCommand("ROLLBACK TO SAVEPOINT request;")->Step();
+            m_writer.sql->PrepareDataCommand("RELEASE SAVEPOINT request;")->Step();
+        });
+        return;
+    }
+    // Changes of the transaction never reach the index
+    m_pendingIndexUpdates.clear();
+    // Privileges added by the transaction disappear with it
+    m_privilegeIds.clear();
+    try {
+        try_catch<void>([&] {
+            m_writer.sql->RollbackTransaction();
+        });
+    } catch (...) {
+        EndTransaction();
+        throw;
+    }
+    EndTransaction();
+}
+
+void PrivilegeDb::BeginTransactionGroup(void)
+{
+    BeginTransaction();
+    m_inGroup = true;
+}
+
+void PrivilegeDb::CommitTransactionGroup(void)
+{
+    std::lock_guard<std::recursive_mutex> writer(m_writerMutex);
+    m_inGroup = false;
+    CommitTransaction();
+}
+
+void PrivilegeDb::RollbackTransactionGroup(void)
+{
+    std::lock_guard<std::recursive_mutex> writer(m_writerMutex);
+    m_inGroup = false;
+    RollbackTransaction();
 }
 
 bool PrivilegeDb::PkgIdExists(const std::string &pkgId)
 {
     return try_catch<bool>([&] {
-        auto &command = getQuery(QueryType::EPkgIdExists);
+        bool exists = false;
+        if (ReadIndex([&](const PrivilegeDbIndex &index) {
+                exists = index.pkgIdExists(pkgId);
+            }))
+            return exists;
+
+        ReadConnection connection(*this);
+        auto &command = connection.getQuery(QueryType::EPkgIdExists);
         command->BindString(1, pkgId.c_str());
         return command->Step();
     });
@@ -128,7 +475,14 @@ bool PrivilegeDb::PkgIdExists(const std::string &pkgId)
 bool PrivilegeDb::GetAppPkgId(const std::string &appId, std::string &pkgId)
 {
     return try_catch<bool>([&] {
-        auto &command = getQuery(QueryType::EGetPkgId);
+        bool found = false;
+        if (ReadIndex([&](const PrivilegeDbIndex &index) {
+                found = index.getAppPkgId(appId, pkgId);
+            }))
+            return found;
+
+        ReadConnection connection(*this);
+        auto &command = connection.getQuery(QueryType::EGetPkgId);
         command->BindString(1, appId.c_str());
 
         if (!command->Step()) {
@@ -143,20 +497,81 @@ bool PrivilegeDb::GetAppPkgId(const std::string &appId, std::string &pkgId)
     });
 }
 
+bool PrivilegeDb::GetAppRowIds(const std::string &appId, uid_t uid,
+        int64_t &appRowId, int64_t &pkgRowId)
+{
+    auto &command = getQuery(QueryType::EGetAppRowIds);
+    command->BindString(1, appId.c_str());
+    command->BindInteger(2, static_cast<unsigned int>(uid));
+
+    if (!command->Step())
+        return false;
+
+    appRowId = command->GetColumnInt64(0);
+    pkgRowId = command->GetColumnInt64(1);
+    command->Reset();
+    return true;
+}
+
+int64_t PrivilegeDb::GetPrivilegeId(const std::string &privilege)
+{
+    auto it = m_privilegeIds.find(privilege);
+    if (it != m_privilegeIds.end())
+        return it->second;
+
+    auto &add = getQuery(QueryType::EAddPrivilege);
+    add->BindString(1, privilege.c_str());
+    add->Step();
+
+    auto &get = getQuery(QueryType::EGetPrivilegeId);
+    get->BindString(1, privilege.c_str());
+    if (!get->Step())
+        ThrowMsg(DB::SqlConnection::Exception::InternalError,
+            "Privilege " << privilege << " missing right after insertion");
+
+    int64_t privilegeId = get->GetColumnInt64(0);
+    get->Reset();
+    m_privilegeIds[privilege] = privilegeId;
+    return privilegeId;
+}
+
+DB::SqlConnection::DataCommandAutoPtr & PrivilegeDb::getAddAppPrivilegesQuery(size_t rows)
+{
+    auto &command = m_writer.addAppPrivileges[rows];
+    if (!command) {
+        std::string query = "INSERT OR IGNORE INTO app_privilege (app_id, privilege_id) VALUES ";
+        for (size_t i = 0; i < rows; ++i)
+            query += (i ? ", (?1, ?" : "(?1, ?") + std::to_string(i + 2) + ")";
+        command = m_writer.sql->PrepareDataCommand("%s", query.c_str());
+    } else {
+        command->Reset();
+    }
+    return command;
+}
+
 void PrivilegeDb::AddApplication(const std::string &appId,
         const std::string &pkgId, uid_t uid)
 {
     try_catch<void>([&] {
+        std::lock_guard<std::recursive_mutex> writer(m_writerMutex);
+        auto &addPkg = getQuery(QueryType::EAddPkg);
+        addPkg->BindString(1, pkgId.c_str());
+        addPkg->Step();
+
         auto &command = getQuery(QueryType::EAddApplication);
         command->BindString(1, appId.c_str());
-        command->BindString(2, pkgId.c_str());
-        command->BindInteger(3, static_cast<unsigned int>(uid));
+        command->BindInteger(2, static_cast<unsigned int>(uid));
+        command->BindString(3, pkgId.c_str());
 
         if (command->Step()) {
             LogDebug("Unexpected SQLITE_ROW answer to query: " <<
                     Queries.at(QueryType::EAddApplication));
         };
 
+        UpdateIndex([=](PrivilegeDbIndex &index) {
+            index.addApplication(appId, pkgId, uid);
+        });
+
         LogDebug("Added appId: " << appId << ", pkgId: " << pkgId);
     });
 }
@@ -165,24 +580,37 @@ void PrivilegeDb::RemoveApplication(const std::string &appId, uid_t uid,
         bool &pkgIdIsNoMore)
 {
     try_catch<void>([&] {
-        std::string pkgId;
-        if (!GetAppPkgId(appId, pkgId)) {
+        std::lock_guard<std::recursive_mutex> writer(m_writerMutex);
+        int64_t appRowId, pkgRowId;
+        if (!GetAppRowIds(appId, uid, appRowId, pkgRowId)) {
             pkgIdIsNoMore = false;
             return;
         }
 
         auto &command = getQuery(QueryType::ERemoveApplication);
-        command->BindString(1, appId.c_str());
-        command->BindInteger(2, static_cast<unsigned int>(uid));
+        command->BindInt64(1, appRowId);
 
         if (command->Step()) {
             LogDebug("Unexpected SQLITE_ROW answer to query: " <<
                     Queries.at(QueryType::ERemoveApplication));
         };
 
+        UpdateIndex([=](PrivilegeDbIndex &index) {
+            index.removeApplication(appId, uid);
+        });
+
         LogDebug("Removed appId: " << appId);
 
-        pkgIdIsNoMore = !(this->PkgIdExists(pkgId));
+        auto &hasApps = getQuery(QueryType::EPkgHasApps);
+        hasApps->BindInt64(1, pkgRowId);
+        pkgIdIsNoMore = !hasApps->Step();
+        hasApps->Reset();
+
+        if (pkgIdIsNoMore) {
+            auto &removePkg = getQuery(QueryType::ERemovePkg);
+            removePkg->BindInt64(1, pkgRowId);
+            removePkg->Step();
+        }
     });
 }
 
@@ -190,7 +618,13 @@ void PrivilegeDb::GetPkgPrivileges(const std::string &pkgId, uid_t uid,
         std::vector<std::string> &currentPrivileges)
 {
     try_catch<void>([&] {
-        auto &command = getQuery(QueryType::EGetPkgPrivileges);
+        if (ReadIndex([&](const PrivilegeDbIndex &index) {
+                index.getPkgPrivileges(pkgId, uid, currentPrivileges);
+            }))
+            return;
+
+        ReadConnection connection(*this);
+        auto &command = connection.getQuery(QueryType::EGetPkgPrivileges);
         command->BindString(1, pkgId.c_str());
         command->BindInteger(2, static_cast<unsigned int>(uid));
 
@@ -206,10 +640,13 @@ void PrivilegeDb::GetAppPrivileges(const std::string &appId, uid_t uid,
         std::vector<std::string> &currentPrivileges)
 {
     try_catch<void>([&] {
-        DB::SqlConnection::DataCommandAutoPtr &command =
-                m_commands.at(static_cast<size_t>(QueryType::EGetAppPrivileges));
+        if (ReadIndex([&](const PrivilegeDbIndex &index) {
+                index.getAppPrivileges(appId, uid, currentPrivileges);
+            }))
+            return;
 
-        command->Reset();
+        ReadConnection connection(*this);
+        auto &command = connection.getQuery(QueryType::EGetAppPrivileges);
         command->BindString(1, appId.c_str());
         command->BindInteger(2, static_cast<unsigned int>(uid));
         currentPrivileges.clear();
@@ -225,14 +662,22 @@ void PrivilegeDb::GetAppPrivileges(const std::string &appId, uid_t uid,
 void PrivilegeDb::RemoveAppPrivileges(const std::string &appId, uid_t uid)
 {
     try_catch<void>([&] {
+        std::lock_guard<std::recursive_mutex> writer(m_writerMutex);
+        int64_t appRowId, pkgRowId;
+        if (!GetAppRowIds(appId, uid, appRowId, pkgRowId))
+            return;
+
         auto &command = getQuery(QueryType::ERemoveAppPrivileges);
-        command->BindString(1, appId.c_str());
-        command->BindInteger(2, static_cast<unsigned int>(uid));
+        command->BindInt64(1, appRowId);
         if (command->Step()) {
             LogDebug("Unexpected SQLITE_ROW answer to query: " <<
                     Queries.at(QueryType::ERemoveAppPrivileges));
         }
 
+        UpdateIndex([=](PrivilegeDbIndex &index) {
+            index.setAppPrivileges(appId, uid, std::vector<std::string>());
+        });
+
         LogDebug("Removed all privileges for appId: " << appId);
     });
 }
@@ -241,18 +686,36 @@ void PrivilegeDb::UpdateAppPrivileges(const std::string &appId, uid_t uid,
         const std::vector<std::string> &privileges)
 {
     try_catch<void>([&] {
-        auto &command = getQuery(QueryType::EAddAppPrivileges);
-        command->BindString(1, appId.c_str());
-        command->BindInteger(2, static_cast<unsigned int>(uid));
-
-        RemoveAppPrivileges(appId, uid);
+        std::lock_guard<std::recursive_mutex> writer(m_writerMutex);
+        int64_t appRowId, pkgRowId;
+        if (!GetAppRowIds(appId, uid, appRowId, pkgRowId)) {
+            LogWarning("Application " << appId << " not installed for user " << uid);
+            return;
+        }
 
-        for (const auto &privilege : privileges) {
-            command->BindString(3, privilege.c_str());
+        auto &remove = getQuery(QueryType::ERemoveAppPrivileges);
+        remove->BindInt64(1, appRowId);
+        remove->Step();
+
+        std::vector<int64_t> privilegeIds;
+        privilegeIds.reserve(privileges.size());
+        for (const auto &privilege : privileges)
+            privilegeIds.push_back(GetPrivilegeId(privilege));
+
+        for (size_t first = 0; first < privilegeIds.size(); first += PRIVILEGES_PER_STATEMENT) {
+            size_t rows = std::min(PRIVILEGES_PER_STATEMENT, privilegeIds.size() - first);
+            auto &command = getAddAppPrivilegesQuery(rows);
+            command->BindInt64(1, appRowId);
+            for (size_t i = 0; i < rows; ++i)
+                command->BindInt64(i + 2, privilegeIds[first + i]);
             command->Step();
-            command->Reset();
-            LogDebug("Added privilege: " << privilege << " to appId: " << appId);
         }
+
+        LogDebug("Set " << privileges.size() << " privileges for appId: " << appId);
+
+        UpdateIndex([=](PrivilegeDbIndex &index) {
+            index.setAppPrivileges(appId, uid, privileges);
+        });
     });
 }
 
@@ -260,7 +723,13 @@ void PrivilegeDb::GetPrivilegeGroups(const std::string &privilege,
         std::vector<std::string> &groups)
 {
    try_catch<void>([&] {
-        auto &command = getQuery(QueryType::EGetPrivilegeGroups);
+        if (ReadIndex([&](const PrivilegeDbIndex &index) {
+                index.getPrivilegeGroups(privilege, groups);
+            }))
+            return;
+
+        ReadConnection connection(*this);
+        auto &command = connection.getQuery(QueryType::EGetPrivilegeGroups);
         command->BindString(1, privilege.c_str());
 
         while (command->Step()) {
@@ -271,10 +740,27 @@ void PrivilegeDb::GetPrivilegeGroups(const std::string &privilege,
     });
 }
 
+void PrivilegeDb::GetGroups(std::vector<std::string> &groups)
+{
+   try_catch<void>([&] {
+        ReadConnection connection(*this);
+        auto &command = connection.getQuery(QueryType::EGetGroups);
+
+        while (command->Step())
+            groups.push_back(command->GetColumnString(0));
+    });
+}
+
 void PrivilegeDb::GetUserApps(uid_t uid, std::vector<std::string> &apps)
 {
    try_catch<void>([&] {
-        auto &command = getQuery(QueryType::EGetUserApps);
+        if (ReadIndex([&](const PrivilegeDbIndex &index) {
+                index.getUserApps(uid, apps);
+            }))
+            return;
+
+        ReadConnection connection(*this);
+        auto &command = connection.getQuery(QueryType::EGetUserApps);
         command->BindInteger(1, static_cast<unsigned int>(uid));
         apps.clear();
         while (command->Step()) {
@@ -289,10 +775,13 @@ void PrivilegeDb::GetAppIdsForPkgId(const std::string &pkgId,
         std::vector<std::string> &appIds)
 {
     try_catch<void>([&] {
-        DB::SqlConnection::DataCommandAutoPtr &command =
-                m_commands.at(static_cast<size_t>(QueryType::EGetAppsInPkg));
+        if (ReadIndex([&](const PrivilegeDbIndex &index) {
+                index.getAppIdsForPkgId(pkgId, appIds);
+            }))
+            return;
 
-        command->Reset();
+        ReadConnection connection(*this);
+        auto &command = connection.getQuery(QueryType::EGetAppsInPkg);
         command->BindString(1, pkgId.c_str());
         appIds.clear();
 
@@ -304,4 +793,80 @@ void PrivilegeDb::GetAppIdsForPkgId(const std::string &pkgId,
     });
 }
 
+static void getSmackRules(DB::SqlConnection::DataCommandAutoPtr &command,
+        std::vector<SmackRule> &rules)
+{
+    rules.clear();
+    while (command->Step()) {
+        SmackRule rule;
+        rule.subject = command->GetColumnString(0);
+        rule.object = command->GetColumnString(1);
+        rule.access = command->GetColumnString(2);
+        rules.push_back(std::move(rule));
+    }
+}
+
+void PrivilegeDb::GetSmackRules(const std::string &owner, std::vector<SmackRule> &rules)
+{
+    try_catch<void>([&] {
+        ReadConnection connection(*this);
+        auto &command = connection.getQuery(QueryType::EGetSmackRules);
+        command->BindString(1, owner.c_str());
+        getSmackRules(command, rules);
+        LogDebug("Got " << rules.size() << " Smack rules of " << owner);
+    });
+}
+
+void PrivilegeDb::GetLabelSmackRules(const std::string &owner, const std::string &label,
+        std::vector<SmackRule> &rules)
+{
+    try_catch<void>([&] {
+        ReadConnection connection(*this);
+        auto &command = connection.getQuery(QueryType::EGetLabelSmackRules);
+        command->BindString(1, owner.c_str());
+        command->BindString(2, label.c_str());
+        getSmackRules(command, rules);
+        LogDebug("Got " << rules.size() << " Smack rules of " << owner << " with label " << label);
+    });
+}
+
+void PrivilegeDb::AddSmackRules(const std::string &owner, const std::vector<SmackRule> &rules)
+{
+    try_catch<void>([&] {
+        std::lock_guard<std::recursive_mutex> writer(m_writerMutex);
+        for (const auto &rule : rules) {
+            auto &command = getQuery(QueryType::EAddSmackRule);
+            command->BindString(1, owner.c_str());
+            command->BindString(2, rule.subject.c_str());
+            command->BindString(3, rule.object.c_str());
+            command->BindString(4, rule.access.c_str());
+            command->Step();
+        }
+        LogDebug("Added " << rules.size() << " Smack rules of " << owner);
+    });
+}
+
+void PrivilegeDb::RemoveSmackRules(const std::string &owner)
+{
+    try_catch<void>([&] {
+        std::lock_guard<std::recursive_mutex> writer(m_writerMutex);
+        auto &command = getQuery(QueryType::ERemoveSmackRules);
+        command->BindString(1, owner.c_str());
+        command->Step();
+        LogDebug("Removed Smack rules of " << owner);
+    });
+}
+
+void PrivilegeDb::RemoveLabelSmackRules(const std::string &owner, const std::string &label)
+{
+    try_catch<void>([&] {
+        std::lock_guard<std::recursive_mutex> writer(m_writerMutex);
+        auto &command = getQuery(QueryType::ERemoveLabelSmackRules);
+        command->BindString(1, owner.c_str());
+        command->BindString(2, label.c_str());
+        command->Step();
+        LogDebug("Removed Smack rules of " << owner << " with label " << label);
+    });
+}
+
 } //namespace SecurityManager
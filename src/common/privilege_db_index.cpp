@@ -0,0 +1,333 @@
+/*
+ * security-manager, database access
+ *
+ * Copyright (c) 2000 - 2014 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ * Contact: Rafal Krypa <r.krypa@samsung.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * @file        privilege_db_index.cpp
+ * @version     1.0
+ * @brief       In-memory copy of the privileges database used to serve read queries.
+ */
+
+#include <algorithm>
+
+#include "privilege_db_index.h"
+
+namespace SecurityManager {
+
+namespace {
+
+bool strLess(const std::string *a, const std::string *b)
+{
+    return *a < *b;
+}
+
+/* Rough per-node overhead of node based containers (pointers and padding) */
+const size_t NODE_OVERHEAD = 4 * sizeof(void *);
+
+size_t stringMemory(const std::string &str)
+{
+    // libstdc++ keeps short strings inline
+    return str.capacity() > 15 ? str.capacity() + 1 : 0;
+}
+
+template <typename Map>
+size_t bucketMemory(const Map &map)
+{
+    return map.bucket_count() * sizeof(void *);
+}
+
+} // namespace anonymous
+
+void PrivilegeDbIndex::clear()
+{
+    m_apps.clear();
+    m_pkgApps.clear();
+    m_userApps.clear();
+    m_privilegeGroups.clear();
+    m_strings.clear();
+    m_appCount = 0;
+}
+
+PrivilegeDbIndex::Str PrivilegeDbIndex::intern(const std::string &str)
+{
+    auto it = m_strings.insert({str, 0}).first;
+    ++it->second;
+    return &it->first;
+}
+
+void PrivilegeDbIndex::release(Str str)
+{
+    auto it = m_strings.find(*str);
+    if (it != m_strings.end() && !--it->second)
+        m_strings.erase(it);
+}
+
+void PrivilegeDbIndex::releaseApp(const AppEntry &entry)
+{
+    release(entry.pkgId);
+    for (Str privilege : entry.privileges)
+        release(privilege);
+}
+
+PrivilegeDbIndex::AppEntry *PrivilegeDbIndex::findApp(const std::string &appId, uid_t uid)
+{
+    auto it = m_apps.find(appId);
+    if (it == m_apps.end())
+        return nullptr;
+    auto entry = it->second.find(uid);
+    return entry == it->second.end() ? nullptr : &entry->second;
+}
+
+const PrivilegeDbIndex::AppEntry *PrivilegeDbIndex::findApp(const std::string &appId, uid_t uid) const
+{
+    return const_cast<PrivilegeDbIndex *>(this)->findApp(appId, uid);
+}
+
+void PrivilegeDbIndex::addApplication(const std::string &appId,
+    const std::string &pkgId, uid_t uid)
+{
+    auto appIt = m_apps.insert({appId, UserAppEntries()}).first;
+    auto &entries = appIt->second;
+    if (entries.count(uid))
+        return;
+
+    Str pkg = intern(pkgId);
+    entries[uid].pkgId = pkg;
+    m_pkgApps[pkg].push_back({&appIt->first, uid});
+    m_userApps[uid].push_back(&appIt->first);
+    ++m_appCount;
+}
+
+void PrivilegeDbIndex::removeApplication(const std::string &appId, uid_t uid)
+{
+    auto appIt = m_apps.find(appId);
+    if (appIt == m_apps.end())
+        return;
+    auto entryIt = appIt->second.find(uid);
+    if (entryIt == appIt->second.end())
+        return;
+
+    Str app = &appIt->first;
+    auto pkgIt = m_pkgApps.find(entryIt->second.pkgId);
+    if (pkgIt != m_pkgApps.end()) {
+        auto &apps = pkgIt->second;
+        apps.erase(std::remove(apps.begin(), apps.end(), AppRef(app, uid)), apps.end());
+        if (apps.empty())
+            m_pkgApps.erase(pkgIt);
+    }
+
+    auto userIt = m_userApps.find(uid);
+    if (userIt != m_userApps.end()) {
+        auto &apps = userIt->second;
+        apps.erase(std::remove(apps.begin(), apps.end(), app), apps.end());
+        if (apps.empty())
+            m_userApps.erase(userIt);
+    }
+
+    releaseApp(entryIt->second);
+    appIt->second.erase(entryIt);
+    if (appIt->second.empty())
+        m_apps.erase(appIt);
+    --m_appCount;
+}
+
+void PrivilegeDbIndex::addAppPrivilege(const std::string &appId, uid_t uid,
+    const std::string &privilege)
+{
+    AppEntry *entry = findApp(appId, uid);
+    if (!entry)
+        return;
+
+    auto &privileges = entry->privileges;
+    auto it = std::lower_bound(privileges.begin(), privileges.end(), privilege,
+        [](Str a, const std::string &b) { return *a < b; });
+    if (it == privileges.end() || **it != privilege)
+        privileges.insert(it, intern(privilege));
+}
+
+void PrivilegeDbIndex::setAppPrivileges(const std::string &appId, uid_t uid,
+    const std::vector<std::string> &privileges)
+{
+    AppEntry *entry = findApp(appId, uid);
+    if (!entry)
+        return;
+
+    // New privileges are interned before old ones are released, so that
+    // privileges kept by the application are not freed in between
+    std::vector<Str> interned;
+    interned.reserve(privileges.size());
+    for (const auto &privilege : privileges)
+        interned.push_back(intern(privilege));
+    std::sort(interned.begin(), interned.end(), strLess);
+
+    std::vector<Str> old;
+    old.swap(entry->privileges);
+    entry->privileges.reserve(interned.size());
+    for (Str privilege : interned) {
+        if (!entry->privileges.empty() && entry->privileges.back() == privilege)
+            release(privilege);
+        else
+            entry->privileges.push_back(privilege);
+    }
+    entry->privileges.shrink_to_fit();
+
+    for (Str privilege : old)
+        release(privilege);
+}
+
+void PrivilegeDbIndex::addPrivilegeGroup(const std::string &privilege,
+    const std::string &groupName)
+{
+    auto &groups = m_privilegeGroups[intern(privilege)];
+    Str group = intern(groupName);
+    if (std::find(groups.begin(), groups.end(), group) == groups.end())
+        groups.push_back(group);
+}
+
+bool PrivilegeDbIndex::getAppPkgId(const std::string &appId, std::string &pkgId) const
+{
+    auto it = m_apps.find(appId);
+    if (it == m_apps.end() || it->second.empty())
+        return false;
+
+    pkgId = *it->second.begin()->second.pkgId;
+    return true;
+}
+
+bool PrivilegeDbIndex::pkgIdExists(const std::string &pkgId) const
+{
+    auto str = m_strings.find(pkgId);
+    return str != m_strings.end() && m_pkgApps.count(&str->first);
+}
+
+void PrivilegeDbIndex::getPkgPrivileges(const std::string &pkgId, uid_t uid,
+    std::vector<std::string> &privileges) const
+{
+    auto str = m_strings.find(pkgId);
+    if (str == m_strings.end())
+        return;
+    auto pkgIt = m_pkgApps.find(&str->first);
+    if (pkgIt == m_pkgApps.end())
+        return;
+
+    std::vector<Str> merged;
+    for (const auto &app : pkgIt->second) {
+        if (app.second != uid)
+            continue;
+        const AppEntry *entry = findApp(*app.first, uid);
+        if (entry)
+            merged.insert(merged.end(), entry->privileges.begin(), entry->privileges.end());
+    }
+
+    std::sort(merged.begin(), merged.end(), strLess);
+    merged.erase(std::unique(merged.begin(), merged.end()), merged.end());
+    for (Str privilege : merged)
+        privileges.push_back(*privilege);
+}
+
+void PrivilegeDbIndex::getAppPrivileges(const std::string &appId, uid_t uid,
+    std::vector<std::string> &privileges) const
+{
+    privileges.clear();
+    const AppEntry *entry = findApp(appId, uid);
+    if (!entry)
+        return;
+
+    for (Str privilege : entry->privileges)
+        privileges.push_back(*privilege);
+}
+
+void PrivilegeDbIndex::getPrivilegeGroups(const std::string &privilege,
+    std::vector<std::string> &groups) const
+{
+    auto str = m_strings.find(privilege);
+    if (str == m_strings.end())
+        return;
+    auto it = m_privilegeGroups.find(&str->first);
+    if (it == m_privilegeGroups.end())
+        return;
+
+    for (Str group : it->second)
+        groups.push_back(*group);
+}
+
+void PrivilegeDbIndex::getUserApps(uid_t uid, std::vector<std::string> &apps) const
+{
+    apps.clear();
+    auto it = m_userApps.find(uid);
+    if (it == m_userApps.end())
+        return;
+
+    for (Str app : it->second)
+        apps.push_back(*app);
+}
+
+void PrivilegeDbIndex::getAppIdsForPkgId(const std::string &pkgId,
+    std::vector<std::string> &appIds) const
+{
+    appIds.clear();
+    auto str = m_strings.find(pkgId);
+    if (str == m_strings.end())
+        return;
+    auto it = m_pkgApps.find(&str->first);
+    if (it == m_pkgApps.end())
+        return;
+
+    for (const auto &app : it->second)
+        appIds.push_back(*app.first);
+}
+
+size_t PrivilegeDbIndex::appCount() const
+{
+    return m_appCount;
+}
+
+size_t PrivilegeDbIndex::memoryUsage() const
+{
+    size_t size = 0;
+
+    size += bucketMemory(m_strings);
+    for (const auto &str : m_strings)
+        size += NODE_OVERHEAD + sizeof(str) + stringMemory(str.first);
+
+    size += bucketMemory(m_apps);
+    for (const auto &app : m_apps) {
+        size += NODE_OVERHEAD + sizeof(app) + stringMemory(app.first);
+        for (const auto &entry : app.second)
+            size += NODE_OVERHEAD + sizeof(entry) +
+                entry.second.privileges.capacity() * sizeof(Str);
+    }
+
+    size += bucketMemory(m_pkgApps);
+    for (const auto &pkg : m_pkgApps)
+        size += NODE_OVERHEAD + sizeof(pkg) + pkg.second.capacity() * sizeof(AppRef);
+
+    size += bucketMemory(m_userApps);
+    for (const auto &user : m_userApps)
+        size += NODE_OVERHEAD + sizeof(user) + user.second.capacity() * sizeof(Str);
+
+    size += bucketMemory(m_privilegeGroups);
+    for (const auto &privilege : m_privilegeGroups)
+        size += NODE_OVERHEAD + sizeof(privilege) + privilege.second.capacity() * sizeof(Str);
+
+    return size;
+}
+
+} //namespace SecurityManager
@@ -24,18 +24,22 @@
  * @brief       Implementation of the service methods
  */
 
-#include <grp.h>
 #include <limits.h>
 #include <pwd.h>
 
 #include <cstring>
 #include <algorithm>
+#include <functional>
+#include <map>
+#include <memory>
 
 #include <dpl/log/log.h>
 #include <tzplatform_config.h>
 
 #include "protocols.h"
 #include "privilege_db.h"
+#include "group_cache.h"
+#include "launch_profile_cache.h"
 #include "cynara.h"
 #include "smack-rules.h"
 #include "smack-labels.h"
@@ -240,7 +244,46 @@ static inline bool installRequestAuthCheck(const app_inst_req &req, uid_t uid, b
     return true;
 }
 
-int appInstall(const app_inst_req &req, uid_t uid)
+/* Labels and Smack rules of an installed application, set once its database
+ * changes are committed */
+static int installSmack(const app_inst_req &req, bool isCorrectPath, const std::string &appPath,
+    const std::vector<std::string> &pkgContents, bool newInPackage)
+{
+    try {
+        if (isCorrectPath)
+            SmackLabels::setupCorrectPath(req.pkgId, req.appId, appPath);
+
+        // register paths, files of a reinstalled application mostly have their labels already
+        SmackLabels::LabelingStatistics labeled = {0, 0};
+        for (const auto &appPath : req.appPaths) {
+            const std::string &path = appPath.first;
+            app_install_path_type pathType = static_cast<app_install_path_type>(appPath.second);
+            SmackLabels::LabelingStatistics statistics =
+                SmackLabels::setupPath(req.appId, path, pathType, !newInPackage);
+            labeled.changed += statistics.changed;
+            labeled.skipped += statistics.skipped;
+        }
+        LogDebug("Labels of appId " << req.appId << ": " << labeled.changed <<
+            " attributes changed, " << labeled.skipped << " unchanged");
+
+        LogDebug("Adding Smack rules for new appId: " << req.appId << " with pkgId: "
+                << req.pkgId << ". Applications in package: " << pkgContents.size());
+        SmackRules::installApplicationRules(req.appId, req.pkgId, pkgContents, newInPackage);
+    } catch (const SmackException::Base &e) {
+        LogError("Error while applying Smack policy for application: " << e.DumpToString());
+        return SECURITY_MANAGER_API_ERROR_SETTING_FILE_LABEL_FAILED;
+    } catch (const PrivilegeDb::Exception::Base &e) {
+        LogError("Error while recording Smack rules of application: " << e.DumpToString());
+        return SECURITY_MANAGER_API_ERROR_SERVER_ERROR;
+    } catch (const std::bad_alloc &e) {
+        LogError("Memory allocation error: " << e.what());
+        return SECURITY_MANAGER_API_ERROR_OUT_OF_MEMORY;
+    }
+
+    return SECURITY_MANAGER_API_SUCCESS;
+}
+
+int appInstall(const app_inst_req &req, uid_t uid, std::function<int()> *afterCommit)
 {
     std::vector<std::string> addedPermissions;
     std::vector<std::string> removedPermissions;
@@ -250,6 +293,7 @@ int appInstall(const app_inst_req &req, uid_t uid)
     std::string appPath;
     std::string appLabel;
     std::string pkgLabel;
+    bool newInPackage = false;
 
     if (uid) {
         if (uid != req.uid) {
@@ -294,6 +338,7 @@ int appInstall(const app_inst_req &req, uid_t uid)
             PrivilegeDb::getInstance().RollbackTransaction();
             return SECURITY_MANAGER_API_ERROR_INPUT_PARAM;
         }
+        newInPackage = !ret;
         PrivilegeDb::getInstance().GetAppPrivileges(req.appId, uid, oldAppPrivileges);
         PrivilegeDb::getInstance().AddApplication(req.appId, req.pkgId, uid);
         PrivilegeDb::getInstance().UpdateAppPrivileges(req.appId, uid, req.privileges);
@@ -302,6 +347,7 @@ int appInstall(const app_inst_req &req, uid_t uid)
         CynaraAdmin::getInstance().UpdateAppPolicy(appLabel, uidstr, oldAppPrivileges,
                                          req.privileges);
         PrivilegeDb::getInstance().CommitTransaction();
+        LaunchProfileCache::getInstance().invalidatePkg(req.pkgId);
         LogDebug("Application installation commited to database");
     } catch (const PrivilegeDb::Exception::IOError &e) {
         LogError("Cannot access application database: " << e.DumpToString());
@@ -324,23 +370,39 @@ int appInstall(const app_inst_req &req, uid_t uid)
         return SECURITY_MANAGER_API_ERROR_OUT_OF_MEMORY;
     }
 
-    try {
-        if (isCorrectPath)
-            SmackLabels::setupCorrectPath(req.pkgId, req.appId, appPath);
+    if (afterCommit) {
+        *afterCommit = [=] {
+            return installSmack(req, isCorrectPath, appPath, pkgContents, newInPackage);
+        };
+        return SECURITY_MANAGER_API_SUCCESS;
+    }
 
-        // register paths
-        for (const auto &appPath : req.appPaths) {
-            const std::string &path = appPath.first;
-            app_install_path_type pathType = static_cast<app_install_path_type>(appPath.second);
-            SmackLabels::setupPath(req.appId, path, pathType);
-        }
+    return installSmack(req, isCorrectPath, appPath, pkgContents, newInPackage);
+}
 
-        LogDebug("Adding Smack rules for new appId: " << req.appId << " with pkgId: "
-                << req.pkgId << ". Applications in package: " << pkgContents.size());
-        SmackRules::installApplicationRules(req.appId, req.pkgId, pkgContents);
+/* Smack rules of an uninstalled application, removed once its database
+ * changes are committed */
+static int uninstallSmack(const std::string &appId, const std::string &pkgId,
+    const std::vector<std::string> &pkgContents, bool removePkg, bool removedFromPkg)
+{
+    try {
+        SmackRules::ScopedBatch batch;
+        LogDebug("Removing smack rules for deleted appId " << appId);
+        if (removePkg) {
+            LogDebug("Removing Smack rules for deleted pkgId " << pkgId);
+            SmackRules::uninstallPackageRules(pkgId);
+            SmackRules::uninstallApplicationRules(appId);
+        } else if (removedFromPkg)
+            SmackRules::uninstallApplicationRules(appId, pkgId, pkgContents);
+        else
+            SmackRules::uninstallApplicationRules(appId);
+        batch.flush();
     } catch (const SmackException::Base &e) {
-        LogError("Error while applying Smack policy for application: " << e.DumpToString());
+        LogError("Error while removing Smack rules for application: " << e.DumpToString());
         return SECURITY_MANAGER_API_ERROR_SETTING_FILE_LABEL_FAILED;
+    } catch (const PrivilegeDb::Exception::Base &e) {
+        LogError("Error while removing recorded Smack rules of application: " << e.DumpToString());
+        return SECURITY_MANAGER_API_ERROR_SERVER_ERROR;
     } catch (const std::bad_alloc &e) {
         LogError("Memory allocation error: " << e.what());
         return SECURITY_MANAGER_API_ERROR_OUT_OF_MEMORY;
@@ -349,13 +411,14 @@ int appInstall(const app_inst_req &req, uid_t uid)
     return SECURITY_MANAGER_API_SUCCESS;
 }
 
-int appUninstall(const std::string &appId, uid_t uid)
+int appUninstall(const std::string &appId, uid_t uid, std::function<int()> *afterCommit)
 {
     std::string pkgId;
     std::string smackLabel;
     std::vector<std::string> pkgContents;
     bool appExists = true;
     bool removePkg = false;
+    bool removedFromPkg = false;
     std::string uidstr;
     checkGlobalUser(uid, uidstr);
 
@@ -373,16 +436,20 @@ int appUninstall(const std::string &appId, uid_t uid)
             LogDebug("Uninstall parameters: appId: " << appId << ", pkgId: " << pkgId
                      << ", uidstr " << uidstr << ", generated smack label: " << smackLabel);
 
-            /* Before we remove the app from the database, let's fetch all apps in the package
-                that this app belongs to, this will allow us to remove all rules withing the
-                package that the app appears in */
-            PrivilegeDb::getInstance().GetAppIdsForPkgId(pkgId, pkgContents);
             PrivilegeDb::getInstance().GetAppPrivileges(appId, uid, oldAppPrivileges);
             PrivilegeDb::getInstance().UpdateAppPrivileges(appId, uid, std::vector<std::string>());
             PrivilegeDb::getInstance().RemoveApplication(appId, uid, removePkg);
+            /* Apps left in the package, rules between them and the removed app go away
+               unless the app is still installed for another user */
+            if (!removePkg) {
+                PrivilegeDb::getInstance().GetAppIdsForPkgId(pkgId, pkgContents);
+                removedFromPkg = std::find(pkgContents.begin(), pkgContents.end(), appId) ==
+                    pkgContents.end();
+            }
             CynaraAdmin::getInstance().UpdateAppPolicy(smackLabel, uidstr, oldAppPrivileges,
                                              std::vector<std::string>());
             PrivilegeDb::getInstance().CommitTransaction();
+            LaunchProfileCache::getInstance().invalidatePkg(pkgId);
             LogDebug("Application uninstallation commited to database");
         }
     } catch (const PrivilegeDb::Exception::IOError &e) {
@@ -406,25 +473,17 @@ int appUninstall(const std::string &appId, uid_t uid)
         return SECURITY_MANAGER_API_ERROR_OUT_OF_MEMORY;
     }
 
-    try {
-        if (appExists) {
-            if (removePkg) {
-                LogDebug("Removing Smack rules for deleted pkgId " << pkgId);
-                SmackRules::uninstallPackageRules(pkgId);
-            }
+    if (!appExists)
+        return SECURITY_MANAGER_API_SUCCESS;
 
-            LogDebug("Removing smack rules for deleted appId " << appId);
-            SmackRules::uninstallApplicationRules(appId, pkgId, pkgContents);
-        }
-    } catch (const SmackException::Base &e) {
-        LogError("Error while removing Smack rules for application: " << e.DumpToString());
-        return SECURITY_MANAGER_API_ERROR_SETTING_FILE_LABEL_FAILED;
-    } catch (const std::bad_alloc &e) {
-        LogError("Memory allocation error: " << e.what());
-        return SECURITY_MANAGER_API_ERROR_OUT_OF_MEMORY;
+    if (afterCommit) {
+        *afterCommit = [=] {
+            return uninstallSmack(appId, pkgId, pkgContents, removePkg, removedFromPkg);
+        };
+        return SECURITY_MANAGER_API_SUCCESS;
     }
 
-    return SECURITY_MANAGER_API_SUCCESS;
+    return uninstallSmack(appId, pkgId, pkgContents, removePkg, removedFromPkg);
 }
 
 int getPkgId(const std::string &appId, std::string &pkgId)
@@ -446,54 +505,79 @@ int getPkgId(const std::string &appId, std::string &pkgId)
     return SECURITY_MANAGER_API_SUCCESS;
 }
 
+/**
+ * Gather data needed by getAppGroups from the database.
+ *
+ * @return false if application is not installed
+ */
+static bool computeLaunchProfile(const std::string &appId, uid_t uid, LaunchProfile &profile)
+{
+    if (!PrivilegeDb::getInstance().GetAppPkgId(appId, profile.pkgId))
+        return false;
+    LogDebug("pkgId: " << profile.pkgId);
+
+    profile.label = SmackLabels::generateAppLabel(appId);
+    LogDebug("smack label: " << profile.label);
+
+    std::vector<std::string> privileges;
+    PrivilegeDb::getInstance().GetPkgPrivileges(profile.pkgId, uid, privileges);
+    /*there is also a need of checking, if privilege is granted to all users*/
+    size_t tmp = privileges.size();
+    PrivilegeDb::getInstance().GetPkgPrivileges(profile.pkgId, getGlobalUserId(), privileges);
+    /*privileges needs to be sorted and with no duplications - for cynara sake*/
+    std::inplace_merge(privileges.begin(), privileges.begin() + tmp, privileges.end());
+    privileges.erase(unique(privileges.begin(), privileges.end()), privileges.end());
+
+    for (const auto &privilege : privileges) {
+        std::vector<std::string> groups;
+        PrivilegeDb::getInstance().GetPrivilegeGroups(privilege, groups);
+        if (!groups.empty())
+            profile.privilegeGroups.emplace_back(privilege, std::move(groups));
+    }
+
+    return true;
+}
+
 int getAppGroups(const std::string &appId, uid_t uid, pid_t pid, std::unordered_set<gid_t> &gids)
 {
     try {
-        std::string pkgId;
-        std::string smackLabel;
         std::string uidStr = std::to_string(uid);
         std::string pidStr = std::to_string(pid);
 
         LogDebug("appId: " << appId);
 
-        if (!PrivilegeDb::getInstance().GetAppPkgId(appId, pkgId)) {
-            LogWarning("Application " << appId << " not found in database");
-            return SECURITY_MANAGER_API_ERROR_NO_SUCH_OBJECT;
+        LaunchProfile profile;
+        if (!LaunchProfileCache::getInstance().get(appId, uid, profile)) {
+            if (!computeLaunchProfile(appId, uid, profile)) {
+                LogWarning("Application " << appId << " not found in database");
+                return SECURITY_MANAGER_API_ERROR_NO_SUCH_OBJECT;
+            }
+            LaunchProfileCache::getInstance().put(appId, uid, profile);
         }
-        LogDebug("pkgId: " << pkgId);
-
-        smackLabel = SmackLabels::generateAppLabel(appId);
-        LogDebug("smack label: " << smackLabel);
 
         std::vector<std::string> privileges;
-        PrivilegeDb::getInstance().GetPkgPrivileges(pkgId, uid, privileges);
-        /*there is also a need of checking, if privilege is granted to all users*/
-        size_t tmp = privileges.size();
-        PrivilegeDb::getInstance().GetPkgPrivileges(pkgId, getGlobalUserId(), privileges);
-        /*privileges needs to be sorted and with no duplications - for cynara sake*/
-        std::inplace_merge(privileges.begin(), privileges.begin() + tmp, privileges.end());
-        privileges.erase(unique(privileges.begin(), privileges.end()), privileges.end());
-
-        for (const auto &privilege : privileges) {
-            std::vector<std::string> gidsTmp;
-            PrivilegeDb::getInstance().GetPrivilegeGroups(privilege, gidsTmp);
-            if (!gidsTmp.empty()) {
-                LogDebug("Considering privilege " << privilege << " with " <<
-                    gidsTmp.size() << " groups assigned");
-                // TODO: create method in Cynara class for fetching all privileges of an application
-                if (Cynara::getInstance().check(smackLabel, privilege, uidStr, pidStr)) {
-                    for_each(gidsTmp.begin(), gidsTmp.end(), [&] (std::string group) {
-                        struct group *grp = getgrnam(group.c_str());
-                        if (grp == NULL) {
-                                LogError("No such group: " << group.c_str());
-                                return;
-                        }
-                        gids.insert(grp->gr_gid);
-                    });
-                    LogDebug("Cynara allowed, adding groups");
-                } else
-                    LogDebug("Cynara denied, not adding groups");
-            }
+        for (const auto &privilegeGroups : profile.privilegeGroups)
+            privileges.push_back(privilegeGroups.first);
+
+        std::vector<bool> allowed;
+        Cynara::getInstance().check(profile.label, privileges, uidStr, pidStr, allowed);
+
+        for (size_t i = 0; i < profile.privilegeGroups.size(); ++i) {
+            const auto &privilegeGroups = profile.privilegeGroups[i];
+            LogDebug("Considering privilege " << privilegeGroups.first << " with " <<
+                privilegeGroups.second.size() << " groups assigned");
+            if (allowed[i]) {
+                for (const auto &group : privilegeGroups.second) {
+                    gid_t gid;
+                    if (!GroupCache::getInstance().getGid(group, gid)) {
+                        LogError("No such group: " << group);
+                        continue;
+                    }
+                    gids.insert(gid);
+                }
+                LogDebug("Cynara allowed, adding groups");
+            } else
+                LogDebug("Cynara denied, not adding groups");
         }
     } catch (const PrivilegeDb::Exception::Base &e) {
         LogError("Database error: " << e.DumpToString());
@@ -531,24 +615,97 @@ int userDelete(uid_t uidDeleted, uid_t uid)
     if (uid != 0)
         return SECURITY_MANAGER_API_ERROR_AUTHENTICATION_FAILED;
 
-    /*Uninstall all user apps*/
+    /*Uninstall all user apps in one go*/
     std::vector<std::string> userApps;
+    // pkgId -> whether the package was removed together with its last application
+    std::map<std::string, bool> userPkgs;
     try {
+        PrivilegeDb::getInstance().BeginTransaction();
         PrivilegeDb::getInstance().GetUserApps(uidDeleted, userApps);
-    } catch (const PrivilegeDb::Exception::Base &e) {
-        LogError("Error while getting user apps from database: " << e.DumpToString());
+        LogDebug("Removing " << userApps.size() << " applications of user " << uidDeleted);
+
+        for (const auto &appId : userApps) {
+            std::string pkgId;
+            bool removePkg = false;
+
+            if (!PrivilegeDb::getInstance().GetAppPkgId(appId, pkgId)) {
+                LogWarning("Application " << appId <<
+                    " not found in database while removing user");
+                continue;
+            }
+
+            PrivilegeDb::getInstance().UpdateAppPrivileges(appId, uidDeleted,
+                std::vector<std::string>());
+            PrivilegeDb::getInstance().RemoveApplication(appId, uidDeleted, removePkg);
+            userPkgs[pkgId] = userPkgs[pkgId] || removePkg;
+        }
+
+        /* Erases privileges of all removed applications at once,
+           instead of UpdateAppPolicy for each of them */
+        CynaraAdmin::getInstance().UserRemove(uidDeleted);
+        PrivilegeDb::getInstance().CommitTransaction();
+        for (const auto &pkg : userPkgs)
+            LaunchProfileCache::getInstance().invalidatePkg(pkg.first);
+        LogDebug("User removal commited to database");
+    } catch (const PrivilegeDb::Exception::IOError &e) {
+        LogError("Cannot access application database: " << e.DumpToString());
+        return SECURITY_MANAGER_API_ERROR_SERVER_ERROR;
+    } catch (const PrivilegeDb::Exception::InternalError &e) {
+        PrivilegeDb::getInstance().RollbackTransaction();
+        LogError("Error while removing user applications from database: " << e.DumpToString());
+        return SECURITY_MANAGER_API_ERROR_SERVER_ERROR;
+    } catch (const CynaraException::Base &e) {
+        PrivilegeDb::getInstance().RollbackTransaction();
+        LogError("Error while removing Cynara rules for user: " << e.DumpToString());
         return SECURITY_MANAGER_API_ERROR_SERVER_ERROR;
+    } catch (const std::bad_alloc &e) {
+        PrivilegeDb::getInstance().RollbackTransaction();
+        LogError("Memory allocation error while removing user: " << e.what());
+        return SECURITY_MANAGER_API_ERROR_OUT_OF_MEMORY;
     }
 
-    for (auto &app: userApps) {
-        if (appUninstall(app, uidDeleted) != SECURITY_MANAGER_API_SUCCESS) {
-        /*if uninstallation of this app fails, just go on trying to uninstall another ones.
-        we do not have anything special to do about that matter - user will be deleted anyway.*/
+    /*if removal of Smack rules fails, just go on with the others.
+    we do not have anything special to do about that matter - user will be deleted anyway.*/
+    SmackRules::ScopedBatch batch;
+    for (const auto &appId : userApps) {
+        try {
+            LogDebug("Removing smack rules for deleted appId " << appId);
+            SmackRules::uninstallApplicationRules(appId);
+        } catch (const SmackException::Base &e) {
+            LogError("Error while removing Smack rules for application: " << e.DumpToString());
+            ret = SECURITY_MANAGER_API_ERROR_SETTING_FILE_LABEL_FAILED;
+        } catch (const PrivilegeDb::Exception::Base &e) {
+            LogError("Error while removing recorded Smack rules of application: " << e.DumpToString());
+            ret = SECURITY_MANAGER_API_ERROR_SERVER_ERROR;
+        }
+    }
+
+    for (const auto &pkg : userPkgs) {
+        const std::string &pkgId = pkg.first;
+        try {
+            if (pkg.second) {
+                LogDebug("Removing Smack rules for deleted pkgId " << pkgId);
+                SmackRules::uninstallPackageRules(pkgId);
+            } else {
+                std::vector<std::string> pkgContents;
+                PrivilegeDb::getInstance().GetAppIdsForPkgId(pkgId, pkgContents);
+                SmackRules::updatePackageRules(pkgId, pkgContents);
+            }
+        } catch (const SmackException::Base &e) {
+            LogError("Error while updating Smack rules for package: " << e.DumpToString());
+            ret = SECURITY_MANAGER_API_ERROR_SETTING_FILE_LABEL_FAILED;
+        } catch (const PrivilegeDb::Exception::Base &e) {
+            LogError("Error while getting package contents from database: " << e.DumpToString());
             ret = SECURITY_MANAGER_API_ERROR_SERVER_ERROR;
         }
     }
 
-    CynaraAdmin::getInstance().UserRemove(uidDeleted);
+    try {
+        batch.flush();
+    } catch (const SmackException::Base &e) {
+        LogError("Error while syncing Smack rules of removed applications: " << e.DumpToString());
+        ret = SECURITY_MANAGER_API_ERROR_SETTING_FILE_LABEL_FAILED;
+    }
 
     return ret;
 }
@@ -674,6 +831,11 @@ int getConfiguredPolicy(bool forAdmin, const policy_entry &filter, uid_t uid, pi
             LogDebug("PRIVACY MANAGER - number of policies matched: " << listOfPolicies.size());
         };
 
+        // Max levels are computed locally, not with a Cynara check per policy
+        std::unique_ptr<CynaraPolicySnapshot> snapshot;
+        if (!forAdmin && !listOfPolicies.empty())
+            snapshot.reset(new CynaraPolicySnapshot(user));
+
         for (const auto &policy : listOfPolicies) {
             //ignore "jump to bucket" entries
             if (policy.result ==  CYNARA_ADMIN_BUCKET)
@@ -689,7 +851,7 @@ int getConfiguredPolicy(bool forAdmin, const policy_entry &filter, uid_t uid, pi
             if (!forAdmin) {
                 // All policy entries in PRIVACY_MANAGER should be fully-qualified
                 pe.maxLevel = CynaraAdmin::getInstance().convertToPolicyDescription(
-                    CynaraAdmin::getInstance().GetPrivilegeManagerMaxLevel(
+                    snapshot->GetPrivilegeManagerMaxLevel(
                         policy.client, policy.user, policy.privilege));
             } else {
                 // Cannot reliably calculate maxLavel for policies from ADMIN bucket
@@ -761,6 +923,10 @@ int getPolicy(const policy_entry &filter, uid_t uid, pid_t pid, const std::strin
         };
         LogDebug("Fetching policy for " << listOfUsers.size() << " users");
 
+        // Levels are computed locally, not with two Cynara checks per privilege
+        CynaraPolicySnapshot snapshot(listOfUsers.size() == 1 ?
+            std::to_string(listOfUsers[0]) : std::string(CYNARA_ADMIN_ANY));
+
         for (const uid_t &uid : listOfUsers) {
             LogDebug("User: " << uid);
             std::string userStr = std::to_string(uid);
@@ -806,11 +972,11 @@ int getPolicy(const policy_entry &filter, uid_t uid, pid_t pid, const std::strin
                     pe.privilege = privilege;
 
                     pe.currentLevel = CynaraAdmin::getInstance().convertToPolicyDescription(
-                        CynaraAdmin::getInstance().GetPrivilegeManagerCurrLevel(
+                        snapshot.GetPrivilegeManagerCurrLevel(
                             smackLabelForApp, userStr, privilege));
 
                     pe.maxLevel = CynaraAdmin::getInstance().convertToPolicyDescription(
-                        CynaraAdmin::getInstance().GetPrivilegeManagerMaxLevel(
+                        snapshot.GetPrivilegeManagerMaxLevel(
                             smackLabelForApp, userStr, privilege));
 
                     LogDebug(
@@ -0,0 +1,315 @@
+/*
+ *  Copyright (c) 2014 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *  Contact: Rafal Krypa <r.krypa@samsung.com>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License
+ */
+/*
+ * @file        smack-backend.cpp
+ * @brief       Kernel, in-memory and user xattr Smack backends
+ */
+
+#include <sys/smack.h>
+#include <sys/stat.h>
+#include <sys/xattr.h>
+#include <linux/xattr.h>
+#include <errno.h>
+
+#include <cstring>
+#include <new>
+
+#include <dpl/log/log.h>
+
+#include "smack-backend.h"
+#include "smack-exceptions.h"
+#include "smack-rules.h"
+
+namespace SecurityManager {
+
+namespace {
+
+/* Access letters in the order used by the kernel */
+const char *const SMACK_ACCESS_ORDER = "rwxatlb";
+
+/* Smack attributes and their counterparts in the user namespace */
+const struct {
+    const char *smack;
+    const char *user;
+} USER_XATTR_NAMES[] = {
+    {XATTR_NAME_SMACK, "user.SMACK64"},
+    {XATTR_NAME_SMACKIPIN, "user.SMACK64IPIN"},
+    {XATTR_NAME_SMACKIPOUT, "user.SMACK64IPOUT"},
+    {XATTR_NAME_SMACKEXEC, "user.SMACK64EXEC"},
+    {XATTR_NAME_SMACKTRANSMUTE, "user.SMACK64TRANSMUTE"},
+    {XATTR_NAME_SMACKMMAP, "user.SMACK64MMAP"},
+};
+
+typedef std::unique_ptr<smack_accesses, void (*)(smack_accesses *)> AccessesPtr;
+
+AccessesPtr makeAccesses(const SmackRules &rules)
+{
+    smack_accesses *handle;
+    if (smack_accesses_new(&handle) < 0) {
+        LogError("Failed to create smack_accesses handle");
+        throw std::bad_alloc();
+    }
+    AccessesPtr accesses(handle, smack_accesses_free);
+
+    for (const auto &rule : rules.getRules())
+        if (smack_accesses_add(handle, rule.subject.c_str(), rule.object.c_str(),
+                rule.access.c_str()))
+            ThrowMsg(SmackException::LibsmackError, "smack_accesses_add");
+
+    for (const auto &modification : rules.getModifications())
+        if (smack_accesses_add_modify(handle, modification.subject.c_str(),
+                modification.object.c_str(), modification.allow.c_str(),
+                modification.deny.c_str()))
+            ThrowMsg(SmackException::LibsmackError, "smack_accesses_add_modify");
+
+    return accesses;
+}
+
+/* Access letters in the kernel order, upper case accepted, "-" ignored */
+std::string normalizeAccess(const std::string &access)
+{
+    std::string normalized;
+    for (const char *code = SMACK_ACCESS_ORDER; *code; ++code)
+        if (access.find(*code) != std::string::npos ||
+            access.find(*code - 'a' + 'A') != std::string::npos)
+            normalized += *code;
+    return normalized;
+}
+
+std::unique_ptr<SmackBackend> &currentBackend()
+{
+    static std::unique_ptr<SmackBackend> backend(new KernelSmackBackend);
+    return backend;
+}
+
+} // namespace anonymous
+
+SmackBackend &SmackBackend::get()
+{
+    return *currentBackend();
+}
+
+void SmackBackend::set(std::unique_ptr<SmackBackend> backend)
+{
+    LogInfo("Using Smack backend: " << backend->name());
+    currentBackend() = std::move(backend);
+}
+
+std::unique_ptr<SmackBackend> SmackBackend::create(const std::string &name)
+{
+    if (name == "kernel")
+        return std::unique_ptr<SmackBackend>(new KernelSmackBackend);
+    if (name == "memory")
+        return std::unique_ptr<SmackBackend>(new MemorySmackBackend);
+    if (name == "user-xattr")
+        return std::unique_ptr<SmackBackend>(new UserXattrSmackBackend);
+    return nullptr;
+}
+
+const char *KernelSmackBackend::name() const
+{
+    return "kernel";
+}
+
+bool KernelSmackBackend::hasPolicy() const
+{
+    return smack_smackfs_path() != NULL;
+}
+
+void KernelSmackBackend::apply(const SmackRules &rules)
+{
+    if (smack_accesses_apply(makeAccesses(rules).get()))
+        ThrowMsg(SmackException::LibsmackError, "smack_accesses_apply");
+}
+
+void KernelSmackBackend::clear(const SmackRules &rules)
+{
+    if (smack_accesses_clear(makeAccesses(rules).get()))
+        ThrowMsg(SmackException::LibsmackError, "smack_accesses_clear");
+}
+
+const char *KernelSmackBackend::xattrName(const char *attribute) const
+{
+    return attribute;
+}
+
+int KernelSmackBackend::setLabel(const char *path, const char *attribute,
+        const std::string &label)
+{
+    return lsetxattr(path, attribute, label.c_str(), label.length(), 0);
+}
+
+ssize_t KernelSmackBackend::getLabel(const char *path, const char *attribute,
+        char *buffer, size_t size)
+{
+    return lgetxattr(path, attribute, buffer, size);
+}
+
+const char *MemorySmackBackend::name() const
+{
+    return "memory";
+}
+
+bool MemorySmackBackend::hasPolicy() const
+{
+    return true;
+}
+
+void MemorySmackBackend::apply(const SmackRules &rules)
+{
+    std::lock_guard<std::mutex> lock(m_policyMutex);
+
+    // Like load2, access of a rule replaces the previous one
+    for (const auto &rule : rules.getRules()) {
+        std::string access = normalizeAccess(rule.access);
+        Key key(rule.subject, rule.object);
+        if (access.empty())
+            m_policy.erase(key);
+        else
+            m_policy[key] = access;
+    }
+
+    for (const auto &modification : rules.getModifications()) {
+        Key key(modification.subject, modification.object);
+        auto it = m_policy.find(key);
+        std::string access = normalizeAccess(
+            (it != m_policy.end() ? it->second : std::string()) + modification.allow);
+        std::string deny = normalizeAccess(modification.deny);
+
+        std::string modified;
+        for (char code : access)
+            if (deny.find(code) == std::string::npos)
+                modified += code;
+
+        if (modified.empty())
+            m_policy.erase(key);
+        else
+            m_policy[key] = modified;
+    }
+}
+
+void MemorySmackBackend::clear(const SmackRules &rules)
+{
+    std::lock_guard<std::mutex> lock(m_policyMutex);
+
+    for (const auto &rule : rules.getRules())
+        m_policy.erase(Key(rule.subject, rule.object));
+    for (const auto &modification : rules.getModifications())
+        m_policy.erase(Key(modification.subject, modification.object));
+}
+
+const char *MemorySmackBackend::xattrName(const char *) const
+{
+    return NULL;
+}
+
+int MemorySmackBackend::setLabel(const char *path, const char *attribute,
+        const std::string &label)
+{
+    std::lock_guard<std::mutex> lock(m_labelsMutex);
+    m_labels[Key(path, attribute)] = label;
+    return 0;
+}
+
+ssize_t MemorySmackBackend::getLabel(const char *path, const char *attribute,
+        char *buffer, size_t size)
+{
+    std::lock_guard<std::mutex> lock(m_labelsMutex);
+    auto it = m_labels.find(Key(path, attribute));
+    if (it == m_labels.end()) {
+        errno = ENODATA;
+        return -1;
+    }
+
+    // Size 0 asks for the length only, as with lgetxattr()
+    const std::string &label = it->second;
+    if (size) {
+        if (size < label.length()) {
+            errno = ERANGE;
+            return -1;
+        }
+        memcpy(buffer, label.data(), label.length());
+    }
+    return label.length();
+}
+
+std::string MemorySmackBackend::getAccess(const std::string &subject,
+        const std::string &object)
+{
+    std::lock_guard<std::mutex> lock(m_policyMutex);
+    auto it = m_policy.find(Key(subject, object));
+    return it != m_policy.end() ? it->second : std::string();
+}
+
+size_t MemorySmackBackend::ruleCount()
+{
+    std::lock_guard<std::mutex> lock(m_policyMutex);
+    return m_policy.size();
+}
+
+const char *UserXattrSmackBackend::name() const
+{
+    return "user-xattr";
+}
+
+const char *UserXattrSmackBackend::xattrName(const char *attribute) const
+{
+    for (const auto &names : USER_XATTR_NAMES)
+        if (!strcmp(names.smack, attribute))
+            return names.user;
+    return NULL;
+}
+
+int UserXattrSmackBackend::setLabel(const char *path, const char *attribute,
+        const std::string &label)
+{
+    const char *name = xattrName(attribute);
+    if (!name) {
+        errno = ENOTSUP;
+        return -1;
+    }
+
+    // Kernel allows user.* attributes on regular files and directories only
+    if (!lsetxattr(path, name, label.c_str(), label.length(), 0))
+        return 0;
+    int error = errno;
+    struct stat st;
+    if (error != EPERM || lstat(path, &st) || S_ISREG(st.st_mode) || S_ISDIR(st.st_mode)) {
+        errno = error;
+        return -1;
+    }
+    return MemorySmackBackend::setLabel(path, attribute, label);
+}
+
+ssize_t UserXattrSmackBackend::getLabel(const char *path, const char *attribute,
+        char *buffer, size_t size)
+{
+    const char *name = xattrName(attribute);
+    if (!name) {
+        errno = ENOTSUP;
+        return -1;
+    }
+
+    // Labels of other files, e.g. symlinks, are kept in memory
+    ssize_t ret = lgetxattr(path, name, buffer, size);
+    if (ret == -1 && errno == ENODATA)
+        return MemorySmackBackend::getLabel(path, attribute, buffer, size);
+    return ret;
+}
+
+} // namespace SecurityManager
@@ -28,14 +28,25 @@
 #include <sys/smack.h>
 #include <sys/xattr.h>
 #include <linux/xattr.h>
+#include <dirent.h>
+#include <fcntl.h>
 #include <memory>
 #include <fts.h>
+#include <atomic>
+#include <condition_variable>
 #include <cstring>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include <dpl/log/log.h>
 
 #include "security-manager.h"
+#include "smack-backend.h"
 #include "smack-labels.h"
 
 namespace SecurityManager {
@@ -44,37 +55,79 @@ namespace SmackLabels {
 /* Const defined below is used to label files accessible to apps only for reading */
 const char *const LABEL_FOR_APP_RO_PATH = "User::Home";
 
-typedef std::function<bool(const FTSENT*)> LabelDecisionFn;
+/* Threads labeling a directory tree, 1 means the calling thread only */
+static std::atomic<unsigned> labelingThreads(1);
+
+namespace {
+
+/* Extended attributes set on every file of a directory tree */
+struct TreeLabels {
+    TreeLabels(const std::string &label, bool transmute, bool executables,
+            bool incremental)
+      : label(label)
+      , transmute(transmute)
+      , executables(executables)
+      , incremental(incremental)
+      , changed(0)
+      , skipped(0)
+    {}
+
+    const std::string &label;
+    bool transmute;
+    bool executables;
+    /* Read attributes first, write only those that differ */
+    bool incremental;
+    std::atomic<size_t> changed;
+    std::atomic<size_t> skipped;
+};
+
+/* Longest Smack label and the terminating zero */
+const size_t SMACK_LABEL_BUFFER_SIZE = 256;
+
+} // namespace anonymous
 
-static bool labelAll(const FTSENT *ftsent __attribute__((unused)))
+static inline void pathSetSmack(const char *path, const std::string &label,
+        const char *xattr_name)
 {
-    return true;
+    if (SmackBackend::get().setLabel(path, xattr_name, label)) {
+        LogError("lsetxattr failed.");
+        ThrowMsg(SmackException::FileError, "lsetxattr failed.");
+    }
 }
 
-static bool labelDirs(const FTSENT *ftsent)
+static void entrySetSmack(const char *path, const std::string &label,
+        const char *xattr_name, TreeLabels &labels)
 {
-    // label only directories
-    return (S_ISDIR(ftsent->fts_statp->st_mode));
-}
+    if (labels.incremental) {
+        // Missing attribute (ENODATA) or longer value (ERANGE) just differ
+        char current[SMACK_LABEL_BUFFER_SIZE];
+        ssize_t size = SmackBackend::get().getLabel(path, xattr_name, current, sizeof(current));
+        if (size == static_cast<ssize_t>(label.length()) &&
+            !memcmp(current, label.c_str(), size)) {
+            ++labels.skipped;
+            return;
+        }
+    }
 
-static bool labelExecs(const FTSENT *ftsent)
-{
-    // LogDebug("Mode = " << ftsent->fts_statp->st_mode); // this could be helpfull in debugging
-    // label only regular executable files
-    return (S_ISREG(ftsent->fts_statp->st_mode) && (ftsent->fts_statp->st_mode & S_IXUSR));
+    pathSetSmack(path, label, xattr_name);
+    ++labels.changed;
 }
 
-static inline void pathSetSmack(const char *path, const std::string &label,
-        const char *xattr_name)
+static void labelEntry(const char *path, mode_t mode, TreeLabels &labels)
 {
-    if (lsetxattr(path, xattr_name, label.c_str(), label.length(), 0)) {
-        LogError("lsetxattr failed.");
-        ThrowMsg(SmackException::FileError, "lsetxattr failed.");
-    }
+    // access label on everything
+    entrySetSmack(path, labels.label, XATTR_NAME_SMACK, labels);
+
+    // transmute on dirs
+    if (labels.transmute && S_ISDIR(mode))
+        entrySetSmack(path, "TRUE", XATTR_NAME_SMACKTRANSMUTE, labels);
+
+    // SMACK64EXEC on regular executable files
+    if (labels.executables && S_ISREG(mode) && (mode & S_IXUSR))
+        entrySetSmack(path, labels.label, XATTR_NAME_SMACKEXEC, labels);
 }
 
-static void dirSetSmack(const std::string &path, const std::string &label,
-        const char *xattr_name, LabelDecisionFn fn)
+static void labelTree(const std::string &path, TreeLabels &labels)
 {
     char *const path_argv[] = {const_cast<char *>(path.c_str()), NULL};
     FTSENT *ftsent;
@@ -99,8 +152,7 @@ static void dirSetSmack(const std::string &path, const std::string &label,
         if (ftsent->fts_info == FTS_D)
             continue;
 
-        if (fn(ftsent))
-            pathSetSmack(ftsent->fts_path, label, xattr_name);
+        labelEntry(ftsent->fts_path, ftsent->fts_statp->st_mode, labels);
     }
 
     /* If last call to fts_read() set errno, we need to return error. */
@@ -110,23 +162,258 @@ static void dirSetSmack(const std::string &path, const std::string &label,
     }
 }
 
-static void labelDir(const std::string &path, const std::string &label,
-        bool set_transmutable, bool set_executables)
-{
-    // setting access label on everything in given directory and below
-    dirSetSmack(path, label, XATTR_NAME_SMACK, labelAll);
+namespace {
+
+/*
+ * Labels a directory tree with several threads. Each thread lists
+ * directories from its own queue, labels their entries and queues
+ * subdirectories found there. Entries of a directory are queued in chunks,
+ * so that a big directory is labeled by several threads too. Thread with
+ * an empty queue takes the oldest task from queue of another thread, which
+ * tends to be the root of a big untouched subtree, or sleeps until there
+ * is one.
+ */
+class ParallelTreeLabeler {
+public:
+    ParallelTreeLabeler(TreeLabels &labels, unsigned threads)
+      : m_labels(labels)
+      , m_threads(threads)
+      , m_queues(new Queue[threads])
+      , m_pending(0)
+      , m_queued(0)
+      , m_idle(0)
+      , m_failed(false)
+    {}
+
+    void run(const std::string &root)
+    {
+        Task task;
+        task.dir = root;
+        push(0, std::move(task));
+
+        std::vector<std::thread> workers;
+        for (unsigned i = 1; i < m_threads; ++i)
+            workers.emplace_back(&ParallelTreeLabeler::work, this, i);
+        work(0);
+        for (auto &worker : workers)
+            worker.join();
+
+        if (m_error)
+            std::rethrow_exception(m_error);
+    }
+
+private:
+    /* Entries labeled by one task, few enough to balance the threads */
+    static const size_t CHUNK_SIZE = 64;
+
+    struct Entry {
+        std::string path;
+        mode_t mode;
+    };
+
+    /* Directory to list, or entries of a directory to label */
+    struct Task {
+        std::string dir;
+        std::vector<Entry> entries;
+    };
+
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void push(unsigned id, Task &&task)
+    {
+        ++m_pending;
+        {
+            std::lock_guard<std::mutex> lock(m_queues[id].mutex);
+            m_queues[id].tasks.push_back(std::move(task));
+        }
+
+        // Seen by a thread going idle, or that thread is seen here
+        ++m_queued;
+        if (m_idle)
+            wake(false);
+    }
+
+    bool pop(unsigned id, Task &task)
+    {
+        for (unsigned i = 0; i < m_threads; ++i) {
+            Queue &queue = m_queues[(id + i) % m_threads];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (queue.tasks.empty())
+                continue;
+
+            // Own queue is used as a stack, others as queues
+            if (!i) {
+                task = std::move(queue.tasks.back());
+                queue.tasks.pop_back();
+            } else {
+                task = std::move(queue.tasks.front());
+                queue.tasks.pop_front();
+            }
+            --m_queued;
+            return true;
+        }
+        return false;
+    }
+
+    void wake(bool all)
+    {
+        // Waiting thread either checked its condition already or is waiting
+        {
+            std::lock_guard<std::mutex> lock(m_idleMutex);
+        }
+        if (all)
+            m_wakeUp.notify_all();
+        else
+            m_wakeUp.notify_one();
+    }
+
+    /* @return false if there will be no more tasks */
+    bool waitForTask()
+    {
+        std::unique_lock<std::mutex> lock(m_idleMutex);
+        ++m_idle;
+        m_wakeUp.wait(lock, [this] { return m_queued || !m_pending || m_failed; });
+        --m_idle;
+        return m_pending && !m_failed;
+    }
+
+    void fail()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_errorMutex);
+            if (!m_error)
+                m_error = std::current_exception();
+        }
+        m_failed = true;
+        wake(true);
+    }
+
+    void work(unsigned id)
+    {
+        Task task;
+
+        // Queued tasks and tasks being done are pending
+        while (!m_failed) {
+            if (!pop(id, task)) {
+                if (!waitForTask())
+                    break;
+                continue;
+            }
+
+            try {
+                if (task.dir.empty())
+                    labelEntries(task.entries);
+                else
+                    labelDirectory(id, task.dir);
+            } catch (...) {
+                fail();
+            }
+            if (!--m_pending)
+                wake(true);
+        }
+    }
 
-    // setting transmute on dirs
-    if (set_transmutable)
-        dirSetSmack(path, "TRUE", XATTR_NAME_SMACKTRANSMUTE, labelDirs);
+    void labelEntries(const std::vector<Entry> &entries)
+    {
+        for (const auto &entry : entries)
+            labelEntry(entry.path.c_str(), entry.mode, m_labels);
+    }
+
+    void labelDirectory(unsigned id, const std::string &path)
+    {
+        std::unique_ptr<DIR, int(*)(DIR*)> dir(opendir(path.c_str()), closedir);
+        if (!dir) {
+            LogError("opendir failed for " << path << ": " << strerror(errno));
+            ThrowMsg(SmackException::FileError, "opendir failed for " << path);
+        }
+
+        Task chunk;
+        struct dirent *entry;
+        while ((errno = 0, entry = readdir(dir.get())) != NULL) {
+            if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, ".."))
+                continue;
+
+            std::string entryPath = path + "/" + entry->d_name;
+            mode_t mode = DTTOIF(entry->d_type);
+
+            // Type is enough unless it's unknown or executable bit matters
+            if (entry->d_type == DT_UNKNOWN ||
+                (entry->d_type == DT_REG && m_labels.executables)) {
+                struct stat st;
+                if (fstatat(dirfd(dir.get()), entry->d_name, &st, AT_SYMLINK_NOFOLLOW)) {
+                    LogError("stat failed for " << entryPath << ": " << strerror(errno));
+                    ThrowMsg(SmackException::FileError, "stat failed for " << entryPath);
+                }
+                mode = st.st_mode;
+            }
+
+            // Directory is labeled by whoever lists it
+            if (S_ISDIR(mode)) {
+                Task subdir;
+                subdir.dir = std::move(entryPath);
+                push(id, std::move(subdir));
+                continue;
+            }
+
+            chunk.entries.push_back(Entry{std::move(entryPath), mode});
+            if (chunk.entries.size() == CHUNK_SIZE) {
+                push(id, std::move(chunk));
+                chunk.entries.clear();
+            }
+        }
+
+        if (errno != 0) {
+            LogError("readdir failed for " << path << ": " << strerror(errno));
+            ThrowMsg(SmackException::FileError, "readdir failed for " << path);
+        }
 
-    // setting SMACK64EXEC labels
-    if (set_executables)
-        dirSetSmack(path, label, XATTR_NAME_SMACKEXEC, &labelExecs);
+        labelEntries(chunk.entries);
+        labelEntry(path.c_str(), S_IFDIR, m_labels);
+    }
+
+    TreeLabels &m_labels;
+    unsigned m_threads;
+    std::unique_ptr<Queue[]> m_queues;
+    std::atomic<size_t> m_pending;
+    std::atomic<size_t> m_queued;
+    std::atomic<unsigned> m_idle;
+    std::atomic<bool> m_failed;
+    std::mutex m_idleMutex;
+    std::condition_variable m_wakeUp;
+    std::mutex m_errorMutex;
+    std::exception_ptr m_error;
+};
+
+} // namespace anonymous
+
+static LabelingStatistics labelDir(const std::string &path, const std::string &label,
+        bool set_transmutable, bool set_executables, bool incremental)
+{
+    TreeLabels labels(label, set_transmutable, set_executables, incremental);
+    unsigned threads = labelingThreads;
+    struct stat st;
+
+    if (threads > 1 && !lstat(path.c_str(), &st) && S_ISDIR(st.st_mode))
+        ParallelTreeLabeler(labels, threads).run(path);
+    else
+        labelTree(path, labels);
+
+    LabelingStatistics statistics = {labels.changed, labels.skipped};
+    LogDebug("Labeled " << path << ": " << statistics.changed << " attributes changed, " <<
+        statistics.skipped << " unchanged");
+    return statistics;
+}
+
+void setLabelingThreads(unsigned threads)
+{
+    labelingThreads = threads ? threads : 1;
 }
 
-void setupPath(const std::string &appId, const std::string &path,
-    app_install_path_type pathType)
+LabelingStatistics setupPath(const std::string &appId, const std::string &path,
+    app_install_path_type pathType, bool incremental)
 {
     std::string label;
     bool label_executables, label_transmute;
@@ -153,7 +440,7 @@ void setupPath(const std::string &appId, const std::string &path,
         LogError("Path type not known.");
         Throw(SmackException::InvalidPathType);
     }
-    return labelDir(path, label, label_transmute, label_executables);
+    return labelDir(path, label, label_transmute, label_executables, incremental);
 }
 
 void setupCorrectPath(const std::string &pkgId, const std::string &appId, const std::string &basePath)
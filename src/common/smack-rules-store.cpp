@@ -0,0 +1,480 @@
+/*
+ *  Copyright (c) 2014 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *  Contact: Rafal Krypa <r.krypa@samsung.com>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License
+ */
+/*
+ * @file        smack-rules-store.cpp
+ * @brief       Single file with Smack rules of all applications and packages
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/smack.h>
+#include <sys/stat.h>
+#include <sys/utsname.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <new>
+#include <sstream>
+
+#include <dpl/errno_string.h>
+#include <dpl/log/log.h>
+#include <tzplatform_config.h>
+
+#include "smack-exceptions.h"
+#include "smack-rules.h"
+#include "smack-rules-store.h"
+
+namespace SecurityManager {
+
+namespace {
+
+const char STORE_MAGIC[8] = {'S', 'M', 'R', 'U', 'L', 'E', 'S', '\0'};
+const uint32_t STORE_VERSION = 1;
+
+struct StoreHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t sectionCount;
+    uint32_t ruleCount;
+    uint32_t rulesOffset;
+    uint32_t rulesSize;
+};
+
+struct StoreSection {
+    uint32_t nameOffset;
+    uint32_t nameSize;
+    uint32_t rulesOffset;
+    uint32_t rulesSize;
+};
+
+std::string getStorePath()
+{
+    return tzplatform_mkpath(TZ_SYS_SMACK, "security-manager.rules");
+}
+
+std::string getRulesDir()
+{
+    return tzplatform_mkpath(TZ_SYS_SMACK, "accesses.d");
+}
+
+bool isRulesFileName(const char *name)
+{
+    return !strncmp(name, "app_", 4) || !strncmp(name, "pkg_", 4);
+}
+
+/*
+ * Timestamps of file systems are coarse, a file changed right after the
+ * store was written may have the same time. Equal ones count as newer.
+ */
+bool notOlder(const struct timespec &a, const struct timespec &b)
+{
+    return a.tv_sec > b.tv_sec || (a.tv_sec == b.tv_sec && a.tv_nsec >= b.tv_nsec);
+}
+
+/* Rules one per line, without empty lines, each ended with a new line */
+std::string normalizeRules(const std::string &rules)
+{
+    std::string normalized;
+    normalized.reserve(rules.size() + 1);
+
+    size_t pos = 0;
+    while (pos < rules.size()) {
+        size_t end = rules.find('\n', pos);
+        if (end == std::string::npos)
+            end = rules.size();
+        if (end > pos) {
+            normalized.append(rules, pos, end - pos);
+            normalized += '\n';
+        }
+        pos = end + 1;
+    }
+    return normalized;
+}
+
+std::string readFile(const std::string &path)
+{
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        LogError("Cannot open rules file: " << path);
+        ThrowMsg(SmackException::FileError, "Cannot open rules file: " << path);
+    }
+
+    std::stringstream contents;
+    contents << file.rdbuf();
+    if (file.bad()) {
+        LogError("Error reading rules file: " << path);
+        ThrowMsg(SmackException::FileError, "Error reading rules file: " << path);
+    }
+    return contents.str();
+}
+
+/*
+ * Until Linux 3.13 only the first rule of a write to load2 was parsed,
+ * the rest was silently ignored. Rules are written one by one then.
+ */
+bool kernelParsesRuleLists()
+{
+    struct utsname name;
+    unsigned major, minor;
+
+    if (uname(&name) || sscanf(name.release, "%u.%u", &major, &minor) != 2)
+        return false;
+    return major > 3 || (major == 3 && minor >= 13);
+}
+
+/* Read only mapping of a store file, checked to be consistent */
+class MappedStore {
+public:
+    explicit MappedStore(const std::string &path)
+      : m_data(MAP_FAILED)
+      , m_size(0)
+    {
+        int fd = TEMP_FAILURE_RETRY(open(path.c_str(), O_RDONLY | O_CLOEXEC));
+        if (fd == -1) {
+            LogWarning("Cannot open Smack rules store " << path << ": " << GetErrnoString(errno));
+            ThrowMsg(SmackException::FileError, "Cannot open Smack rules store: " << path);
+        }
+
+        struct stat st;
+        if (fstat(fd, &st) == -1) {
+            LogError("Cannot stat Smack rules store " << path << ": " << GetErrnoString(errno));
+            close(fd);
+            ThrowMsg(SmackException::FileError, "Cannot stat Smack rules store: " << path);
+        }
+
+        m_size = st.st_size;
+        if (m_size >= sizeof(StoreHeader))
+            m_data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+        close(fd);
+
+        if (m_data == MAP_FAILED) {
+            LogError("Cannot map Smack rules store: " << path);
+            ThrowMsg(SmackException::FileError, "Cannot map Smack rules store: " << path);
+        }
+
+        if (!valid()) {
+            munmap(m_data, m_size);
+            LogError("Invalid Smack rules store: " << path);
+            ThrowMsg(SmackException::FileError, "Invalid Smack rules store: " << path);
+        }
+    }
+
+    ~MappedStore()
+    {
+        munmap(m_data, m_size);
+    }
+
+    const StoreHeader &header() const
+    {
+        return *static_cast<const StoreHeader *>(m_data);
+    }
+
+    const StoreSection *sections() const
+    {
+        return reinterpret_cast<const StoreSection *>(data() + sizeof(StoreHeader));
+    }
+
+    const char *data() const
+    {
+        return static_cast<const char *>(m_data);
+    }
+
+private:
+    bool valid() const
+    {
+        const StoreHeader &hdr = header();
+        if (memcmp(hdr.magic, STORE_MAGIC, sizeof(STORE_MAGIC)) || hdr.version != STORE_VERSION)
+            return false;
+
+        uint64_t sectionsEnd = sizeof(StoreHeader) +
+            static_cast<uint64_t>(hdr.sectionCount) * sizeof(StoreSection);
+        if (sectionsEnd > hdr.rulesOffset ||
+            static_cast<uint64_t>(hdr.rulesOffset) + hdr.rulesSize != m_size)
+            return false;
+
+        for (uint32_t i = 0; i < hdr.sectionCount; ++i) {
+            const StoreSection &section = sections()[i];
+            if (section.nameOffset < sectionsEnd ||
+                static_cast<uint64_t>(section.nameOffset) + section.nameSize > hdr.rulesOffset ||
+                section.rulesOffset < hdr.rulesOffset ||
+                static_cast<uint64_t>(section.rulesOffset) + section.rulesSize > m_size)
+                return false;
+        }
+
+        return !hdr.rulesSize || data()[m_size - 1] == '\n';
+    }
+
+    void *m_data;
+    size_t m_size;
+};
+
+} // namespace anonymous
+
+void SmackRulesStore::readRulesDir(const std::string &rulesDir, Sections &sections)
+{
+    std::unique_ptr<DIR, int (*)(DIR *)> dir(opendir(rulesDir.c_str()), closedir);
+    if (!dir) {
+        LogError("Cannot open rules directory " << rulesDir << ": " << GetErrnoString(errno));
+        ThrowMsg(SmackException::FileError, "Cannot open rules directory: " << rulesDir);
+    }
+
+    struct dirent *entry;
+    while ((entry = readdir(dir.get())) != nullptr) {
+        if (!isRulesFileName(entry->d_name))
+            continue;
+        sections[entry->d_name] = normalizeRules(readFile(rulesDir + "/" + entry->d_name));
+    }
+}
+
+void SmackRulesStore::writeStore(const std::string &storePath, const Sections &sections)
+{
+    StoreHeader header;
+    memcpy(header.magic, STORE_MAGIC, sizeof(STORE_MAGIC));
+    header.version = STORE_VERSION;
+    header.sectionCount = sections.size();
+    header.ruleCount = 0;
+
+    size_t namesSize = 0;
+    size_t rulesSize = 0;
+    for (const auto &section : sections) {
+        namesSize += section.first.size();
+        rulesSize += section.second.size();
+    }
+
+    size_t namesOffset = sizeof(StoreHeader) + sections.size() * sizeof(StoreSection);
+    size_t rulesOffset = namesOffset + namesSize;
+    if (rulesOffset + rulesSize > UINT32_MAX) {
+        LogError("Too many rules for Smack rules store: " << rulesOffset + rulesSize << " bytes");
+        ThrowMsg(SmackException::FileError, "Too many rules for Smack rules store");
+    }
+    header.rulesOffset = rulesOffset;
+    header.rulesSize = rulesSize;
+
+    std::string image(rulesOffset + rulesSize, '\0');
+    size_t nameOffset = namesOffset;
+    size_t ruleOffset = rulesOffset;
+    StoreSection *table = reinterpret_cast<StoreSection *>(&image[sizeof(StoreHeader)]);
+    for (const auto &section : sections) {
+        table->nameOffset = nameOffset;
+        table->nameSize = section.first.size();
+        table->rulesOffset = ruleOffset;
+        table->rulesSize = section.second.size();
+        ++table;
+
+        image.replace(nameOffset, section.first.size(), section.first);
+        image.replace(ruleOffset, section.second.size(), section.second);
+        nameOffset += section.first.size();
+        ruleOffset += section.second.size();
+
+        for (char c : section.second)
+            header.ruleCount += c == '\n';
+    }
+    memcpy(&image[0], &header, sizeof(header));
+
+    // Boot must see either the old or the new store, never a partial one
+    std::string tmpPath = storePath + ".tmp";
+    int fd = TEMP_FAILURE_RETRY(open(tmpPath.c_str(),
+        O_CREAT | O_WRONLY | O_TRUNC | O_CLOEXEC, 0644));
+    if (fd == -1) {
+        LogError("Failed to create file " << tmpPath << ": " << GetErrnoString(errno));
+        ThrowMsg(SmackException::FileError, "Failed to create file: " << tmpPath);
+    }
+
+    size_t done = 0;
+    while (done < image.size()) {
+        ssize_t ret = TEMP_FAILURE_RETRY(::write(fd, image.data() + done, image.size() - done));
+        if (ret == -1)
+            break;
+        done += ret;
+    }
+
+    if (done < image.size() || fsync(fd) == -1) {
+        LogError("Failed to write file " << tmpPath << ": " << GetErrnoString(errno));
+        close(fd);
+        unlink(tmpPath.c_str());
+        ThrowMsg(SmackException::FileError, "Failed to write file: " << tmpPath);
+    }
+
+    if (close(fd) == -1 && errno == EIO) {
+        LogError("I/O Error occured while closing the file: " << tmpPath);
+        unlink(tmpPath.c_str());
+        ThrowMsg(SmackException::FileError, "I/O Error occured while closing the file: " << tmpPath);
+    }
+
+    if (rename(tmpPath.c_str(), storePath.c_str()) == -1) {
+        LogError("Failed to rename " << tmpPath << " to " << storePath << ": " <<
+            GetErrnoString(errno));
+        unlink(tmpPath.c_str());
+        ThrowMsg(SmackException::FileError, "Failed to rename file: " << tmpPath);
+    }
+}
+
+void SmackRulesStore::build(const std::string &rulesDir, const std::string &storePath)
+{
+    Sections sections;
+    readRulesDir(rulesDir, sections);
+    writeStore(storePath, sections);
+}
+
+bool SmackRulesStore::isStale(const std::string &rulesDir, const std::string &storePath)
+{
+    struct stat store;
+    if (stat(storePath.c_str(), &store) == -1) {
+        if (errno != ENOENT)
+            LogWarning("Cannot stat Smack rules store " << storePath << ": " <<
+                GetErrnoString(errno));
+        return true;
+    }
+
+    std::unique_ptr<DIR, int (*)(DIR *)> dir(opendir(rulesDir.c_str()), closedir);
+    struct stat st;
+    if (!dir || fstat(dirfd(dir.get()), &st) == -1) {
+        LogWarning("Cannot check rules directory " << rulesDir << ": " << GetErrnoString(errno));
+        return true;
+    }
+    if (notOlder(st.st_mtim, store.st_mtim))
+        return true;
+
+    // Files may also be modified in place, not only replaced
+    struct dirent *entry;
+    while ((entry = readdir(dir.get())) != nullptr) {
+        if (!isRulesFileName(entry->d_name))
+            continue;
+        if (fstatat(dirfd(dir.get()), entry->d_name, &st, 0) == -1 ||
+            notOlder(st.st_mtim, store.st_mtim))
+            return true;
+    }
+    return false;
+}
+
+size_t SmackRulesStore::load(const std::string &storePath, const std::string &loadPath)
+{
+    MappedStore store(storePath);
+    const StoreHeader &header = store.header();
+
+    int fd = TEMP_FAILURE_RETRY(open(loadPath.c_str(), O_WRONLY | O_CLOEXEC));
+    if (fd == -1) {
+        LogError("Cannot open " << loadPath << ": " << GetErrnoString(errno));
+        ThrowMsg(SmackException::FileError, "Cannot open: " << loadPath);
+    }
+
+    // Batch of whole rules, a rule split between two writes would be rejected
+    size_t batchMax = kernelParsesRuleLists() ? sysconf(_SC_PAGESIZE) - 1 : 0;
+    const char *pos = store.data() + header.rulesOffset;
+    const char *end = pos + header.rulesSize;
+    while (pos < end) {
+        const char *batchEnd;
+        if (!batchMax) {
+            batchEnd = static_cast<const char *>(memchr(pos, '\n', end - pos)) + 1;
+        } else if (static_cast<size_t>(end - pos) <= batchMax) {
+            batchEnd = end;
+        } else {
+            batchEnd = static_cast<const char *>(memrchr(pos, '\n', batchMax));
+            if (!batchEnd) {
+                close(fd);
+                LogError("Smack rule longer than " << batchMax << " bytes in " << storePath);
+                ThrowMsg(SmackException::FileError, "Invalid Smack rule in: " << storePath);
+            }
+            ++batchEnd;
+        }
+
+        // Kernel may take less than the whole batch, it stops at a rule boundary
+        while (pos < batchEnd) {
+            ssize_t ret = TEMP_FAILURE_RETRY(::write(fd, pos, batchEnd - pos));
+            if (ret <= 0) {
+                LogError("Failed to load Smack rules to " << loadPath << ": " <<
+                    GetErrnoString(errno));
+                close(fd);
+                ThrowMsg(SmackException::FileError, "Failed to load Smack rules to: " << loadPath);
+            }
+            pos += ret;
+        }
+    }
+
+    close(fd);
+    return header.ruleCount;
+}
+
+void SmackRulesStore::refresh()
+{
+    std::string storePath = getStorePath();
+    std::string rulesDir = getRulesDir();
+    if (!isStale(rulesDir, storePath))
+        return;
+
+    try {
+        build(rulesDir, storePath);
+        LogInfo("Rebuilt Smack rules store " << storePath);
+    } catch (const SmackException::Base &e) {
+        LogError("Failed to rebuild Smack rules store " << storePath);
+    } catch (const std::bad_alloc &e) {
+        LogError("Failed to rebuild Smack rules store " << storePath);
+    }
+}
+
+void SmackRulesStore::loadToKernel()
+{
+    if (!smack_smackfs_path()) {
+        LogError("Smack filesystem is not mounted, rules can't be loaded");
+        ThrowMsg(SmackException::FileError, "Smack filesystem is not mounted");
+    }
+
+    std::string storePath = getStorePath();
+    std::string rulesDir = getRulesDir();
+    std::string loadPath = std::string(smack_smackfs_path()) + "/load2";
+
+    // Rules changed since the daemon last rebuilt the store must be loaded too
+    refresh();
+    if (isStale(rulesDir, storePath)) {
+        LogWarning("Loading Smack rules from rule files, store is not up to date: " << storePath);
+    } else {
+        try {
+            size_t rules = load(storePath, loadPath);
+            LogInfo("Loaded " << rules << " Smack rules from " << storePath);
+            return;
+        } catch (const SmackException::FileError &e) {
+            LogWarning("Loading Smack rules from rule files, store is not usable: " << storePath);
+        }
+    }
+
+    std::unique_ptr<DIR, int (*)(DIR *)> dir(opendir(rulesDir.c_str()), closedir);
+    if (!dir) {
+        LogError("Cannot open rules directory " << rulesDir << ": " << GetErrnoString(errno));
+        ThrowMsg(SmackException::FileError, "Cannot open rules directory: " << rulesDir);
+    }
+
+    size_t files = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir.get())) != nullptr) {
+        if (!isRulesFileName(entry->d_name))
+            continue;
+        SmackRules rules;
+        rules.loadFromFile(rulesDir + "/" + entry->d_name);
+        rules.apply();
+        ++files;
+    }
+    LogInfo("Loaded Smack rules from " << files << " files in " << rulesDir);
+}
+
+} // namespace SecurityManager
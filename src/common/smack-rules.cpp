@@ -31,11 +31,17 @@
 #include <fstream>
 #include <cstring>
 #include <sstream>
+#include <functional>
 #include <memory>
+#include <mutex>
+#include <set>
+#include <utility>
 
 #include <dpl/log/log.h>
 #include <tzplatform_config.h>
 
+#include "privilege_db.h"
+#include "smack-backend.h"
 #include "smack-labels.h"
 #include "smack-rules.h"
 
@@ -46,99 +52,458 @@ const char *const SMACK_PKG_LABEL_TEMPLATE     = "~PKG~";
 const char *const APP_RULES_TEMPLATE_FILE_PATH = tzplatform_mkpath4(TZ_SYS_SHARE, "security-manager", "policy", "app-rules-template.smack");
 const char *const SMACK_APP_IN_PACKAGE_PERMS   = "rwxat";
 
-SmackRules::SmackRules()
+namespace {
+
+/* Access letters accepted by the kernel, "-" stands for no access */
+const char *const SMACK_ACCESS_CODES = "rwxatlbRWXATLB-";
+
+/* Database updates of Smack rules, done in one transaction */
+void inTransaction(const std::function<void()> &update)
 {
-    if (smack_accesses_new(&m_handle) < 0) {
-        LogError("Failed to create smack_accesses handle");
-        throw std::bad_alloc();
+    PrivilegeDb::getInstance().BeginTransaction();
+    try {
+        update();
+        PrivilegeDb::getInstance().CommitTransaction();
+    } catch (...) {
+        PrivilegeDb::getInstance().RollbackTransaction();
+        throw;
     }
 }
 
-SmackRules::~SmackRules() {
-    smack_accesses_free(m_handle);
+void checkRule(const std::string &subject, const std::string &object,
+        const std::string &access)
+{
+    if (smack_label_length(subject.c_str()) <= 0 || smack_label_length(object.c_str()) <= 0 ||
+        access.find_first_not_of(SMACK_ACCESS_CODES) != std::string::npos)
+        ThrowMsg(SmackException::LibsmackError, "Invalid Smack rule: " << subject << " " <<
+            object << " " << access);
+}
+
+/* Renames and removals of rule files in the current batch are synced when
+ * it ends. Files replaced in the batch wait in their temporary files until
+ * then, to be synced all at once before they are renamed. */
+std::mutex batchMutex;
+unsigned batchDepth = 0;
+std::set<std::string> unsyncedDirs;
+std::set<std::string> pendingRenames;
+
+std::string dirName(const std::string &path)
+{
+    size_t slash = path.rfind('/');
+    if (slash == std::string::npos)
+        return ".";
+    return slash ? path.substr(0, slash) : "/";
+}
+
+/* Hidden, so that it's not taken for a rules file by the rules store */
+std::string tempPath(const std::string &path)
+{
+    size_t name = path.rfind('/') + 1;
+    return path.substr(0, name) + "." + path.substr(name) + ".tmp";
+}
+
+/* Path with the current contents of the rules file, also in a batch */
+std::string currentPath(const std::string &path)
+{
+    std::lock_guard<std::mutex> lock(batchMutex);
+    return pendingRenames.count(path) ? tempPath(path) : path;
+}
+
+/* Remove the rules file with its pending replacement, false with errno set
+ * on error */
+bool unlinkRulesFile(const std::string &path)
+{
+    bool pending;
+    {
+        std::lock_guard<std::mutex> lock(batchMutex);
+        pending = pendingRenames.erase(path) != 0;
+    }
+
+    if (pending && unlink(tempPath(path).c_str()) == -1 && errno != ENOENT)
+        return false;
+    // File created in the batch is only in its temporary file
+    return unlink(path.c_str()) == 0 || (pending && errno == ENOENT);
+}
+
+/* One syncfs() per file system of the files, false on error */
+bool syncFileSystems(const std::set<std::string> &paths)
+{
+    std::set<dev_t> synced;
+    for (const auto &path : paths) {
+        std::string dir = dirName(path);
+        int fd = TEMP_FAILURE_RETRY(open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+        if (fd == -1) {
+            LogError("Failed to open directory: " << dir << ", error: " << strerror(errno));
+            return false;
+        }
+
+        struct stat st;
+        bool ok = fstat(fd, &st) == 0;
+        if (ok && synced.insert(st.st_dev).second)
+            ok = syncfs(fd) == 0;
+        if (!ok)
+            LogError("Failed to sync file system of: " << dir << ", error: " << strerror(errno));
+        close(fd);
+        if (!ok)
+            return false;
+    }
+    return true;
+}
+
+void syncDir(const std::string &dir)
+{
+    int fd = TEMP_FAILURE_RETRY(open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+    if (fd == -1) {
+        LogError("Failed to open directory: " << dir << ", error: " << strerror(errno));
+        ThrowMsg(SmackException::FileError, "Failed to open directory: " << dir);
+    }
+
+    if (fsync(fd) == -1) {
+        LogError("Failed to sync directory: " << dir << ", error: " << strerror(errno));
+        close(fd);
+        ThrowMsg(SmackException::FileError, "Failed to sync directory: " << dir);
+    }
+    close(fd);
+}
+
+/* Write the whole buffer, false with errno set on error */
+bool writeAll(int fd, const std::string &data)
+{
+    size_t done = 0;
+    while (done < data.size()) {
+        ssize_t ret = TEMP_FAILURE_RETRY(write(fd, data.data() + done, data.size() - done));
+        if (ret == -1)
+            return false;
+        done += ret;
+    }
+    return true;
+}
+
+} // namespace anonymous
+
+SmackRules::SmackRules()
+{
+}
+
+SmackRules::~SmackRules()
+{
 }
 
 void SmackRules::add(const std::string &subject, const std::string &object,
         const std::string &permissions)
 {
-    if (smack_accesses_add(m_handle, subject.c_str(), object.c_str(), permissions.c_str()))
-        ThrowMsg(SmackException::LibsmackError, "smack_accesses_add");
+    checkRule(subject, object, permissions);
+    m_rules.push_back(SmackRule{subject, object, permissions.empty() ? "-" : permissions});
 }
 
 void SmackRules::addModify(const std::string &subject, const std::string &object,
         const std::string &allowPermissions, const std::string &denyPermissions)
 {
-    if (smack_accesses_add_modify(m_handle, subject.c_str(), object.c_str(), allowPermissions.c_str(), denyPermissions.c_str()))
-        ThrowMsg(SmackException::LibsmackError, "smack_accesses_add_modify");
+    checkRule(subject, object, allowPermissions);
+    checkRule(subject, object, denyPermissions);
+    m_modifications.push_back(SmackRuleModification{subject, object,
+        allowPermissions.empty() ? "-" : allowPermissions,
+        denyPermissions.empty() ? "-" : denyPermissions});
+}
+
+const std::vector<SmackRule> &SmackRules::getRules() const
+{
+    return m_rules;
+}
+
+const std::vector<SmackRuleModification> &SmackRules::getModifications() const
+{
+    return m_modifications;
 }
 
 void SmackRules::clear() const
 {
-    if (smack_accesses_clear(m_handle))
-        ThrowMsg(SmackException::LibsmackError, "smack_accesses_clear");
+    SmackBackend::get().clear(*this);
 }
 
 void SmackRules::apply() const
 {
-    if (smack_accesses_apply(m_handle))
-        ThrowMsg(SmackException::LibsmackError, "smack_accesses_apply");
-
+    SmackBackend::get().apply(*this);
 }
 
 void SmackRules::loadFromFile(const std::string &path)
 {
-    int fd;
-
-    fd = TEMP_FAILURE_RETRY(open(path.c_str(), O_RDONLY));
-    if (fd == -1) {
+    std::ifstream rulesFile(currentPath(path));
+    if (!rulesFile.is_open()) {
         LogError("Failed to open file: " << path);
         ThrowMsg(SmackException::FileError, "Failed to open file: " << path);
     }
 
-    if (smack_accesses_add_from_file(m_handle, fd)) {
-        LogError("Failed to load smack rules from file: " << path);
-        ThrowMsg(SmackException::LibsmackError, "Failed to load smack rules from file: " << path);
+    // "subject object access" rules and "subject object allow deny" modifications
+    std::string line;
+    while (std::getline(rulesFile, line)) {
+        std::stringstream stream(line);
+        std::vector<std::string> fields;
+        std::string field;
+        while (stream >> field)
+            fields.push_back(std::move(field));
+
+        if (fields.size() == 3)
+            add(fields[0], fields[1], fields[2]);
+        else if (fields.size() == 4)
+            addModify(fields[0], fields[1], fields[2], fields[3]);
+        else if (!fields.empty()) {
+            LogError("Failed to load smack rules from file: " << path);
+            ThrowMsg(SmackException::LibsmackError, "Failed to load smack rules from file: " << path);
+        }
     }
 
-    if (close(fd) == -1) {
-        // don't change the return code, the descriptor should be closed despite the error.
-        LogWarning("Error while closing the file: " << path << ", error: " << strerror(errno));
+    if (rulesFile.bad()) {
+        LogError("Error reading rules file: " << path);
+        ThrowMsg(SmackException::FileError, "Error reading rules file: " << path);
     }
 }
 
 void SmackRules::saveToFile(const std::string &path) const
 {
-    int fd;
+    writeToFile(path, false);
+}
+
+void SmackRules::appendToFile(const std::string &path) const
+{
+    writeToFile(path, true);
+}
+
+void SmackRules::writeToFile(const std::string &path, bool append) const
+{
+    std::string data;
+    if (append) {
+        std::ifstream rulesFile(currentPath(path));
+        if (rulesFile.is_open()) {
+            std::stringstream contents;
+            contents << rulesFile.rdbuf();
+            if (rulesFile.bad()) {
+                LogError("Error reading rules file: " << path);
+                ThrowMsg(SmackException::FileError, "Error reading rules file: " << path);
+            }
+            data = contents.str();
+        }
+    }
+
+    for (const auto &rule : m_rules)
+        data += rule.subject + " " + rule.object + " " + rule.access + "\n";
+    for (const auto &modification : m_modifications)
+        data += modification.subject + " " + modification.object + " " +
+            modification.allow + " " + modification.deny + "\n";
+
+    replaceRulesFile(path, data);
+}
 
-    fd = TEMP_FAILURE_RETRY(open(path.c_str(), O_CREAT | O_WRONLY | O_TRUNC, 0644));
+void SmackRules::replaceRulesFile(const std::string &path, const std::string &data)
+{
+    // In a batch the file is renamed by flushBatch(), the lock keeps the
+    // batch from ending before the file is added to it
+    std::unique_lock<std::mutex> lock(batchMutex);
+    bool batched = batchDepth != 0;
+    if (!batched)
+        lock.unlock();
+
+    std::string tmpPath = tempPath(path);
+    int fd = TEMP_FAILURE_RETRY(open(tmpPath.c_str(),
+        O_CREAT | O_WRONLY | O_TRUNC | O_CLOEXEC, 0644));
     if (fd == -1) {
-        LogError("Failed to create file: " << path);
-        ThrowMsg(SmackException::FileError, "Failed to create file: " << path);
+        LogError("Failed to create file: " << tmpPath);
+        ThrowMsg(SmackException::FileError, "Failed to create file: " << tmpPath);
+    }
+
+    // Data must reach the disk before the rename does, in a batch together
+    // with the other files. Otherwise a crash could leave an empty or
+    // truncated file in place of the old one.
+    if (!writeAll(fd, data) || (!batched && fdatasync(fd) == -1)) {
+        LogError("Failed to save rules to file: " << tmpPath << ", error: " << strerror(errno));
+        close(fd);
+        unlink(tmpPath.c_str());
+        // Replacement from earlier in the batch is lost with the file
+        if (batched)
+            pendingRenames.erase(path);
+        ThrowMsg(SmackException::FileError, "Failed to save rules to file: " << tmpPath);
+    }
+
+    if (close(fd) == -1 && errno == EIO) {
+        LogError("I/O Error occured while closing the file: " << tmpPath << ", error: " << strerror(errno));
+        unlink(tmpPath.c_str());
+        if (batched)
+            pendingRenames.erase(path);
+        ThrowMsg(SmackException::FileError, "I/O Error occured while closing the file: " << tmpPath);
+    }
+
+    if (batched) {
+        pendingRenames.insert(path);
+        return;
+    }
+
+    if (rename(tmpPath.c_str(), path.c_str()) == -1) {
+        LogError("Failed to rename " << tmpPath << " to " << path << ", error: " << strerror(errno));
+        unlink(tmpPath.c_str());
+        ThrowMsg(SmackException::FileError, "Failed to rename file: " << tmpPath);
+    }
+
+    syncRulesDir(path);
+}
+
+void SmackRules::syncRulesDir(const std::string &path)
+{
+    std::string dir = dirName(path);
+    {
+        std::lock_guard<std::mutex> lock(batchMutex);
+        if (batchDepth) {
+            unsyncedDirs.insert(dir);
+            return;
+        }
     }
+    syncDir(dir);
+}
 
-    if (smack_accesses_save(m_handle, fd)) {
-        LogError("Failed to save rules to file: " << path);
-        unlink(path.c_str());
-        ThrowMsg(SmackException::LibsmackError, "Failed to save rules to file: " << path);
+void SmackRules::beginBatch()
+{
+    std::lock_guard<std::mutex> lock(batchMutex);
+    ++batchDepth;
+}
+
+void SmackRules::flushBatch()
+{
+    std::set<std::string> dirs;
+    std::set<std::string> renames;
+    {
+        std::lock_guard<std::mutex> lock(batchMutex);
+        if (batchDepth && !--batchDepth) {
+            dirs.swap(unsyncedDirs);
+            renames.swap(pendingRenames);
+        }
     }
 
-    if (close(fd) == -1) {
-        if (errno == EIO) {
-            LogError("I/O Error occured while closing the file: " << path << ", error: " << strerror(errno));
-            unlink(path.c_str());
-            ThrowMsg(SmackException::FileError, "I/O Error occured while closing the file: " << path << ", error: " << strerror(errno));
-        } else {
-            // non critical error
-            // don't change the return code, the descriptor should be closed despite the error.
-            LogWarning("Error while closing the file: " << path << ", error: " << strerror(errno));
+    // All replaced files reach the disk at once, before any of them is
+    // renamed over the old one
+    std::string failedPath;
+    bool synced = renames.empty() || syncFileSystems(renames);
+    for (const auto &path : renames) {
+        std::string tmpPath = tempPath(path);
+        if (!synced) {
+            unlink(tmpPath.c_str());
+            failedPath = path;
+        } else if (rename(tmpPath.c_str(), path.c_str()) == -1) {
+            LogError("Failed to rename " << tmpPath << " to " << path << ", error: " << strerror(errno));
+            unlink(tmpPath.c_str());
+            failedPath = path;
+        } else
+            dirs.insert(dirName(path));
+    }
+
+    for (const auto &dir : dirs) {
+        try {
+            syncDir(dir);
+        } catch (const SmackException::Base &e) {
+            failedPath = dir;
         }
     }
+    if (!dirs.empty())
+        LogDebug("Synced " << renames.size() << " Smack rule files in " << dirs.size() <<
+            " directories");
+
+    if (!failedPath.empty())
+        ThrowMsg(SmackException::FileError,
+            "Changes of Smack rule files in " << failedPath << " may not be on disk");
 }
 
 
 void SmackRules::addFromTemplateFile(const std::string &appId,
         const std::string &pkgId)
 {
+    SmackRulesTemplate::getAppRulesTemplate()->expand(*this, appId, pkgId);
+}
+
+void SmackRules::addFromTemplate(const std::vector<std::string> &templateRules,
+        const std::string &appId, const std::string &pkgId)
+{
+    SmackRulesTemplate(templateRules).expand(*this, appId, pkgId);
+}
+
+SmackRulesTemplate::SmackRulesTemplate(const std::vector<std::string> &templateRules)
+    : m_usesAppLabel(false)
+    , m_usesPkgLabel(false)
+{
+    m_rules.reserve(templateRules.size());
+    for (const auto &line : templateRules) {
+        if (line.empty())
+            continue;
+
+        std::stringstream stream(line);
+        Rule rule;
+        stream >> rule.subject >> rule.object >> rule.permissions;
+
+        if (stream.fail() || !stream.eof()) {
+            LogError("Invalid rule template: " << line);
+            ThrowMsg(SmackException::FileError, "Invalid rule template: " << line);
+        }
+
+        rule.subjectType = parseLabel(rule.subject);
+        rule.objectType = parseLabel(rule.object);
+        m_usesAppLabel |= rule.subjectType == Label::APP || rule.objectType == Label::APP;
+        m_usesPkgLabel |= rule.subjectType == Label::PKG || rule.objectType == Label::PKG;
+        m_rules.push_back(std::move(rule));
+    }
+}
+
+SmackRulesTemplate::Label SmackRulesTemplate::parseLabel(const std::string &label)
+{
+    if (label == SMACK_APP_LABEL_TEMPLATE)
+        return Label::APP;
+    if (label == SMACK_PKG_LABEL_TEMPLATE)
+        return Label::PKG;
+    return Label::LITERAL;
+}
+
+void SmackRulesTemplate::expand(SmackRules &rules, const std::string &appId,
+        const std::string &pkgId) const
+{
+    std::string appLabel, pkgLabel;
+    if (m_usesAppLabel)
+        appLabel = SmackLabels::generateAppLabel(appId);
+    if (m_usesPkgLabel)
+        pkgLabel = SmackLabels::generatePkgLabel(pkgId);
+
+    auto label = [&](Label type, const std::string &literal) -> const std::string & {
+        switch (type) {
+        case Label::APP:
+            return appLabel;
+        case Label::PKG:
+            return pkgLabel;
+        default:
+            return literal;
+        }
+    };
+
+    for (const auto &rule : m_rules)
+        rules.add(label(rule.subjectType, rule.subject),
+            label(rule.objectType, rule.object), rule.permissions);
+}
+
+std::shared_ptr<const SmackRulesTemplate> SmackRulesTemplate::getAppRulesTemplate()
+{
+    static std::mutex mutex;
+    static std::shared_ptr<const SmackRulesTemplate> parsed;
+    static struct stat parsedStat;
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    // Checked before reading, a modification during reading is caught next time
+    struct stat st;
+    if (stat(APP_RULES_TEMPLATE_FILE_PATH, &st) == -1) {
+        LogError("Cannot access rules template file: " << APP_RULES_TEMPLATE_FILE_PATH);
+        ThrowMsg(SmackException::FileError, "Cannot access rules template file: " << APP_RULES_TEMPLATE_FILE_PATH);
+    }
+
+    if (parsed && st.st_dev == parsedStat.st_dev && st.st_ino == parsedStat.st_ino &&
+        st.st_size == parsedStat.st_size &&
+        st.st_mtim.tv_sec == parsedStat.st_mtim.tv_sec &&
+        st.st_mtim.tv_nsec == parsedStat.st_mtim.tv_nsec)
+        return parsed;
+
     std::vector<std::string> templateRules;
     std::string line;
     std::ifstream templateRulesFile(APP_RULES_TEMPLATE_FILE_PATH);
@@ -157,116 +522,198 @@ void SmackRules::addFromTemplateFile(const std::string &appId,
         ThrowMsg(SmackException::FileError, "Error reading template file: " << APP_RULES_TEMPLATE_FILE_PATH);
     }
 
-    addFromTemplate(templateRules, appId, pkgId);
+    parsed = std::make_shared<const SmackRulesTemplate>(templateRules);
+    parsedStat = st;
+    LogDebug("Parsed " << parsed->m_rules.size() << " rules from template file: " <<
+        APP_RULES_TEMPLATE_FILE_PATH);
+    return parsed;
 }
 
-void SmackRules::addFromTemplate(const std::vector<std::string> &templateRules,
-        const std::string &appId, const std::string &pkgId)
+void SmackRules::generatePackageCrossDeps(const std::vector<std::string> &pkgContents)
 {
-    for (auto rule : templateRules) {
-        if (rule.empty())
-            continue;
+    LogDebug ("Generating cross-package rules");
 
-        std::stringstream stream(rule);
-        std::string subject, object, permissions;
-        stream >> subject >> object >> permissions;
+    std::string appsInPackagePerms = SMACK_APP_IN_PACKAGE_PERMS;
+    std::vector<std::string> labels;
+    labels.reserve(pkgContents.size());
+    for (const auto &appId : pkgContents)
+        labels.push_back(SmackLabels::generateAppLabel(appId));
+
+    for (size_t subject = 0; subject < labels.size(); ++subject) {
+        for (size_t object = 0; object < labels.size(); ++object) {
+            if (pkgContents[object] == pkgContents[subject])
+                continue;
 
-        if (stream.fail() || !stream.eof()) {
-            LogError("Invalid rule template: " << rule);
-            ThrowMsg(SmackException::FileError, "Invalid rule template: " << rule);
+            LogDebug ("Trying to add rule subject: " << labels[subject] << " object: " << labels[object] << " perms: " << appsInPackagePerms);
+            add(labels[subject], labels[object], appsInPackagePerms);
         }
-
-        if (subject == SMACK_APP_LABEL_TEMPLATE)
-            subject = SmackLabels::generateAppLabel(appId);
-
-        if (subject == SMACK_PKG_LABEL_TEMPLATE)
-             subject = SmackLabels::generatePkgLabel(pkgId);
-
-        if (object == SMACK_APP_LABEL_TEMPLATE)
-            object = SmackLabels::generateAppLabel(appId);
-
-        if (object == SMACK_PKG_LABEL_TEMPLATE)
-            object = SmackLabels::generatePkgLabel(pkgId);
-
-        add(subject, object, permissions);
     }
 }
 
-void SmackRules::generatePackageCrossDeps(const std::vector<std::string> &pkgContents)
+void SmackRules::generateAppCrossDeps(const std::string &appId,
+        const std::vector<std::string> &pkgContents)
 {
-    LogDebug ("Generating cross-package rules");
+    LogDebug ("Generating cross-package rules for application " << appId);
 
-    std::string subjectLabel, objectLabel;
     std::string appsInPackagePerms = SMACK_APP_IN_PACKAGE_PERMS;
+    std::string appLabel = SmackLabels::generateAppLabel(appId);
+    for (const auto &other : pkgContents) {
+        if (other == appId)
+            continue;
 
-    for (const auto &subject : pkgContents) {
-        for (const auto &object : pkgContents) {
-            if (object == subject)
-                continue;
-
-            subjectLabel = SmackLabels::generateAppLabel(subject);
-            objectLabel = SmackLabels::generateAppLabel(object);
-            LogDebug ("Trying to add rule subject: " << subjectLabel << " object: " << objectLabel << " perms: " << appsInPackagePerms);
-            add(subjectLabel, objectLabel, appsInPackagePerms);
-        }
+        std::string otherLabel = SmackLabels::generateAppLabel(other);
+        add(appLabel, otherLabel, appsInPackagePerms);
+        add(otherLabel, appLabel, appsInPackagePerms);
     }
 }
 
-std::string SmackRules::getPackageRulesFilePath(const std::string &pkgId)
+std::string SmackRules::getPackageRulesName(const std::string &pkgId)
 {
-    std::string path(tzplatform_mkpath3(TZ_SYS_SMACK, "accesses.d", ("pkg_" + pkgId).c_str()));
-    return path;
+    return "pkg_" + pkgId;
 }
 
-std::string SmackRules::getApplicationRulesFilePath(const std::string &appId)
+std::string SmackRules::getApplicationRulesName(const std::string &appId)
 {
-    std::string path(tzplatform_mkpath3(TZ_SYS_SMACK, "accesses.d", ("app_" +  appId).c_str()));
+    return "app_" + appId;
+}
+
+std::string SmackRules::getRulesFilePath(const std::string &name)
+{
+    std::string path(tzplatform_mkpath3(TZ_SYS_SMACK, "accesses.d", name.c_str()));
     return path;
 }
 
 void SmackRules::installApplicationRules(const std::string &appId, const std::string &pkgId,
-        const std::vector<std::string> &pkgContents)
+        const std::vector<std::string> &pkgContents, bool newInPackage)
 {
+    // Rule files are synced once, after all of them are written
+    ScopedBatch batch;
     SmackRules smackRules;
-    std::string appPath = getApplicationRulesFilePath(appId);
+    std::string appName = getApplicationRulesName(appId);
+    std::string appPath = getRulesFilePath(appName);
 
     smackRules.addFromTemplateFile(appId, pkgId);
 
-    if (smack_smackfs_path() != NULL)
+    if (SmackBackend::get().hasPolicy())
         smackRules.apply();
 
     smackRules.saveToFile(appPath);
-    updatePackageRules(pkgId, pkgContents);
+
+    SmackRules crossRules;
+    crossRules.generateAppCrossDeps(appId, pkgContents);
+
+    if (SmackBackend::get().hasPolicy())
+        crossRules.apply();
+
+    std::string pkgName = getPackageRulesName(pkgId);
+    std::vector<SmackRule> unrecordedPkgRules;
+    if (newInPackage) {
+        std::string pkgPath = getRulesFilePath(pkgName);
+        // Package rules saved before they were recorded are recorded now, all at once
+        std::vector<SmackRule> pkgRules;
+        PrivilegeDb::getInstance().GetSmackRules(pkgName, pkgRules);
+        if (pkgRules.empty())
+            readRulesFile(pkgPath, unrecordedPkgRules);
+
+        crossRules.appendToFile(pkgPath);
+    }
+
+    inTransaction([&] {
+        replaceRecordedRules(appName, smackRules.getRules());
+        if (newInPackage) {
+            PrivilegeDb::getInstance().AddSmackRules(pkgName, unrecordedPkgRules);
+            PrivilegeDb::getInstance().AddSmackRules(pkgName, crossRules.getRules());
+        }
+    });
+
+    batch.flush();
 }
 
 void SmackRules::updatePackageRules(const std::string &pkgId, const std::vector<std::string> &pkgContents)
 {
     SmackRules smackRules;
-    std::string pkgPath = getPackageRulesFilePath(pkgId);
+    std::string pkgName = getPackageRulesName(pkgId);
+    std::string pkgPath = getRulesFilePath(pkgName);
 
     smackRules.generatePackageCrossDeps(pkgContents);
 
-    if (smack_smackfs_path() != NULL)
+    if (SmackBackend::get().hasPolicy())
         smackRules.apply();
 
     smackRules.saveToFile(pkgPath);
+
+    inTransaction([&] {
+        replaceRecordedRules(pkgName, smackRules.getRules());
+    });
 }
 
 void SmackRules::uninstallPackageRules(const std::string &pkgId)
 {
-    uninstallRules(getPackageRulesFilePath(pkgId));
+    uninstallRules(getPackageRulesName(pkgId));
 }
 
 void SmackRules::uninstallApplicationRules(const std::string &appId,
         const std::string &pkgId, std::vector<std::string> pkgContents)
 {
-    uninstallRules(getApplicationRulesFilePath(appId));
-    updatePackageRules(pkgId, pkgContents);
+    // Rule files are synced once, after all of them are written
+    ScopedBatch batch;
+    uninstallRules(getApplicationRulesName(appId));
+
+    std::string pkgName = getPackageRulesName(pkgId);
+    std::string appLabel = SmackLabels::generateAppLabel(appId);
+    if (!removeLabelRules(pkgName, appLabel)) {
+        // Package rules are not recorded, rules of the application follow from package contents
+        if (SmackBackend::get().hasPolicy()) {
+            SmackRules crossRules;
+            crossRules.generateAppCrossDeps(appId, pkgContents);
+            crossRules.clear();
+        }
+
+        removeLabelRulesFromFile(getRulesFilePath(pkgName), appLabel);
+    }
+
+    batch.flush();
+}
+
+void SmackRules::uninstallApplicationRules(const std::string &appId)
+{
+    uninstallRules(getApplicationRulesName(appId));
+}
+
+void SmackRules::uninstallRules(const std::string &name)
+{
+    std::string path = getRulesFilePath(name);
+    std::vector<SmackRule> recorded;
+    PrivilegeDb::getInstance().GetSmackRules(name, recorded);
+    if (recorded.empty()) {
+        // Installed before rules were recorded
+        uninstallRulesFile(path);
+        return;
+    }
+
+    if (SmackBackend::get().hasPolicy()) {
+        try {
+            SmackRules rules;
+            for (const auto &rule : recorded)
+                rules.add(rule.subject, rule.object, rule.access);
+            rules.clear();
+        } catch (const SmackException::Base &e) {
+            LogWarning("Failed to clear smack kernel rules of: " << name);
+            // don't stop uninstallation
+        }
+    }
+
+    if (!unlinkRulesFile(path) && errno != ENOENT) {
+        LogWarning("Failed to remove smack rules file: " << path);
+        ThrowMsg(SmackException::FileError, "Failed to remove smack rules file: " << path);
+    }
+    syncRulesDir(path);
+    PrivilegeDb::getInstance().RemoveSmackRules(name);
 }
 
-void SmackRules::uninstallRules(const std::string &path)
+void SmackRules::uninstallRulesFile(const std::string &path)
 {
-    if (access(path.c_str(), F_OK) == -1) {
+    if (access(currentPath(path).c_str(), F_OK) == -1) {
         if (errno == ENOENT) {
             LogWarning("Smack rules not found in file: " << path);
             return;
@@ -279,17 +726,131 @@ void SmackRules::uninstallRules(const std::string &path)
     try {
         SmackRules rules;
         rules.loadFromFile(path);
-        if (smack_smackfs_path())
+        if (SmackBackend::get().hasPolicy())
             rules.clear();
     } catch (const SmackException::Base &e) {
         LogWarning("Failed to clear smack kernel rules from file: " << path);
         // don't stop uninstallation
     }
 
-    if (unlink(path.c_str()) == -1) {
+    if (!unlinkRulesFile(path)) {
         LogWarning("Failed to remove smack rules file: " << path);
         ThrowMsg(SmackException::FileError, "Failed to remove smack rules file: " << path);
     }
+    syncRulesDir(path);
+}
+
+void SmackRules::removeLabelRulesFromFile(const std::string &path, const std::string &label)
+{
+    std::ifstream rulesFile(currentPath(path));
+    if (!rulesFile.is_open()) {
+        LogWarning("Smack rules not found in file: " << path);
+        return;
+    }
+
+    std::string kept;
+    std::string line;
+    size_t removed = 0;
+    while (std::getline(rulesFile, line)) {
+        size_t subjectEnd = line.find(' ');
+        size_t objectEnd = line.find(' ', subjectEnd + 1);
+        if (subjectEnd != std::string::npos && objectEnd != std::string::npos &&
+            (line.compare(0, subjectEnd, label) == 0 ||
+             line.compare(subjectEnd + 1, objectEnd - subjectEnd - 1, label) == 0)) {
+            ++removed;
+            continue;
+        }
+        kept += line;
+        kept += '\n';
+    }
+
+    if (rulesFile.bad()) {
+        LogError("Error reading rules file: " << path);
+        ThrowMsg(SmackException::FileError, "Error reading rules file: " << path);
+    }
+    rulesFile.close();
+
+    if (!removed)
+        return;
+    LogDebug("Removing " << removed << " rules of " << label << " from file: " << path);
+
+    replaceRulesFile(path, kept);
+}
+
+bool SmackRules::removeLabelRules(const std::string &name, const std::string &label)
+{
+    std::vector<SmackRule> revoked;
+    PrivilegeDb::getInstance().GetLabelSmackRules(name, label, revoked);
+    if (revoked.empty())
+        return false;
+
+    if (SmackBackend::get().hasPolicy()) {
+        SmackRules rules;
+        for (const auto &rule : revoked)
+            rules.add(rule.subject, rule.object, rule.access);
+        rules.clear();
+    }
+
+    std::vector<SmackRule> kept;
+    inTransaction([&] {
+        PrivilegeDb::getInstance().RemoveLabelSmackRules(name, label);
+        PrivilegeDb::getInstance().GetSmackRules(name, kept);
+    });
+    LogDebug("Removed " << revoked.size() << " rules of " << label << " from " << name);
+
+    std::string path = getRulesFilePath(name);
+    SmackRules keptRules;
+    for (const auto &rule : kept)
+        keptRules.add(rule.subject, rule.object, rule.access);
+    keptRules.saveToFile(path);
+    return true;
+}
+
+void SmackRules::replaceRecordedRules(const std::string &name, const std::vector<SmackRule> &rules)
+{
+    std::vector<SmackRule> recorded;
+    PrivilegeDb::getInstance().GetSmackRules(name, recorded);
+
+    // Kernel keeps one rule per subject and object, new access replaces the old one
+    std::set<std::pair<std::string, std::string>> kept;
+    for (const auto &rule : rules)
+        kept.emplace(rule.subject, rule.object);
+
+    SmackRules revoked;
+    for (const auto &rule : recorded)
+        if (!kept.count(std::make_pair(rule.subject, rule.object)))
+            revoked.add(rule.subject, rule.object, rule.access);
+
+    if (!revoked.getRules().empty()) {
+        LogDebug("Revoking " << revoked.getRules().size() << " rules of " << name);
+        if (SmackBackend::get().hasPolicy())
+            revoked.clear();
+    }
+
+    PrivilegeDb::getInstance().RemoveSmackRules(name);
+    PrivilegeDb::getInstance().AddSmackRules(name, rules);
+}
+
+void SmackRules::readRulesFile(const std::string &path, std::vector<SmackRule> &rules)
+{
+    std::ifstream rulesFile(currentPath(path));
+    if (!rulesFile.is_open())
+        return;
+
+    std::string line;
+    while (std::getline(rulesFile, line)) {
+        std::stringstream stream(line);
+        SmackRule rule;
+        stream >> rule.subject >> rule.object >> rule.access;
+        if (!stream.fail())
+            rules.push_back(std::move(rule));
+    }
+
+    if (rulesFile.bad()) {
+        LogError("Error reading rules file: " << path);
+        ThrowMsg(SmackException::FileError, "Error reading rules file: " << path);
+    }
+    LogDebug("Read " << rules.size() << " unrecorded rules from file: " << path);
 }
 
 } // namespace SecurityManager
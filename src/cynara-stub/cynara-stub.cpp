@@ -0,0 +1,678 @@
+/*
+ *  Copyright (c) 2014 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *  Contact: Rafal Krypa <r.krypa@samsung.com>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License
+ */
+/*
+ * @file        cynara-stub.cpp
+ * @brief       In-process stand-in for Cynara service
+ *
+ * Implements the part of Cynara client, asynchronous client and
+ * administrative APIs used by Security Manager, keeping buckets in memory
+ * of the calling process. Policies are evaluated like in Cynara: the most
+ * restrictive of matching policies wins, bucket links are followed and
+ * default policy of a bucket applies when nothing in it matches.
+ * Plugins and client side caches are not supported.
+ */
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <new>
+#include <set>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include <cynara-admin.h>
+#include <cynara-client.h>
+#include <cynara-client-async.h>
+#include <cynara-stub.h>
+
+struct cynara {
+};
+
+struct cynara_admin {
+};
+
+namespace {
+
+typedef std::tuple<std::string, std::string, std::string> PolicyKey;
+
+struct Policy {
+    int result;
+    std::string resultExtra;
+};
+
+struct Bucket {
+    int defaultResult;
+    std::map<PolicyKey, Policy> policies;
+};
+
+/* Limit of bucket links followed during a check */
+const unsigned MAX_BUCKET_DEPTH = 32;
+
+/* Limit of asynchronous requests waiting for cynara_async_process() */
+const size_t MAX_PENDING_REQUESTS = 1024;
+
+const std::string WILDCARD(CYNARA_ADMIN_WILDCARD);
+
+class Storage {
+public:
+    static Storage &getInstance()
+    {
+        static Storage storage;
+        return storage;
+    }
+
+    void reset()
+    {
+        m_buckets.clear();
+        m_buckets[CYNARA_ADMIN_DEFAULT_BUCKET] = Bucket{CYNARA_ADMIN_DENY, {}};
+    }
+
+    Bucket *findBucket(const std::string &name)
+    {
+        auto it = m_buckets.find(name);
+        return it == m_buckets.end() ? nullptr : &it->second;
+    }
+
+    std::map<std::string, Bucket> &buckets()
+    {
+        return m_buckets;
+    }
+
+    int check(const Bucket &bucket, const std::string &client, const std::string &user,
+        const std::string &privilege, bool recursive, std::string &resultExtra,
+        unsigned depth = 0)
+    {
+        const std::string *clients[] = {&client, &WILDCARD};
+        const std::string *users[] = {&user, &WILDCARD};
+        const std::string *privileges[] = {&privilege, &WILDCARD};
+        bool matched = false;
+        int minimal = bucket.defaultResult;
+        resultExtra.clear();
+
+        for (const std::string *c : clients)
+            for (const std::string *u : users)
+                for (const std::string *p : privileges) {
+                    auto it = bucket.policies.find(PolicyKey(*c, *u, *p));
+                    if (it == bucket.policies.end())
+                        continue;
+
+                    int result = it->second.result;
+                    std::string extra = it->second.resultExtra;
+                    if (result == CYNARA_ADMIN_BUCKET && recursive) {
+                        const Bucket *next = findBucket(extra);
+                        if (!next || depth >= MAX_BUCKET_DEPTH)
+                            continue;
+                        result = check(*next, client, user, privilege, true, extra,
+                            depth + 1);
+                    }
+                    if (result == CYNARA_ADMIN_NONE)
+                        continue;
+
+                    if (!matched || result < minimal) {
+                        minimal = result;
+                        resultExtra = extra;
+                    }
+                    matched = true;
+                }
+
+        return minimal;
+    }
+
+    int clientCheck(const std::string &client, const std::string &user,
+        const std::string &privilege)
+    {
+        std::string extra;
+        int result = check(m_buckets.at(CYNARA_ADMIN_DEFAULT_BUCKET), client, user,
+            privilege, true, extra);
+        return result == CYNARA_ADMIN_ALLOW ? CYNARA_API_ACCESS_ALLOWED : CYNARA_API_ACCESS_DENIED;
+    }
+
+    std::mutex m_mutex;
+
+private:
+    Storage()
+    {
+        reset();
+    }
+
+    std::map<std::string, Bucket> m_buckets;
+};
+
+unsigned int initialLatency()
+{
+    const char *env = getenv("CYNARA_STUB_LATENCY_US");
+    return env ? static_cast<unsigned int>(strtoul(env, nullptr, 10)) : 0;
+}
+
+std::atomic<unsigned int> &latency()
+{
+    static std::atomic<unsigned int> value(initialLatency());
+    return value;
+}
+
+/* Model the cost of a request sent to Cynara service and its answer */
+void roundTrip()
+{
+    unsigned int usec = latency();
+    if (usec)
+        std::this_thread::sleep_for(std::chrono::microseconds(usec));
+}
+
+bool filterMatches(const char *filter, const std::string &value)
+{
+    return !strcmp(filter, CYNARA_ADMIN_ANY) || value == filter;
+}
+
+int tryCatch(const std::function<int()> &func)
+{
+    try {
+        return func();
+    } catch (const std::bad_alloc &) {
+        return CYNARA_API_OUT_OF_MEMORY;
+    } catch (...) {
+        return CYNARA_API_UNKNOWN_ERROR;
+    }
+}
+
+} // namespace anonymous
+
+struct cynara_async {
+    struct Request {
+        std::string client;
+        std::string user;
+        std::string privilege;
+        cynara_response_callback callback;
+        void *data;
+    };
+
+    int fd;
+    cynara_async_status status;
+    cynara_status_callback statusCallback;
+    void *statusData;
+    cynara_check_id nextId;
+    std::map<cynara_check_id, Request> pending;
+
+    void setStatus(cynara_async_status newStatus)
+    {
+        if (status == newStatus)
+            return;
+        status = newStatus;
+        if (statusCallback)
+            statusCallback(fd, fd, status, statusData);
+    }
+};
+
+void cynara_stub_set_latency(unsigned int usec)
+{
+    latency() = usec;
+}
+
+void cynara_stub_reset(void)
+{
+    Storage &storage = Storage::getInstance();
+    std::lock_guard<std::mutex> lock(storage.m_mutex);
+    storage.reset();
+}
+
+int cynara_initialize(struct cynara **pp_cynara, const struct cynara_configuration *)
+{
+    if (!pp_cynara)
+        return CYNARA_API_INVALID_PARAM;
+
+    *pp_cynara = new (std::nothrow) cynara;
+    return *pp_cynara ? CYNARA_API_SUCCESS : CYNARA_API_OUT_OF_MEMORY;
+}
+
+int cynara_finish(struct cynara *p_cynara)
+{
+    delete p_cynara;
+    return CYNARA_API_SUCCESS;
+}
+
+int cynara_check(struct cynara *p_cynara, const char *client, const char *,
+    const char *user, const char *privilege)
+{
+    if (!p_cynara || !client || !user || !privilege)
+        return CYNARA_API_INVALID_PARAM;
+
+    return tryCatch([&] {
+        roundTrip();
+        Storage &storage = Storage::getInstance();
+        std::lock_guard<std::mutex> lock(storage.m_mutex);
+        return storage.clientCheck(client, user, privilege);
+    });
+}
+
+int cynara_async_initialize(struct cynara_async **pp_cynara,
+    const struct cynara_async_configuration *, cynara_status_callback callback,
+    void *user_status_data)
+{
+    if (!pp_cynara)
+        return CYNARA_API_INVALID_PARAM;
+
+    int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (fd < 0)
+        return CYNARA_API_UNKNOWN_ERROR;
+
+    cynara_async *p_cynara = new (std::nothrow) cynara_async;
+    if (!p_cynara) {
+        close(fd);
+        return CYNARA_API_OUT_OF_MEMORY;
+    }
+
+    p_cynara->fd = fd;
+    p_cynara->status = CYNARA_STATUS_FOR_READ;
+    p_cynara->statusCallback = callback;
+    p_cynara->statusData = user_status_data;
+    p_cynara->nextId = 0;
+    if (callback)
+        callback(-1, fd, CYNARA_STATUS_FOR_READ, user_status_data);
+
+    *pp_cynara = p_cynara;
+    return CYNARA_API_SUCCESS;
+}
+
+void cynara_async_finish(struct cynara_async *p_cynara)
+{
+    if (!p_cynara)
+        return;
+
+    for (const auto &request : p_cynara->pending)
+        request.second.callback(request.first, CYNARA_CALL_CAUSE_FINISH, 0,
+            request.second.data);
+
+    if (p_cynara->statusCallback)
+        p_cynara->statusCallback(p_cynara->fd, -1, CYNARA_STATUS_FOR_READ,
+            p_cynara->statusData);
+    close(p_cynara->fd);
+    delete p_cynara;
+}
+
+int cynara_async_check_cache(struct cynara_async *p_cynara, const char *client,
+    const char *, const char *user, const char *privilege)
+{
+    if (!p_cynara || !client || !user || !privilege)
+        return CYNARA_API_INVALID_PARAM;
+
+    // The stand-in keeps no client side cache
+    return CYNARA_API_CACHE_MISS;
+}
+
+int cynara_async_create_request(struct cynara_async *p_cynara, const char *client,
+    const char *, const char *user, const char *privilege,
+    cynara_check_id *p_check_id, cynara_response_callback callback,
+    void *user_response_data)
+{
+    if (!p_cynara || !client || !user || !privilege || !p_check_id || !callback)
+        return CYNARA_API_INVALID_PARAM;
+
+    if (p_cynara->pending.size() >= MAX_PENDING_REQUESTS)
+        return CYNARA_API_MAX_PENDING_REQUESTS;
+
+    return tryCatch([&] {
+        while (p_cynara->pending.count(p_cynara->nextId))
+            ++p_cynara->nextId;
+
+        cynara_check_id checkId = p_cynara->nextId++;
+        p_cynara->pending[checkId] = cynara_async::Request{client, user, privilege,
+            callback, user_response_data};
+        *p_check_id = checkId;
+
+        eventfd_write(p_cynara->fd, 1);
+        p_cynara->setStatus(CYNARA_STATUS_FOR_RW);
+        return CYNARA_API_SUCCESS;
+    });
+}
+
+int cynara_async_process(struct cynara_async *p_cynara)
+{
+    if (!p_cynara)
+        return CYNARA_API_INVALID_PARAM;
+
+    eventfd_t value;
+    eventfd_read(p_cynara->fd, &value);
+    if (p_cynara->pending.empty())
+        return CYNARA_API_SUCCESS;
+
+    return tryCatch([&] {
+        // All pending requests are sent and answered in one round trip
+        roundTrip();
+        std::map<cynara_check_id, cynara_async::Request> requests;
+        requests.swap(p_cynara->pending);
+        p_cynara->setStatus(CYNARA_STATUS_FOR_READ);
+
+        std::vector<int> responses;
+        {
+            Storage &storage = Storage::getInstance();
+            std::lock_guard<std::mutex> lock(storage.m_mutex);
+            for (const auto &request : requests)
+                responses.push_back(storage.clientCheck(request.second.client,
+                    request.second.user, request.second.privilege));
+        }
+
+        // Callbacks may create new requests, storage must not be locked
+        auto response = responses.begin();
+        for (const auto &request : requests)
+            request.second.callback(request.first, CYNARA_CALL_CAUSE_ANSWER, *response++,
+                request.second.data);
+
+        return CYNARA_API_SUCCESS;
+    });
+}
+
+int cynara_async_cancel_request(struct cynara_async *p_cynara, cynara_check_id check_id)
+{
+    if (!p_cynara)
+        return CYNARA_API_INVALID_PARAM;
+
+    auto it = p_cynara->pending.find(check_id);
+    if (it == p_cynara->pending.end())
+        return CYNARA_API_INVALID_PARAM;
+
+    cynara_async::Request request = it->second;
+    p_cynara->pending.erase(it);
+    request.callback(check_id, CYNARA_CALL_CAUSE_CANCEL, 0, request.data);
+    return CYNARA_API_SUCCESS;
+}
+
+int cynara_admin_initialize(struct cynara_admin **pp_cynara_admin)
+{
+    if (!pp_cynara_admin)
+        return CYNARA_API_INVALID_PARAM;
+
+    *pp_cynara_admin = new (std::nothrow) cynara_admin;
+    return *pp_cynara_admin ? CYNARA_API_SUCCESS : CYNARA_API_OUT_OF_MEMORY;
+}
+
+int cynara_admin_finish(struct cynara_admin *p_cynara_admin)
+{
+    delete p_cynara_admin;
+    return CYNARA_API_SUCCESS;
+}
+
+int cynara_admin_set_policies(struct cynara_admin *p_cynara_admin,
+    const struct cynara_admin_policy *const *policies)
+{
+    if (!p_cynara_admin || !policies)
+        return CYNARA_API_INVALID_PARAM;
+
+    return tryCatch([&] {
+        roundTrip();
+        Storage &storage = Storage::getInstance();
+        std::lock_guard<std::mutex> lock(storage.m_mutex);
+
+        // Policies are validated first, set is applied completely or not at all
+        for (size_t i = 0; policies[i]; ++i) {
+            const cynara_admin_policy *policy = policies[i];
+            if (!policy->bucket || !policy->client || !policy->user || !policy->privilege)
+                return CYNARA_API_INVALID_PARAM;
+            if (!storage.findBucket(policy->bucket))
+                return CYNARA_API_BUCKET_NOT_FOUND;
+            if (policy->result == CYNARA_ADMIN_BUCKET &&
+                (!policy->result_extra || !storage.findBucket(policy->result_extra)))
+                return CYNARA_API_BUCKET_NOT_FOUND;
+        }
+
+        for (size_t i = 0; policies[i]; ++i) {
+            const cynara_admin_policy *policy = policies[i];
+            Bucket *bucket = storage.findBucket(policy->bucket);
+            PolicyKey key(policy->client, policy->user, policy->privilege);
+
+            if (policy->result == CYNARA_ADMIN_DELETE)
+                bucket->policies.erase(key);
+            else
+                bucket->policies[key] = Policy{policy->result,
+                    policy->result_extra ? policy->result_extra : ""};
+        }
+
+        return CYNARA_API_SUCCESS;
+    });
+}
+
+int cynara_admin_set_bucket(struct cynara_admin *p_cynara_admin, const char *bucket,
+    int operation, const char *)
+{
+    if (!p_cynara_admin || !bucket)
+        return CYNARA_API_INVALID_PARAM;
+
+    return tryCatch([&] {
+        roundTrip();
+        Storage &storage = Storage::getInstance();
+        std::lock_guard<std::mutex> lock(storage.m_mutex);
+        bool isDefault = !strcmp(bucket, CYNARA_ADMIN_DEFAULT_BUCKET);
+
+        switch (operation) {
+        case CYNARA_ADMIN_DELETE:
+            if (isDefault)
+                return CYNARA_API_OPERATION_NOT_ALLOWED;
+            if (!storage.buckets().erase(bucket))
+                return CYNARA_API_BUCKET_NOT_FOUND;
+            // Links to removed bucket are removed too
+            for (auto &other : storage.buckets()) {
+                auto &policies = other.second.policies;
+                for (auto it = policies.begin(); it != policies.end();) {
+                    if (it->second.result == CYNARA_ADMIN_BUCKET &&
+                        it->second.resultExtra == bucket)
+                        it = policies.erase(it);
+                    else
+                        ++it;
+                }
+            }
+            return CYNARA_API_SUCCESS;
+        case CYNARA_ADMIN_NONE:
+            if (isDefault)
+                return CYNARA_API_OPERATION_NOT_ALLOWED;
+            // fall through
+        case CYNARA_ADMIN_DENY:
+        case CYNARA_ADMIN_ALLOW:
+            storage.buckets()[bucket].defaultResult = operation;
+            return CYNARA_API_SUCCESS;
+        default:
+            return CYNARA_API_INVALID_PARAM;
+        }
+    });
+}
+
+int cynara_admin_check(struct cynara_admin *p_cynara_admin, const char *start_bucket,
+    const int recursive, const char *client, const char *user, const char *privilege,
+    int *result, char **result_extra)
+{
+    if (!p_cynara_admin || !start_bucket || !client || !user || !privilege ||
+        !result || !result_extra)
+        return CYNARA_API_INVALID_PARAM;
+
+    return tryCatch([&] {
+        roundTrip();
+        Storage &storage = Storage::getInstance();
+        std::lock_guard<std::mutex> lock(storage.m_mutex);
+
+        const Bucket *bucket = storage.findBucket(start_bucket);
+        if (!bucket)
+            return CYNARA_API_BUCKET_NOT_FOUND;
+
+        std::string extra;
+        *result = storage.check(*bucket, client, user, privilege, recursive, extra);
+        *result_extra = nullptr;
+        if (!extra.empty() && !(*result_extra = strdup(extra.c_str())))
+            return CYNARA_API_OUT_OF_MEMORY;
+
+        return CYNARA_API_SUCCESS;
+    });
+}
+
+static void freePolicies(struct cynara_admin_policy **policies)
+{
+    for (size_t i = 0; policies[i]; ++i) {
+        free(policies[i]->bucket);
+        free(policies[i]->client);
+        free(policies[i]->user);
+        free(policies[i]->privilege);
+        free(policies[i]->result_extra);
+        free(policies[i]);
+    }
+    free(policies);
+}
+
+int cynara_admin_list_policies(struct cynara_admin *p_cynara_admin, const char *bucket,
+    const char *client, const char *user, const char *privilege,
+    struct cynara_admin_policy ***policies)
+{
+    if (!p_cynara_admin || !bucket || !client || !user || !privilege || !policies)
+        return CYNARA_API_INVALID_PARAM;
+
+    return tryCatch([&] {
+        roundTrip();
+        Storage &storage = Storage::getInstance();
+        std::lock_guard<std::mutex> lock(storage.m_mutex);
+
+        const Bucket *found = storage.findBucket(bucket);
+        if (!found)
+            return CYNARA_API_BUCKET_NOT_FOUND;
+
+        std::vector<const std::pair<const PolicyKey, Policy> *> matching;
+        for (const auto &policy : found->policies)
+            if (filterMatches(client, std::get<0>(policy.first)) &&
+                filterMatches(user, std::get<1>(policy.first)) &&
+                filterMatches(privilege, std::get<2>(policy.first)))
+                matching.push_back(&policy);
+
+        auto list = static_cast<struct cynara_admin_policy **>(
+            calloc(matching.size() + 1, sizeof(struct cynara_admin_policy *)));
+        if (!list)
+            return CYNARA_API_OUT_OF_MEMORY;
+
+        for (size_t i = 0; i < matching.size(); ++i) {
+            auto policy = static_cast<struct cynara_admin_policy *>(
+                calloc(1, sizeof(struct cynara_admin_policy)));
+            list[i] = policy;
+            if (!policy) {
+                freePolicies(list);
+                return CYNARA_API_OUT_OF_MEMORY;
+            }
+
+            const auto &resultExtra = matching[i]->second.resultExtra;
+            policy->bucket = strdup(bucket);
+            policy->client = strdup(std::get<0>(matching[i]->first).c_str());
+            policy->user = strdup(std::get<1>(matching[i]->first).c_str());
+            policy->privilege = strdup(std::get<2>(matching[i]->first).c_str());
+            policy->result = matching[i]->second.result;
+            policy->result_extra = resultExtra.empty() ? nullptr : strdup(resultExtra.c_str());
+
+            if (!policy->bucket || !policy->client || !policy->user || !policy->privilege ||
+                (!resultExtra.empty() && !policy->result_extra)) {
+                freePolicies(list);
+                return CYNARA_API_OUT_OF_MEMORY;
+            }
+        }
+
+        *policies = list;
+        return CYNARA_API_SUCCESS;
+    });
+}
+
+int cynara_admin_erase(struct cynara_admin *p_cynara_admin, const char *start_bucket,
+    int recursive, const char *client, const char *user, const char *privilege)
+{
+    if (!p_cynara_admin || !start_bucket || !client || !user || !privilege)
+        return CYNARA_API_INVALID_PARAM;
+
+    return tryCatch([&] {
+        roundTrip();
+        Storage &storage = Storage::getInstance();
+        std::lock_guard<std::mutex> lock(storage.m_mutex);
+
+        if (!storage.findBucket(start_bucket))
+            return CYNARA_API_BUCKET_NOT_FOUND;
+
+        // Recursive erase visits all buckets linked from the start bucket
+        std::set<std::string> visited;
+        std::vector<std::string> toVisit(1, start_bucket);
+        while (!toVisit.empty()) {
+            std::string name = toVisit.back();
+            toVisit.pop_back();
+            Bucket *bucket = storage.findBucket(name);
+            if (!bucket || !visited.insert(name).second)
+                continue;
+
+            auto &policies = bucket->policies;
+            for (auto it = policies.begin(); it != policies.end();) {
+                if (recursive && it->second.result == CYNARA_ADMIN_BUCKET)
+                    toVisit.push_back(it->second.resultExtra);
+
+                if (filterMatches(client, std::get<0>(it->first)) &&
+                    filterMatches(user, std::get<1>(it->first)) &&
+                    filterMatches(privilege, std::get<2>(it->first)))
+                    it = policies.erase(it);
+                else
+                    ++it;
+            }
+        }
+
+        return CYNARA_API_SUCCESS;
+    });
+}
+
+int cynara_admin_list_policies_descriptions(struct cynara_admin *p_cynara_admin,
+    struct cynara_admin_policy_descr ***descriptions)
+{
+    if (!p_cynara_admin || !descriptions)
+        return CYNARA_API_INVALID_PARAM;
+
+    static const std::pair<int, const char *> predefined[] = {
+        {CYNARA_ADMIN_DENY, "Deny"},
+        {CYNARA_ADMIN_ALLOW, "Allow"},
+    };
+    const size_t count = sizeof(predefined) / sizeof(predefined[0]);
+
+    roundTrip();
+    auto list = static_cast<struct cynara_admin_policy_descr **>(
+        calloc(count + 1, sizeof(struct cynara_admin_policy_descr *)));
+    if (!list)
+        return CYNARA_API_OUT_OF_MEMORY;
+
+    for (size_t i = 0; i < count; ++i) {
+        auto descr = static_cast<struct cynara_admin_policy_descr *>(
+            malloc(sizeof(struct cynara_admin_policy_descr)));
+        char *name = strdup(predefined[i].second);
+        if (!descr || !name) {
+            free(descr);
+            free(name);
+            for (size_t j = 0; j < i; ++j) {
+                free(list[j]->name);
+                free(list[j]);
+            }
+            free(list);
+            return CYNARA_API_OUT_OF_MEMORY;
+        }
+        descr->result = predefined[i].first;
+        descr->name = name;
+        list[i] = descr;
+    }
+
+    *descriptions = list;
+    return CYNARA_API_SUCCESS;
+}
@@ -0,0 +1,60 @@
+/*
+ *  Copyright (c) 2014 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *  Contact: Rafal Krypa <r.krypa@samsung.com>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License
+ */
+/*
+ * @file        cynara-admin-types.h
+ * @brief       Cynara administrative API types, as defined by Cynara
+ */
+
+#ifndef _SECURITY_MANAGER_CYNARA_STUB_ADMIN_TYPES_
+#define _SECURITY_MANAGER_CYNARA_STUB_ADMIN_TYPES_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct cynara_admin_policy {
+    char *bucket;
+
+    char *client;
+    char *user;
+    char *privilege;
+
+    int result;
+    char *result_extra;
+};
+
+struct cynara_admin_policy_descr {
+    int result;
+    char *name;
+};
+
+#define CYNARA_ADMIN_WILDCARD "*"
+#define CYNARA_ADMIN_ANY "#"
+#define CYNARA_ADMIN_DEFAULT_BUCKET ""
+
+#define CYNARA_ADMIN_DELETE -1
+#define CYNARA_ADMIN_DENY 0
+#define CYNARA_ADMIN_NONE 1
+#define CYNARA_ADMIN_BUCKET 0xFFFE
+#define CYNARA_ADMIN_ALLOW 0xFFFF
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _SECURITY_MANAGER_CYNARA_STUB_ADMIN_TYPES_
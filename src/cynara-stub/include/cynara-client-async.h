@@ -0,0 +1,79 @@
+/*
+ *  Copyright (c) 2014 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *  Contact: Rafal Krypa <r.krypa@samsung.com>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License
+ */
+/*
+ * @file        cynara-client-async.h
+ * @brief       Subset of Cynara asynchronous client API implemented by the stand-in
+ */
+
+#ifndef _SECURITY_MANAGER_CYNARA_STUB_CLIENT_ASYNC_
+#define _SECURITY_MANAGER_CYNARA_STUB_CLIENT_ASYNC_
+
+#include <stdint.h>
+
+#include <cynara-error.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef uint16_t cynara_check_id;
+
+typedef enum {
+    CYNARA_STATUS_FOR_READ,
+    CYNARA_STATUS_FOR_RW
+} cynara_async_status;
+
+typedef enum {
+    CYNARA_CALL_CAUSE_ANSWER,
+    CYNARA_CALL_CAUSE_CANCEL,
+    CYNARA_CALL_CAUSE_FINISH,
+    CYNARA_CALL_CAUSE_SERVICE_NOT_AVAILABLE
+} cynara_async_call_cause;
+
+struct cynara_async;
+struct cynara_async_configuration;
+
+typedef void (*cynara_status_callback)(int old_fd, int new_fd, cynara_async_status status,
+    void *user_status_data);
+
+typedef void (*cynara_response_callback)(cynara_check_id check_id,
+    cynara_async_call_cause cause, int response, void *user_response_data);
+
+int cynara_async_initialize(struct cynara_async **pp_cynara,
+    const struct cynara_async_configuration *p_conf, cynara_status_callback callback,
+    void *user_status_data);
+
+void cynara_async_finish(struct cynara_async *p_cynara);
+
+int cynara_async_check_cache(struct cynara_async *p_cynara, const char *client,
+    const char *client_session, const char *user, const char *privilege);
+
+int cynara_async_create_request(struct cynara_async *p_cynara, const char *client,
+    const char *client_session, const char *user, const char *privilege,
+    cynara_check_id *p_check_id, cynara_response_callback callback,
+    void *user_response_data);
+
+int cynara_async_process(struct cynara_async *p_cynara);
+
+int cynara_async_cancel_request(struct cynara_async *p_cynara, cynara_check_id check_id);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _SECURITY_MANAGER_CYNARA_STUB_CLIENT_ASYNC_
@@ -0,0 +1,46 @@
+/*
+ *  Copyright (c) 2014 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *  Contact: Rafal Krypa <r.krypa@samsung.com>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License
+ */
+/*
+ * @file        cynara-client.h
+ * @brief       Subset of Cynara client API implemented by the stand-in
+ */
+
+#ifndef _SECURITY_MANAGER_CYNARA_STUB_CLIENT_
+#define _SECURITY_MANAGER_CYNARA_STUB_CLIENT_
+
+#include <cynara-error.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct cynara;
+struct cynara_configuration;
+
+int cynara_initialize(struct cynara **pp_cynara, const struct cynara_configuration *p_conf);
+
+int cynara_finish(struct cynara *p_cynara);
+
+int cynara_check(struct cynara *p_cynara, const char *client, const char *client_session,
+    const char *user, const char *privilege);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _SECURITY_MANAGER_CYNARA_STUB_CLIENT_
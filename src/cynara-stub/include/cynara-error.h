@@ -0,0 +1,40 @@
+/*
+ *  Copyright (c) 2014 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *  Contact: Rafal Krypa <r.krypa@samsung.com>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License
+ */
+/*
+ * @file        cynara-error.h
+ * @brief       Cynara API return codes, as defined by Cynara
+ */
+
+#ifndef _SECURITY_MANAGER_CYNARA_STUB_ERROR_
+#define _SECURITY_MANAGER_CYNARA_STUB_ERROR_
+
+#define CYNARA_API_ACCESS_ALLOWED           2
+#define CYNARA_API_ACCESS_DENIED            1
+#define CYNARA_API_SUCCESS                  0
+#define CYNARA_API_CACHE_MISS               -1
+#define CYNARA_API_MAX_PENDING_REQUESTS     -2
+#define CYNARA_API_OUT_OF_MEMORY            -3
+#define CYNARA_API_INVALID_PARAM            -4
+#define CYNARA_API_SERVICE_NOT_AVAILABLE    -5
+#define CYNARA_API_METHOD_NOT_SUPPORTED     -6
+#define CYNARA_API_OPERATION_NOT_ALLOWED    -7
+#define CYNARA_API_OPERATION_FAILED         -8
+#define CYNARA_API_BUCKET_NOT_FOUND         -9
+#define CYNARA_API_UNKNOWN_ERROR            -10
+
+#endif // _SECURITY_MANAGER_CYNARA_STUB_ERROR_
@@ -0,0 +1,50 @@
+/*
+ *  Copyright (c) 2014 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *  Contact: Rafal Krypa <r.krypa@samsung.com>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License
+ */
+/*
+ * @file        cynara-stub.h
+ * @brief       Control interface of the in-process Cynara stand-in
+ */
+
+#ifndef _SECURITY_MANAGER_CYNARA_STUB_
+#define _SECURITY_MANAGER_CYNARA_STUB_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Set artificial latency added to every call that would be a round trip
+ * to Cynara service. Asynchronous requests answered by one
+ * cynara_async_process() call share a single round trip.
+ * Initial value is taken from CYNARA_STUB_LATENCY_US environment variable.
+ *
+ * @param usec latency in microseconds
+ */
+void cynara_stub_set_latency(unsigned int usec);
+
+/**
+ * Drop all policies and buckets, leaving only the default bucket with
+ * DENY default policy, like a freshly installed Cynara.
+ */
+void cynara_stub_reset(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _SECURITY_MANAGER_CYNARA_STUB_
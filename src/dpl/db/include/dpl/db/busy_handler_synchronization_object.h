@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2014 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+/*
+ * @file        busy_handler_synchronization_object.h
+ * @version     1.0
+ * @brief       SQL synchronization object based on sqlite3_busy_handler
+ */
+#ifndef SECURITY_MANAGER_BUSY_HANDLER_SYNCHRONIZATION_OBJECT_H
+#define SECURITY_MANAGER_BUSY_HANDLER_SYNCHRONIZATION_OBJECT_H
+
+#include <atomic>
+#include <stdint.h>
+
+#include <dpl/db/sql_connection.h>
+
+namespace SecurityManager {
+namespace DB {
+/**
+ * Synchronization object waiting for a locked database inside of SQLite,
+ * using busy handler with bounded exponential backoff. Busy events and time
+ * spent waiting are counted.
+ *
+ * Synchronize() is called only when SQLite gives up without calling the
+ * handler (e.g. lock upgrade deadlock) or when the handler timed out,
+ * it backs off using the same schedule.
+ */
+class BusyHandlerSynchronizationObject :
+    public SqlConnection::SynchronizationObject
+{
+  public:
+    struct Statistics {
+        uint64_t busyEvents;        // number of times database was found locked
+        uint64_t retries;           // number of waits performed
+        uint64_t timeouts;          // busy handler gave up waiting
+        uint64_t waitMicroseconds;  // total time spent waiting
+        uint64_t maxWaitMicroseconds; // longest single busy episode
+    };
+
+    /**
+     * @param initialDelayUs first wait, doubled on each retry
+     * @param maxDelayUs upper bound for a single wait
+     * @param timeoutUs total time the busy handler waits before SQLite
+     *                  returns SQLITE_BUSY to the caller
+     */
+    explicit BusyHandlerSynchronizationObject(unsigned initialDelayUs = 100,
+                                              unsigned maxDelayUs = 10000,
+                                              unsigned timeoutUs = 2000000);
+    virtual ~BusyHandlerSynchronizationObject();
+
+    // [SqlConnection::SynchronizationObject]
+    virtual void Attach(sqlite3 *connection);
+    virtual void Synchronize();
+    virtual void NotifyAll();
+
+    Statistics GetStatistics() const;
+
+  private:
+    static int BusyHandler(void *param, int count);
+    unsigned Delay(unsigned attempt) const;
+    void Wait(unsigned microseconds);
+    void EndEpisode();
+
+    const unsigned m_initialDelayUs;
+    const unsigned m_maxDelayUs;
+    const unsigned m_timeoutUs;
+
+    // state of current busy episode
+    unsigned m_attempt;
+    uint64_t m_episodeWaitUs;
+
+    std::atomic<uint64_t> m_busyEvents;
+    std::atomic<uint64_t> m_retries;
+    std::atomic<uint64_t> m_timeouts;
+    std::atomic<uint64_t> m_waitUs;
+    std::atomic<uint64_t> m_maxWaitUs;
+};
+} // namespace DB
+} // namespace SecurityManager
+
+#endif // SECURITY_MANAGER_BUSY_HANDLER_SYNCHRONIZATION_OBJECT_H
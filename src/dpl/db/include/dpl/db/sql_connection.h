@@ -401,6 +401,12 @@ class SqlConnection
       public:
         virtual ~SynchronizationObject() {}
 
+        /**
+         * Called once the connection is opened, allows to install
+         * SQLite level hooks (e.g. busy handler) on the connection.
+         */
+        virtual void Attach(sqlite3 *connection) { (void) connection; }
+
         /**
          * Synchronizes SQL connection for multiple clients.
          */
@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) 2014 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+/*
+ * @file        busy_handler_synchronization_object.cpp
+ * @version     1.0
+ * @brief       SQL synchronization object based on sqlite3_busy_handler
+ */
+#include <errno.h>
+#include <time.h>
+
+#include <dpl/db/busy_handler_synchronization_object.h>
+#include <dpl/log/log.h>
+
+namespace SecurityManager {
+namespace DB {
+
+BusyHandlerSynchronizationObject::BusyHandlerSynchronizationObject(
+    unsigned initialDelayUs, unsigned maxDelayUs, unsigned timeoutUs) :
+    m_initialDelayUs(initialDelayUs),
+    m_maxDelayUs(maxDelayUs),
+    m_timeoutUs(timeoutUs),
+    m_attempt(0),
+    m_episodeWaitUs(0),
+    m_busyEvents(0),
+    m_retries(0),
+    m_timeouts(0),
+    m_waitUs(0),
+    m_maxWaitUs(0)
+{
+}
+
+BusyHandlerSynchronizationObject::~BusyHandlerSynchronizationObject()
+{
+    if (m_busyEvents)
+        LogDebug("Database busy events: " << m_busyEvents << ", retries: " << m_retries
+            << ", timeouts: " << m_timeouts << ", total wait: " << m_waitUs
+            << " us, longest wait: " << m_maxWaitUs << " us");
+}
+
+void BusyHandlerSynchronizationObject::Attach(sqlite3 *connection)
+{
+    sqlite3_busy_handler(connection, &BusyHandlerSynchronizationObject::BusyHandler, this);
+}
+
+int BusyHandlerSynchronizationObject::BusyHandler(void *param, int count)
+{
+    auto self = static_cast<BusyHandlerSynchronizationObject *>(param);
+
+    if (count == 0) {
+        self->EndEpisode();
+        ++self->m_busyEvents;
+    }
+
+    if (self->m_episodeWaitUs >= self->m_timeoutUs) {
+        ++self->m_timeouts;
+        LogWarning("Database still locked after " << self->m_episodeWaitUs << " us");
+        return 0;
+    }
+
+    self->Wait(self->Delay(self->m_attempt++));
+    return 1;
+}
+
+unsigned BusyHandlerSynchronizationObject::Delay(unsigned attempt) const
+{
+    if (attempt >= 32)
+        return m_maxDelayUs;
+    uint64_t delay = static_cast<uint64_t>(m_initialDelayUs) << attempt;
+    return delay > m_maxDelayUs ? m_maxDelayUs : static_cast<unsigned>(delay);
+}
+
+void BusyHandlerSynchronizationObject::Wait(unsigned microseconds)
+{
+    timespec requested = {
+        static_cast<time_t>(microseconds / 1000000),
+        static_cast<long>(microseconds % 1000000) * 1000
+    };
+    timespec remaining;
+
+    while (nanosleep(&requested, &remaining) == -1 && errno == EINTR)
+        requested = remaining;
+
+    ++m_retries;
+    m_waitUs += microseconds;
+    m_episodeWaitUs += microseconds;
+}
+
+void BusyHandlerSynchronizationObject::EndEpisode()
+{
+    if (m_episodeWaitUs > m_maxWaitUs)
+        m_maxWaitUs = m_episodeWaitUs;
+    m_attempt = 0;
+    m_episodeWaitUs = 0;
+}
+
+void BusyHandlerSynchronizationObject::Synchronize()
+{
+    // SQLITE_BUSY reached the caller, which will retry the operation
+    if (m_attempt == 0)
+        ++m_busyEvents;
+    if (m_episodeWaitUs >= m_timeoutUs) {
+        // Handler gave up, start over with short delays
+        EndEpisode();
+    }
+    Wait(Delay(m_attempt++));
+}
+
+void BusyHandlerSynchronizationObject::NotifyAll()
+{
+    // Operation finished, the next busy event starts a new episode
+    if (m_attempt)
+        EndEpisode();
+}
+
+BusyHandlerSynchronizationObject::Statistics
+BusyHandlerSynchronizationObject::GetStatistics() const
+{
+    Statistics stats;
+    stats.busyEvents = m_busyEvents;
+    stats.retries = m_retries;
+    stats.timeouts = m_timeouts;
+    stats.waitMicroseconds = m_waitUs;
+    stats.maxWaitMicroseconds = m_maxWaitUs;
+    return stats;
+}
+
+} // namespace DB
+} // namespace SecurityManager
@@ -21,7 +21,7 @@
  */
 #include <stddef.h>
 #include <dpl/db/sql_connection.h>
-#include <dpl/db/naive_synchronization_object.h>
+#include <dpl/db/busy_handler_synchronization_object.h>
 #include <dpl/free_deleter.h>
 #include <memory>
 #include <dpl/noncopyable.h>
@@ -707,6 +707,8 @@ SqlConnection::SqlConnection(const std::string &address,
 
     if (!m_synchronizationObject) {
         LogPedantic("No synchronization object defined");
+    } else {
+        m_synchronizationObject->Attach(m_connection);
     }
 }
 
@@ -860,7 +862,7 @@ void SqlConnection::CommitTransaction()
 SqlConnection::SynchronizationObject *
 SqlConnection::AllocDefaultSynchronizationObject()
 {
-    return new NaiveSynchronizationObject();
+    return new BusyHandlerSynchronizationObject();
 }
 } // namespace DB
 } // namespace SecurityManager
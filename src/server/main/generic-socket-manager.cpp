@@ -24,6 +24,7 @@
 
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <unistd.h>
 
 #include <generic-socket-manager.h>
 
@@ -75,17 +76,24 @@ SendMsgData::SendMsgData()
   , m_pimpl(NULL)
 {}
 
-SendMsgData::SendMsgData(int resultCode, int fileDesc, int flags)
+SendMsgData::SendMsgData(int resultCode, int fileDesc, int flags, bool ownFileDesc)
   : m_resultCode(resultCode)
   , m_fileDesc(fileDesc)
   , m_flags(flags)
   , m_pimpl(NULL)
-{}
+{
+    if (ownFileDesc && fileDesc != -1)
+        m_fileDescOwner.reset(new int(fileDesc), [](int *fd) {
+            close(*fd);
+            delete fd;
+        });
+}
 
 SendMsgData::SendMsgData(const SendMsgData &second)
   : m_resultCode(second.m_resultCode)
   , m_fileDesc(second.m_fileDesc)
   , m_flags(second.m_flags)
+  , m_fileDescOwner(second.m_fileDescOwner)
   , m_pimpl(NULL)
 {}
 
@@ -97,6 +105,7 @@ SendMsgData& SendMsgData::operator=(const SendMsgData &second) {
     m_resultCode = second.m_resultCode;
     m_fileDesc = second.m_fileDesc;
     m_flags = second.m_flags;
+    m_fileDescOwner = second.m_fileDescOwner;
     delete m_pimpl;
     m_pimpl = NULL;
     return *this;
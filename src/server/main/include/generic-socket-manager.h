@@ -25,6 +25,7 @@
 #ifndef _SECURITY_MANAGER_GENERIC_SERVICE_MANAGER_
 #define _SECURITY_MANAGER_GENERIC_SERVICE_MANAGER_
 
+#include <memory>
 #include <vector>
 #include <string>
 
@@ -118,7 +119,11 @@ public:
     class Internal;
 
     SendMsgData();
-    SendMsgData(int resultCode, int fileDesc, int flags = 0);
+    /*
+     * If ownFileDesc is set, fileDesc is closed when the last copy of this
+     * object is destroyed, i.e. after the descriptor was sent to the peer.
+     */
+    SendMsgData(int resultCode, int fileDesc, int flags = 0, bool ownFileDesc = false);
     SendMsgData(const SendMsgData &second);
     SendMsgData& operator=(const SendMsgData &second);
     virtual ~SendMsgData();
@@ -129,6 +134,7 @@ private:
     int m_resultCode;
     int m_fileDesc;
     int m_flags;
+    std::shared_ptr<void> m_fileDescOwner;
     Internal *m_pimpl;
 };
 
@@ -26,6 +26,7 @@
 #define _SECURITY_MANAGER_SERVICE_THREAD_
 
 #include <cassert>
+#include <chrono>
 #include <queue>
 #include <mutex>
 #include <thread>
@@ -69,6 +70,7 @@ public:
     ServiceThread()
       : m_state(State::NoThread)
       , m_quit(false)
+      , m_timeoutSet(false)
     {}
 
     void Create() {
@@ -119,6 +121,21 @@ public:
 
 protected:
 
+    /*
+     * Call Timeout() from the service thread once the deadline passes.
+     * Replaces previously set deadline. Must be called from the service thread.
+     */
+    void SetTimeout(std::chrono::steady_clock::time_point deadline) {
+        m_timeout = deadline;
+        m_timeoutSet = true;
+    }
+
+    void CancelTimeout() {
+        m_timeoutSet = false;
+    }
+
+    virtual void Timeout() {}
+
     struct EventDescription {
         void (Service::*serviceFunctionPtr)(void *);
         Service *servicePtr;
@@ -140,18 +157,32 @@ protected:
     void ThreadLoop(){
         for (;;) {
             EventDescription description = {NULL, NULL, NULL, NULL};
+            bool timeout = false;
             {
                 std::unique_lock<std::mutex> ulock(m_eventQueueMutex);
                 if (m_quit)
                     return;
-                if (!m_eventQueue.empty()) {
+                if (m_timeoutSet && std::chrono::steady_clock::now() >= m_timeout) {
+                    m_timeoutSet = false;
+                    timeout = true;
+                } else if (!m_eventQueue.empty()) {
                     description = m_eventQueue.front();
                     m_eventQueue.pop();
+                } else if (m_timeoutSet) {
+                    m_waitCondition.wait_until(ulock, m_timeout);
                 } else {
                     m_waitCondition.wait(ulock);
                 }
             }
 
+            if (timeout) {
+                UNHANDLED_EXCEPTION_HANDLER_BEGIN
+                {
+                    Timeout();
+                }
+                UNHANDLED_EXCEPTION_HANDLER_END
+            }
+
             if (description.eventPtr != NULL) {
                 UNHANDLED_EXCEPTION_HANDLER_BEGIN
                 {
@@ -170,6 +201,10 @@ protected:
 
     State m_state;
     bool m_quit;
+
+    /* Accessed from the service thread only */
+    bool m_timeoutSet;
+    std::chrono::steady_clock::time_point m_timeout;
 };
 
 } // namespace SecurityManager
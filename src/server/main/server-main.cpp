@@ -32,6 +32,7 @@
 #include <file-lock.h>
 
 #include <service.h>
+#include <smack-rules-store.h>
 
 IMPLEMENT_SAFE_SINGLETON(SecurityManager::Log::LogSystem);
 
@@ -81,14 +82,19 @@ int main(void) {
         }
 
         LogInfo("Start!");
-        SecurityManager::SocketManager manager;
+        {
+            SecurityManager::SocketManager manager;
 
-        if (!REGISTER_SOCKET_SERVICE(manager, SecurityManager::Service)) {
-            LogError("Unable to create socket service. Exiting.");
-            return EXIT_FAILURE;
+            if (!REGISTER_SOCKET_SERVICE(manager, SecurityManager::Service)) {
+                LogError("Unable to create socket service. Exiting.");
+                return EXIT_FAILURE;
+            }
+
+            manager.MainLoop();
         }
 
-        manager.MainLoop();
+        // Rule files don't change any more, boot won't have to rebuild the store
+        SecurityManager::SmackRulesStore::refresh();
     } catch (const SecurityManager::FileLocker::Exception::Base &e) {
         LogError("Unable to get a file lock. Exiting.");
         return EXIT_FAILURE;
@@ -317,20 +317,23 @@ void SocketManager::ReadyForWriteBuffer(int sock) {
 
     desc.timeout = time(NULL) + SOCKET_TIMEOUT;
 
-    if (desc.rawBuffer.empty())
+    if (desc.rawBuffer.empty() && desc.sendMsgDataQueue.empty())
         FD_CLR(sock, &m_writeSet);
 
     GenericSocketService::WriteEvent event;
     event.connectionID.sock = sock;
     event.connectionID.counter = desc.counter;
     event.size = result;
-    event.left = desc.rawBuffer.size();
+    event.left = desc.rawBuffer.size() + desc.sendMsgDataQueue.size();
 
     desc.service->Event(event);
 }
 
 void SocketManager::ReadyForWrite(int sock) {
-    m_socketDescriptionVector[sock].useSendMsg ?
+    auto &desc = m_socketDescriptionVector[sock];
+    // Sockets using write() may also carry descriptor replies (sendmsg).
+    // Raw data queued before them is flushed first.
+    (desc.useSendMsg || desc.rawBuffer.empty()) ?
         ReadyForSendMsg(sock) : ReadyForWriteBuffer(sock);
 }
 
@@ -670,11 +673,6 @@ void SocketManager::ProcessQueue() {
                 continue;
             }
 
-            if (!desc.useSendMsg) {
-                LogError("Some service tries to push SendMsgData to socket that uses write!");
-                continue;
-            }
-
             desc.sendMsgDataQueue.push(data.sendMsgData);
 
             FD_SET(data.connectionID.sock, &m_writeSet);
@@ -25,7 +25,13 @@
 #ifndef _SECURITY_MANAGER_SERVICE_
 #define _SECURITY_MANAGER_SERVICE_
 
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <vector>
+
 #include "base-service.h"
+#include "cynara.h"
 
 namespace SecurityManager {
 
@@ -44,6 +50,66 @@ public:
     ServiceDescriptionVector GetServiceDescription();
 
 private:
+    /**
+     * Reply to a request of the open commit group, sent when the group ends
+     */
+    struct GroupReply {
+        ConnectionID conn;
+        int result;
+        /* Smack part of the request, run once the group is committed */
+        std::function<int()> afterCommit;
+        /* The whole request run again alone if the group can't be committed,
+         * empty if the request made no database changes */
+        std::function<int()> retry;
+        /* Cynara policies of the request in the group batch, [begin, end) */
+        size_t policiesBegin;
+        size_t policiesEnd;
+    };
+
+    /**
+     * Time for which installation and policy update requests are collected
+     * into one commit group, zero if group commit is disabled
+     */
+    std::chrono::milliseconds m_groupWindow;
+    bool m_groupOpen;
+    std::vector<GroupReply> m_groupReplies;
+    /* Cynara policies of the requests in the group, sent before it's committed */
+    std::unique_ptr<CynaraAdminPolicyBatch> m_groupPolicies;
+
+    /**
+     * Open commit group unless it's already open. Database changes of the
+     * requests in the group are committed together, replies are held back
+     * until then. Cynara policies of the requests are collected and sent
+     * together right before the commit. Labels and Smack rules are set only
+     * after the group is committed.
+     *
+     * @return true if the group is open
+     */
+    bool openGroup();
+
+    /**
+     * Commit changes of all requests in the group, set their labels and
+     * Smack rules and send their replies. If the commit fails, requests
+     * that succeeded are run again one by one, outside of any group, so that
+     * the database catches up with Cynara policies they have already set.
+     * If Cynara fails to set policies of the group, the group is rolled back
+     * and each request sets its policies alone, so that only requests with
+     * policies Cynara rejects fail.
+     */
+    void commitGroup();
+
+    /**
+     * Send Cynara policies of the requests in the group that succeeded.
+     *
+     * @return false if Cynara failed, none or some of them may be set
+     */
+    bool setGroupPolicies();
+
+    /**
+     * Called when the commit group window ends
+     */
+    void Timeout();
+
     /**
      * Handle request from a client
      *
@@ -60,8 +126,12 @@ private:
      * @param  buffer Raw received data buffer
      * @param  send   Raw data buffer to be sent
      * @param  uid    User's identifier for whom application will be installed
+     * @param  groupReply reply of the request in the open commit group, NULL
+     *                if the request is not grouped
+     * @return        result of the request, also serialized to send
      */
-    void processAppInstall(MessageBuffer &buffer, MessageBuffer &send, uid_t uid);
+    int processAppInstall(MessageBuffer &buffer, MessageBuffer &send, uid_t uid,
+        GroupReply *groupReply);
 
     /**
      * Process application uninstallation
@@ -69,8 +139,12 @@ private:
      * @param  buffer Raw received data buffer
      * @param  send   Raw data buffer to be sent
      * @param  uid    User's identifier for whom application will be uninstalled
+     * @param  groupReply reply of the request in the open commit group, NULL
+     *                if the request is not grouped
+     * @return        result of the request, also serialized to send
      */
-    void processAppUninstall(MessageBuffer &buffer, MessageBuffer &send, uid_t uid);
+    int processAppUninstall(MessageBuffer &buffer, MessageBuffer &send, uid_t uid,
+        GroupReply *groupReply);
 
     /**
      * Process getting package id from app id
@@ -102,8 +176,9 @@ private:
      * @param  uid    Identifier of the user who sent the request
      * @param  pid    PID of the process which sent the request
      * @param  smackLabel smack label of requesting app
+     * @return        result of the request, also serialized to send
      */
-    void processPolicyUpdate(MessageBuffer &buffer, MessageBuffer &send, uid_t uid, pid_t pid, const std::string &smackLabel);
+    int processPolicyUpdate(MessageBuffer &buffer, MessageBuffer &send, uid_t uid, pid_t pid, const std::string &smackLabel);
 
     /**
      * List all privileges for specific user, placed in Cynara's PRIVACY_MANAGER
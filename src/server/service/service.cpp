@@ -23,22 +23,136 @@
  * @brief       Implementation of security-manager service.
  */
 
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 
 #include <dpl/log/log.h>
 #include <dpl/serialization.h>
 #include <sys/smack.h>
 
+#include "cynara.h"
+#include "group_cache.h"
+#include "privilege_db.h"
+#include "launch_profile_cache.h"
 #include "protocols.h"
 #include "service.h"
 #include "service_impl.h"
+#include "smack-backend.h"
+#include "smack-labels.h"
+#include "smack-rules.h"
+#include "smack-rules-store.h"
 
 namespace SecurityManager {
 
 const InterfaceID IFACE = 1;
 
+/* Replies bigger than this are passed to the client in a sealed memfd */
+const size_t FD_REPLY_THRESHOLD = 64 * 1024;
+
+/* Cynara policy can also be changed by other administrators (e.g. cyad or
+ * security-manager-policy-reload), which is not notified to the daemon.
+ * Such revocations take effect on launch and on authorization of requests
+ * after at most CYNARA_CACHE_LIFETIME, kept short enough to only absorb
+ * bursts of them. */
+const size_t CYNARA_CACHE_CAPACITY = 4096;
+const std::chrono::seconds CYNARA_CACHE_LIFETIME(2);
+
+/* Installation and policy update requests arriving within this many
+ * milliseconds share database commits, Cynara updates and syncs of Smack rule
+ * files. Group commit
+ * trades latency of a single request for throughput of a burst, so it's
+ * disabled unless set in the environment of the daemon. */
+const char *const GROUP_COMMIT_WINDOW_ENV = "SECURITY_MANAGER_GROUP_COMMIT_MS";
+
+/* Group is committed early when this many requests are waiting for it */
+const size_t GROUP_COMMIT_MAX_REQUESTS = 64;
+
+/* Number of threads labeling application directories, 1 if not set */
+const char *const LABEL_THREADS_ENV = "SECURITY_MANAGER_LABEL_THREADS";
+
+/* Smack backend other than the kernel, "memory" or "user-xattr", for profiling
+ * installation on systems without Smack. Used only if built with
+ * SMACK_BACKEND_SWITCH, such backend doesn't enforce anything. */
+const char *const SMACK_BACKEND_ENV = "SECURITY_MANAGER_SMACK_BACKEND";
+
+/* Append policies [begin, end) of the batch */
+static void appendPolicies(const CynaraAdminPolicyBatch &batch, size_t begin, size_t end,
+    std::vector<const struct cynara_admin_policy *> &policies)
+{
+    for (size_t i = begin; i < end; ++i)
+        policies.push_back(&batch.policies()[i]);
+}
+
+static bool changesRuleFiles(SecurityModuleCall call)
+{
+    return call == SecurityModuleCall::APP_INSTALL ||
+        call == SecurityModuleCall::APP_UNINSTALL;
+}
+
+static bool isGroupCommitted(SecurityModuleCall call)
+{
+    return call == SecurityModuleCall::APP_INSTALL ||
+        call == SecurityModuleCall::APP_UNINSTALL ||
+        call == SecurityModuleCall::POLICY_UPDATE;
+}
+
 Service::Service()
+  : m_groupWindow(0)
+  , m_groupOpen(false)
 {
+    const char *window = getenv(GROUP_COMMIT_WINDOW_ENV);
+    if (window) {
+        m_groupWindow = std::chrono::milliseconds(strtoul(window, nullptr, 10));
+        LogInfo("Group commit window: " << m_groupWindow.count() << " ms");
+    }
+
+    const char *labelThreads = getenv(LABEL_THREADS_ENV);
+    if (labelThreads) {
+        SmackLabels::setLabelingThreads(strtoul(labelThreads, nullptr, 10));
+        LogInfo("Labeling threads: " << labelThreads);
+    }
+
+    const char *smackBackend = getenv(SMACK_BACKEND_ENV);
+    if (smackBackend) {
+#ifdef SMACK_BACKEND_SWITCH
+        std::unique_ptr<SmackBackend> backend = SmackBackend::create(smackBackend);
+        if (!backend) {
+            LogError("Unknown Smack backend " << smackBackend << ", using the kernel");
+        } else {
+            if (strcmp(backend->name(), "kernel"))
+                LogError("Smack backend " << backend->name() << " set in " << SMACK_BACKEND_ENV <<
+                    ", Smack rules and labels are NOT ENFORCED");
+            SmackBackend::set(std::move(backend));
+        }
+#else
+        LogError(SMACK_BACKEND_ENV << " ignored, daemon built without SMACK_BACKEND_SWITCH");
+#endif
+    }
+
+    // Daemon is the only writer, it can answer read queries and launch
+    // requests from memory
+    try {
+        PrivilegeDb::getInstance().EnableIndex();
+        LaunchProfileCache::getInstance().enable();
+    } catch (const PrivilegeDb::Exception::Base &e) {
+        LogError("Unable to load privilege index, falling back to database queries: "
+            << e.DumpToString());
+    }
+
+    CynaraCheckCache::getInstance().enable(CYNARA_CACHE_CAPACITY, CYNARA_CACHE_LIFETIME);
+    GroupCache::getInstance().enable();
+    try {
+        std::vector<std::string> groups;
+        PrivilegeDb::getInstance().GetGroups(groups);
+        GroupCache::getInstance().preload(groups);
+    } catch (const PrivilegeDb::Exception::Base &e) {
+        LogError("Unable to preload privilege groups: " << e.DumpToString());
+    }
 }
 
 GenericSocketService::ServiceDescriptionVector Service::GetServiceDescription()
@@ -72,6 +186,45 @@ static bool getPeerID(int sock, uid_t &uid, pid_t &pid, std::string &smackLabel)
     return false;
 }
 
+/*
+ * Store serialized reply in a sealed memory file. Client receives the
+ * descriptor over SCM_RIGHTS and maps it instead of reading the socket.
+ * Returns -1 if memfd is not available, caller should send data inline then.
+ */
+static int createReplyMemfd(const RawBuffer &reply)
+{
+#if defined(SYS_memfd_create) && defined(MFD_ALLOW_SEALING) && defined(F_ADD_SEALS)
+    int fd = syscall(SYS_memfd_create, "security-manager-reply",
+        MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd == -1) {
+        LogWarning("memfd_create failed: " << strerror(errno));
+        return -1;
+    }
+
+    size_t done = 0;
+    while (done < reply.size()) {
+        ssize_t ret = TEMP_FAILURE_RETRY(write(fd, &reply[done], reply.size() - done));
+        if (ret == -1) {
+            LogError("Writing reply to memfd failed: " << strerror(errno));
+            close(fd);
+            return -1;
+        }
+        done += ret;
+    }
+
+    if (fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) == -1) {
+        LogError("Sealing reply memfd failed: " << strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+#else
+    (void) reply;
+    return -1;
+#endif
+}
+
 bool Service::processOne(const ConnectionID &conn, MessageBuffer &buffer,
                                   InterfaceID interfaceID)
 {
@@ -84,6 +237,11 @@ bool Service::processOne(const ConnectionID &conn, MessageBuffer &buffer,
 
     MessageBuffer send;
     bool retval = false;
+    bool fdReplyAllowed = false;
+    bool grouped = false;
+    bool rulesChanged = false;
+    int result = SECURITY_MANAGER_API_SUCCESS;
+    GroupReply groupReply = GroupReply{conn, SECURITY_MANAGER_API_SUCCESS, nullptr, nullptr, 0, 0};
 
     uid_t uid;
     pid_t pid;
@@ -102,6 +260,15 @@ bool Service::processOne(const ConnectionID &conn, MessageBuffer &buffer,
             Deserialization::Deserialize(buffer, call_type_int);
             SecurityModuleCall call_type = static_cast<SecurityModuleCall>(call_type_int);
 
+            // Other requests must see changes of the group and be answered
+            // after earlier requests of the same client
+            if (m_groupWindow.count() && isGroupCommitted(call_type))
+                grouped = openGroup();
+            else
+                commitGroup();
+            if (grouped)
+                groupReply.policiesBegin = m_groupPolicies->policies().size();
+
             switch (call_type) {
                 case SecurityModuleCall::NOOP:
                     LogDebug("call_type: SecurityModuleCall::NOOP");
@@ -109,11 +276,13 @@ bool Service::processOne(const ConnectionID &conn, MessageBuffer &buffer,
                     break;
                 case SecurityModuleCall::APP_INSTALL:
                     LogDebug("call_type: SecurityModuleCall::APP_INSTALL");
-                    processAppInstall(buffer, send, uid);
+                    result = processAppInstall(buffer, send, uid,
+                        grouped ? &groupReply : nullptr);
                     break;
                 case SecurityModuleCall::APP_UNINSTALL:
                     LogDebug("call_type: SecurityModuleCall::APP_UNINSTALL");
-                    processAppUninstall(buffer, send, uid);
+                    result = processAppUninstall(buffer, send, uid,
+                        grouped ? &groupReply : nullptr);
                     break;
                 case SecurityModuleCall::APP_GET_PKGID:
                     processGetPkgId(buffer, send);
@@ -128,15 +297,18 @@ bool Service::processOne(const ConnectionID &conn, MessageBuffer &buffer,
                     processUserDelete(buffer, send, uid);
                     break;
                 case SecurityModuleCall::POLICY_UPDATE:
-                    processPolicyUpdate(buffer, send, uid, pid, smackLabel);
+                    result = processPolicyUpdate(buffer, send, uid, pid, smackLabel);
                     break;
                 case SecurityModuleCall::GET_CONF_POLICY_ADMIN:
+                    fdReplyAllowed = true;
                     processGetConfiguredPolicy(buffer, send, uid, pid, smackLabel, true);
                     break;
                 case SecurityModuleCall::GET_CONF_POLICY_SELF:
+                    fdReplyAllowed = true;
                     processGetConfiguredPolicy(buffer, send, uid, pid, smackLabel, false);
                     break;
                 case SecurityModuleCall::GET_POLICY:
+                    fdReplyAllowed = true;
                     processGetPolicy(buffer, send, uid, pid, smackLabel);
                     break;
                 case SecurityModuleCall::POLICY_GET_DESCRIPTIONS:
@@ -148,6 +320,7 @@ bool Service::processOne(const ConnectionID &conn, MessageBuffer &buffer,
             }
             // if we reach this point, the protocol is OK
             retval = true;
+            rulesChanged = !grouped && changesRuleFiles(call_type);
         } Catch (MessageBuffer::Exception::Base) {
             LogError("Broken protocol.");
         } Catch (ServiceException::Base) {
@@ -162,18 +335,197 @@ bool Service::processOne(const ConnectionID &conn, MessageBuffer &buffer,
         LogError("Wrong interface");
     }
 
-    if (retval) {
+    if (retval && grouped) {
+        // Reply when changes of the request are committed
+        groupReply.result = result;
+        groupReply.policiesEnd = m_groupPolicies->policies().size();
+        m_groupReplies.push_back(std::move(groupReply));
+        if (m_groupReplies.size() >= GROUP_COMMIT_MAX_REQUESTS)
+            commitGroup();
+    } else if (retval) {
         //send response
-        m_serviceManager->Write(conn, send.Pop());
+        RawBuffer reply = send.Pop();
+        int fd = -1;
+        if (fdReplyAllowed && reply.size() > FD_REPLY_THRESHOLD)
+            fd = createReplyMemfd(reply);
+
+        if (fd != -1) {
+            LogDebug("Sending " << reply.size() << " bytes of reply in memfd");
+            m_serviceManager->Write(conn, SendMsgData(0, fd, 0, true));
+        } else
+            m_serviceManager->Write(conn, reply);
     } else {
         LogError("Closing socket because of error");
         m_serviceManager->Close(conn);
     }
 
+    // Store of Smack rules is kept up to date, so that boot after a crash
+    // doesn't have to rebuild it. Commit group rebuilds it once per group.
+    if (rulesChanged)
+        SmackRulesStore::refresh();
+
     return retval;
 }
 
-void Service::processAppInstall(MessageBuffer &buffer, MessageBuffer &send, uid_t uid)
+bool Service::openGroup()
+{
+    if (m_groupOpen)
+        return true;
+
+    try {
+        PrivilegeDb::getInstance().BeginTransactionGroup();
+    } catch (const PrivilegeDb::Exception::Base &e) {
+        LogError("Unable to start commit group, committing request alone: "
+            << e.DumpToString());
+        return false;
+    }
+    SmackRules::beginBatch();
+    m_groupPolicies.reset(new CynaraAdminPolicyBatch);
+    CynaraAdmin::getInstance().BeginDeferredUpdate(*m_groupPolicies);
+
+    m_groupOpen = true;
+    SetTimeout(std::chrono::steady_clock::now() + m_groupWindow);
+    return true;
+}
+
+void Service::commitGroup()
+{
+    if (!m_groupOpen)
+        return;
+    m_groupOpen = false;
+    CancelTimeout();
+
+    LogDebug("Committing group of " << m_groupReplies.size() << " requests");
+    CynaraAdmin::getInstance().EndDeferredUpdate();
+    bool policiesSet = setGroupPolicies();
+
+    // Database must not get ahead of Cynara, the group is rolled back if
+    // its policies are not set
+    bool committed = false;
+    if (policiesSet) {
+        try {
+            PrivilegeDb::getInstance().CommitTransactionGroup();
+            committed = true;
+        } catch (const PrivilegeDb::Exception::Base &e) {
+            LogError("Error while committing the commit group: " << e.DumpToString());
+        }
+    }
+    if (!committed) {
+        try {
+            PrivilegeDb::getInstance().RollbackTransactionGroup();
+        } catch (const PrivilegeDb::Exception::Base &e) {
+            LogError("Error while rolling back the commit group: " << e.DumpToString());
+        }
+    }
+
+    if (committed) {
+        // Smack rules recorded by the requests are committed together as well
+        bool recording = true;
+        try {
+            PrivilegeDb::getInstance().BeginTransactionGroup();
+        } catch (const PrivilegeDb::Exception::Base &e) {
+            LogError("Unable to start commit group, recording Smack rules one by one: "
+                << e.DumpToString());
+            recording = false;
+        }
+
+        for (auto &groupReply : m_groupReplies)
+            if (groupReply.result == SECURITY_MANAGER_API_SUCCESS && groupReply.afterCommit)
+                groupReply.result = groupReply.afterCommit();
+
+        if (recording) {
+            try {
+                PrivilegeDb::getInstance().CommitTransactionGroup();
+            } catch (const PrivilegeDb::Exception::Base &e) {
+                // Rules not recorded are read back from the rule files
+                LogError("Error while recording Smack rules of the commit group: "
+                    << e.DumpToString());
+                try {
+                    PrivilegeDb::getInstance().RollbackTransactionGroup();
+                } catch (const PrivilegeDb::Exception::Base &e) {
+                    LogError("Error while rolling back the commit group: " << e.DumpToString());
+                }
+                for (auto &groupReply : m_groupReplies)
+                    if (groupReply.result == SECURITY_MANAGER_API_SUCCESS &&
+                            groupReply.afterCommit)
+                        groupReply.result = SECURITY_MANAGER_API_ERROR_SERVER_ERROR;
+            }
+        }
+    } else {
+        // Requests run again set their Cynara policies again, the rest only
+        // has to set them if sending those of the group failed
+        for (auto &groupReply : m_groupReplies) {
+            if (groupReply.result != SECURITY_MANAGER_API_SUCCESS)
+                continue;
+            if (groupReply.retry) {
+                LogWarning("Running request of the failed commit group alone");
+                groupReply.result = groupReply.retry();
+            } else if (!policiesSet) {
+                LogWarning("Setting Cynara policies of a request of the commit group alone");
+                std::vector<const struct cynara_admin_policy *> policies;
+                appendPolicies(*m_groupPolicies, groupReply.policiesBegin,
+                    groupReply.policiesEnd, policies);
+                try {
+                    CynaraAdmin::getInstance().SetPolicies(policies.data(), policies.size());
+                } catch (const CynaraException::Base &e) {
+                    LogError("Error while updating Cynara rules: " << e.DumpToString());
+                    groupReply.result = SECURITY_MANAGER_API_ERROR_SERVER_ERROR;
+                }
+            }
+        }
+    }
+
+    try {
+        SmackRules::flushBatch();
+    } catch (const SmackException::Base &e) {
+        LogError("Error while syncing Smack rules of the commit group: " << e.DumpToString());
+        for (auto &groupReply : m_groupReplies)
+            if (groupReply.result == SECURITY_MANAGER_API_SUCCESS && groupReply.retry)
+                groupReply.result = SECURITY_MANAGER_API_ERROR_SETTING_FILE_LABEL_FAILED;
+    }
+
+    // Installations and uninstallations are the requests with a Smack part
+    bool rulesChanged = false;
+    for (const auto &groupReply : m_groupReplies) {
+        MessageBuffer send;
+        Serialization::Serialize(send, groupReply.result);
+        m_serviceManager->Write(groupReply.conn, send.Pop());
+        rulesChanged = rulesChanged || groupReply.retry;
+    }
+    m_groupReplies.clear();
+    m_groupPolicies.reset();
+
+    // Boot after a crash finds the store of Smack rules up to date
+    if (rulesChanged)
+        SmackRulesStore::refresh();
+}
+
+bool Service::setGroupPolicies()
+{
+    // Requests that failed roll back their changes, their policies are dropped
+    std::vector<const struct cynara_admin_policy *> policies;
+    policies.reserve(m_groupPolicies->policies().size());
+    for (const auto &groupReply : m_groupReplies)
+        if (groupReply.result == SECURITY_MANAGER_API_SUCCESS)
+            appendPolicies(*m_groupPolicies, groupReply.policiesBegin, groupReply.policiesEnd,
+                policies);
+
+    try {
+        CynaraAdmin::getInstance().SetPolicies(policies.data(), policies.size());
+    } catch (const CynaraException::Base &e) {
+        LogError("Error while updating Cynara rules of the commit group: " << e.DumpToString());
+        return false;
+    }
+    return true;
+}
+
+void Service::Timeout()
+{
+    commitGroup();
+}
+
+int Service::processAppInstall(MessageBuffer &buffer, MessageBuffer &send, uid_t uid,
+    GroupReply *groupReply)
 {
     app_inst_req req;
 
@@ -182,15 +534,30 @@ void Service::processAppInstall(MessageBuffer &buffer, MessageBuffer &send, uid_
     Deserialization::Deserialize(buffer, req.privileges);
     Deserialization::Deserialize(buffer, req.appPaths);
     Deserialization::Deserialize(buffer, req.uid);
-    Serialization::Serialize(send, ServiceImpl::appInstall(req, uid));
+    int ret;
+    if (groupReply) {
+        ret = ServiceImpl::appInstall(req, uid, &groupReply->afterCommit);
+        groupReply->retry = [req, uid] { return ServiceImpl::appInstall(req, uid); };
+    } else
+        ret = ServiceImpl::appInstall(req, uid);
+    Serialization::Serialize(send, ret);
+    return ret;
 }
 
-void Service::processAppUninstall(MessageBuffer &buffer, MessageBuffer &send, uid_t uid)
+int Service::processAppUninstall(MessageBuffer &buffer, MessageBuffer &send, uid_t uid,
+    GroupReply *groupReply)
 {
     std::string appId;
 
     Deserialization::Deserialize(buffer, appId);
-    Serialization::Serialize(send, ServiceImpl::appUninstall(appId, uid));
+    int ret;
+    if (groupReply) {
+        ret = ServiceImpl::appUninstall(appId, uid, &groupReply->afterCommit);
+        groupReply->retry = [appId, uid] { return ServiceImpl::appUninstall(appId, uid); };
+    } else
+        ret = ServiceImpl::appUninstall(appId, uid);
+    Serialization::Serialize(send, ret);
+    return ret;
 }
 
 void Service::processGetPkgId(MessageBuffer &buffer, MessageBuffer &send)
@@ -247,7 +614,7 @@ void Service::processUserDelete(MessageBuffer &buffer, MessageBuffer &send, uid_
     Serialization::Serialize(send, ret);
 }
 
-void Service::processPolicyUpdate(MessageBuffer &buffer, MessageBuffer &send, uid_t uid, pid_t pid, const std::string &smackLabel)
+int Service::processPolicyUpdate(MessageBuffer &buffer, MessageBuffer &send, uid_t uid, pid_t pid, const std::string &smackLabel)
 {
     int ret;
     std::vector<policy_entry> policyEntries;
@@ -256,6 +623,7 @@ void Service::processPolicyUpdate(MessageBuffer &buffer, MessageBuffer &send, ui
 
     ret = ServiceImpl::policyUpdate(policyEntries, uid, pid, smackLabel);
     Serialization::Serialize(send, ret);
+    return ret;
 }
 
 void Service::processGetConfiguredPolicy(MessageBuffer &buffer, MessageBuffer &send, uid_t uid, pid_t pid, const std::string &smackLabel, bool forAdmin)
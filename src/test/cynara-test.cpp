@@ -0,0 +1,341 @@
+/*
+ *  Copyright (c) 2014 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *  Contact: Rafal Krypa <r.krypa@samsung.com>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License
+ */
+/*
+ * @file        cynara-test.cpp
+ * @brief       Tests of Cynara usage, run against in-process Cynara stand-in
+ */
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <cynara-stub.h>
+
+#include <cynara.h>
+
+#include <test.h>
+
+namespace SecurityManager {
+namespace Test {
+
+namespace {
+
+const char *const LABEL = "User::App::test";
+const char *const USER = "5001";
+const uid_t UID = 5001;
+const char *const SESSION = "1";
+const char *const PRIVILEGE = "http://tizen.org/privilege/test";
+
+const std::chrono::hours LONG_LIFETIME(1);
+
+/* Bucket layout created by security-manager-policy-reload */
+void setupPolicy()
+{
+    cynara_stub_reset();
+    cynara_stub_set_latency(0);
+    CynaraCheckCache::getInstance().enable(0, std::chrono::milliseconds(0));
+
+    struct cynara_admin *admin;
+    cynara_admin_initialize(&admin);
+    for (const auto &bucket : CynaraAdmin::Buckets) {
+        int defaultPolicy = CYNARA_ADMIN_DENY;
+        if (bucket.first == Bucket::ADMIN)
+            defaultPolicy = CYNARA_ADMIN_NONE;
+        cynara_admin_set_bucket(admin, bucket.second.c_str(), defaultPolicy, nullptr);
+    }
+    cynara_admin_finish(admin);
+
+    CynaraAdminPolicyBatch batch;
+    batch.add(CYNARA_ADMIN_WILDCARD, CYNARA_ADMIN_WILDCARD, CYNARA_ADMIN_WILDCARD,
+        CynaraAdmin::Buckets.at(Bucket::MANIFESTS), CynaraAdmin::Buckets.at(Bucket::MAIN));
+    batch.add(CYNARA_ADMIN_WILDCARD, CYNARA_ADMIN_WILDCARD, CYNARA_ADMIN_WILDCARD,
+        CynaraAdmin::Buckets.at(Bucket::MAIN),
+        CynaraAdmin::Buckets.at(Bucket::PRIVACY_MANAGER));
+    for (Bucket bucket : {Bucket::USER_TYPE_ADMIN, Bucket::USER_TYPE_NORMAL,
+            Bucket::USER_TYPE_GUEST, Bucket::USER_TYPE_SYSTEM})
+        batch.add(CYNARA_ADMIN_WILDCARD, CYNARA_ADMIN_WILDCARD, CYNARA_ADMIN_WILDCARD,
+            CynaraAdmin::Buckets.at(Bucket::ADMIN), CynaraAdmin::Buckets.at(bucket));
+    batch.add(CYNARA_ADMIN_WILDCARD, CYNARA_ADMIN_WILDCARD, PRIVILEGE, CYNARA_ADMIN_ALLOW,
+        CynaraAdmin::Buckets.at(Bucket::USER_TYPE_NORMAL));
+    for (const char *client : {"User", "System"})
+        batch.add(client, CYNARA_ADMIN_WILDCARD, CYNARA_ADMIN_WILDCARD, CYNARA_ADMIN_ALLOW,
+            CynaraAdmin::Buckets.at(Bucket::MANIFESTS));
+    CynaraAdmin::getInstance().SetPolicies(batch);
+
+    CynaraAdmin::getInstance().UserInit(UID, SM_USER_TYPE_NORMAL);
+}
+
+void testCacheLruEviction()
+{
+    setupPolicy();
+    CynaraCheckCache &cache = CynaraCheckCache::getInstance();
+    cache.enable(2, LONG_LIFETIME);
+
+    bool allowed = false;
+    cache.put(LABEL, "a", USER, true);
+    cache.put(LABEL, "b", USER, false);
+    TEST_CHECK(cache.get(LABEL, "a", USER, allowed));
+    TEST_CHECK(allowed);
+
+    // "b" is the least recently used now
+    cache.put(LABEL, "c", USER, true);
+    TEST_CHECK(!cache.get(LABEL, "b", USER, allowed));
+    TEST_CHECK(cache.get(LABEL, "a", USER, allowed));
+    TEST_CHECK(cache.get(LABEL, "c", USER, allowed));
+
+    // Update of a known entry doesn't evict anything
+    cache.put(LABEL, "a", USER, false);
+    TEST_CHECK(cache.get(LABEL, "a", USER, allowed));
+    TEST_CHECK(!allowed);
+    TEST_CHECK(cache.get(LABEL, "c", USER, allowed));
+}
+
+void testCacheExpiry()
+{
+    setupPolicy();
+    CynaraCheckCache &cache = CynaraCheckCache::getInstance();
+    cache.enable(16, std::chrono::milliseconds(20));
+
+    bool allowed = false;
+    cache.put(LABEL, PRIVILEGE, USER, true);
+    TEST_CHECK(cache.get(LABEL, PRIVILEGE, USER, allowed));
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(40));
+    unsigned long misses = cache.getStatistics().misses;
+    TEST_CHECK(!cache.get(LABEL, PRIVILEGE, USER, allowed));
+    TEST_CHECK_EQUAL(cache.getStatistics().misses, misses + 1);
+}
+
+void testCacheKey()
+{
+    setupPolicy();
+    CynaraCheckCache &cache = CynaraCheckCache::getInstance();
+    cache.enable(16, LONG_LIFETIME);
+
+    bool allowed = false;
+    cache.put(LABEL, PRIVILEGE, USER, true);
+    TEST_CHECK(!cache.get(LABEL, PRIVILEGE, "5002", allowed));
+    TEST_CHECK(!cache.get("User::App::other", PRIVILEGE, USER, allowed));
+    TEST_CHECK(cache.get(LABEL, PRIVILEGE, USER, allowed));
+}
+
+void testCacheSharedByLaunches()
+{
+    setupPolicy();
+    CynaraCheckCache &cache = CynaraCheckCache::getInstance();
+    cache.enable(16, LONG_LIFETIME);
+
+    std::vector<std::string> privileges{PRIVILEGE};
+    std::vector<bool> results;
+    CynaraAdmin::getInstance().UpdateAppPolicy(LABEL, USER, std::vector<std::string>(),
+        privileges);
+
+    // Session of a launch is the pid of the launched process
+    Cynara::getInstance().check(LABEL, privileges, USER, "1001", results);
+    TEST_CHECK(results[0]);
+
+    unsigned long hits = cache.getStatistics().hits;
+    Cynara::getInstance().check(LABEL, privileges, USER, "1002", results);
+    TEST_CHECK(results[0]);
+    TEST_CHECK_EQUAL(cache.getStatistics().hits, hits + 1);
+
+    // Single checks authorizing requests use the same entry
+    TEST_CHECK(Cynara::getInstance().check(LABEL, PRIVILEGE, USER, "1003"));
+    TEST_CHECK_EQUAL(cache.getStatistics().hits, hits + 2);
+}
+
+void testCacheSkipsPluginPolicies()
+{
+    setupPolicy();
+    CynaraCheckCache &cache = CynaraCheckCache::getInstance();
+    cache.enable(16, LONG_LIFETIME);
+
+    std::vector<std::string> privileges{PRIVILEGE};
+    CynaraAdmin::getInstance().UpdateAppPolicy(LABEL, USER, std::vector<std::string>(),
+        privileges);
+
+    // Result of a policy type handled by a plugin may depend on the session
+    const int pluginType = 0x10;
+    CynaraAdminPolicyBatch batch;
+    batch.add(LABEL, USER, PRIVILEGE, pluginType,
+        CynaraAdmin::Buckets.at(Bucket::PRIVACY_MANAGER));
+    CynaraAdmin::getInstance().SetPolicies(batch);
+    TEST_CHECK_EQUAL(CynaraAdmin::getInstance().GetPrivilegeManagerCurrLevel(LABEL, USER,
+        PRIVILEGE), pluginType);
+
+    std::vector<bool> results;
+    bool allowed;
+    Cynara::getInstance().check(LABEL, privileges, USER, "1001", results);
+    TEST_CHECK(!cache.get(LABEL, PRIVILEGE, USER, allowed));
+    Cynara::getInstance().check(LABEL, PRIVILEGE, USER, "1002");
+    TEST_CHECK(!cache.get(LABEL, PRIVILEGE, USER, allowed));
+}
+
+void testCacheFlushOnSetPolicies()
+{
+    setupPolicy();
+    CynaraCheckCache &cache = CynaraCheckCache::getInstance();
+    cache.enable(16, LONG_LIFETIME);
+
+    std::vector<std::string> privileges{PRIVILEGE};
+    std::vector<bool> results;
+    CynaraAdmin::getInstance().UpdateAppPolicy(LABEL, USER, std::vector<std::string>(),
+        privileges);
+    Cynara::getInstance().check(LABEL, privileges, USER, SESSION, results);
+    TEST_CHECK(results[0]);
+
+    // Answered from the cache until the next change
+    unsigned long hits = cache.getStatistics().hits;
+    Cynara::getInstance().check(LABEL, privileges, USER, SESSION, results);
+    TEST_CHECK(results[0]);
+    TEST_CHECK_EQUAL(cache.getStatistics().hits, hits + 1);
+
+    // Revocation through CynaraAdmin is seen on the next check
+    unsigned long flushes = cache.getStatistics().flushes;
+    CynaraAdmin::getInstance().UpdateAppPolicy(LABEL, USER, privileges,
+        std::vector<std::string>());
+    TEST_CHECK_EQUAL(cache.getStatistics().flushes, flushes + 1);
+
+    Cynara::getInstance().check(LABEL, privileges, USER, SESSION, results);
+    TEST_CHECK(!results[0]);
+}
+
+void testCacheFlushOnEmptyBucket()
+{
+    setupPolicy();
+    CynaraCheckCache &cache = CynaraCheckCache::getInstance();
+    cache.enable(16, LONG_LIFETIME);
+
+    std::vector<std::string> privileges{PRIVILEGE};
+    std::vector<bool> results;
+    CynaraAdmin::getInstance().UpdateAppPolicy(LABEL, USER, std::vector<std::string>(),
+        privileges);
+    Cynara::getInstance().check(LABEL, privileges, USER, SESSION, results);
+    TEST_CHECK(results[0]);
+
+    // Removal of the user empties its part of MANIFESTS and PRIVACY_MANAGER
+    unsigned long flushes = cache.getStatistics().flushes;
+    CynaraAdmin::getInstance().UserRemove(UID);
+    TEST_CHECK_EQUAL(cache.getStatistics().flushes, flushes + 1);
+
+    Cynara::getInstance().check(LABEL, privileges, USER, SESSION, results);
+    TEST_CHECK(!results[0]);
+}
+
+/* Levels from snapshots of all users and of a single user agree with Cynara */
+void compareSnapshot(const std::vector<std::string> &users,
+    const std::vector<std::string> &labels, const std::vector<std::string> &privileges)
+{
+    for (const std::string &snapshotUser : {std::string(CYNARA_ADMIN_ANY),
+            std::string(USER)}) {
+        CynaraPolicySnapshot snapshot(snapshotUser);
+        for (const auto &user : users) {
+            if (snapshotUser != CYNARA_ADMIN_ANY && snapshotUser != user)
+                continue;
+            for (const auto &label : labels)
+                for (const auto &privilege : privileges) {
+                    TEST_CHECK_EQUAL(
+                        snapshot.GetPrivilegeManagerCurrLevel(label, user, privilege),
+                        CynaraAdmin::getInstance().GetPrivilegeManagerCurrLevel(label, user,
+                            privilege));
+                    TEST_CHECK_EQUAL(
+                        snapshot.GetPrivilegeManagerMaxLevel(label, user, privilege),
+                        CynaraAdmin::getInstance().GetPrivilegeManagerMaxLevel(label, user,
+                            privilege));
+                }
+        }
+    }
+}
+
+void testSnapshotMatchesAdminCheck()
+{
+    setupPolicy();
+
+    const std::string otherUser = "5002";
+    const std::vector<std::string> users{USER, otherUser};
+    const std::vector<std::string> labels{LABEL, "User::App::other", "User", "System"};
+    const std::vector<std::string> privileges{PRIVILEGE,
+        "http://tizen.org/privilege/test2", "http://tizen.org/privilege/test3"};
+
+    CynaraAdmin::getInstance().UserInit(static_cast<uid_t>(std::stoul(otherUser)),
+        SM_USER_TYPE_GUEST);
+    for (const auto &user : users)
+        CynaraAdmin::getInstance().UpdateAppPolicy(LABEL, user, std::vector<std::string>(),
+            privileges);
+
+    CynaraAdminPolicyBatch batch;
+    // Privacy manager settings of the user
+    batch.add(LABEL, USER, privileges[0], CYNARA_ADMIN_DENY,
+        CynaraAdmin::Buckets.at(Bucket::PRIVACY_MANAGER));
+    batch.add(LABEL, USER, privileges[1], CYNARA_ADMIN_ALLOW,
+        CynaraAdmin::Buckets.at(Bucket::PRIVACY_MANAGER));
+    // Device administrator settings
+    batch.add(CYNARA_ADMIN_WILDCARD, otherUser, privileges[1], CYNARA_ADMIN_ALLOW,
+        CynaraAdmin::Buckets.at(Bucket::ADMIN));
+    batch.add(LABEL, CYNARA_ADMIN_WILDCARD, privileges[2], CYNARA_ADMIN_DENY,
+        CynaraAdmin::Buckets.at(Bucket::ADMIN));
+    CynaraAdmin::getInstance().SetPolicies(batch);
+
+    compareSnapshot(users, labels, privileges);
+
+    // Without the link to MAIN default policy of PRIVACY_MANAGER decides
+    CynaraAdminPolicyBatch unlink;
+    unlink.add(CYNARA_ADMIN_WILDCARD, CYNARA_ADMIN_WILDCARD, CYNARA_ADMIN_WILDCARD,
+        static_cast<int>(CynaraAdminPolicy::Operation::Delete),
+        CynaraAdmin::Buckets.at(Bucket::PRIVACY_MANAGER));
+    CynaraAdmin::getInstance().SetPolicies(unlink);
+    compareSnapshot(users, labels, privileges);
+}
+
+void testBatchSharesStrings()
+{
+    const std::string &bucket = CynaraAdmin::Buckets.at(Bucket::MANIFESTS);
+    CynaraAdminPolicyBatch batch;
+    batch.add(LABEL, USER, PRIVILEGE, CYNARA_ADMIN_ALLOW, bucket);
+    batch.add(std::string(LABEL), USER, "http://tizen.org/privilege/test2",
+        CYNARA_ADMIN_ALLOW, bucket);
+    batch.add(batch.policies()[0]);
+
+    const auto &policies = batch.policies();
+    TEST_CHECK_EQUAL(policies.size(), 3u);
+    TEST_CHECK(policies[0].client == policies[1].client);
+    TEST_CHECK(policies[0].user == policies[2].user);
+    TEST_CHECK(policies[0].bucket == policies[1].bucket);
+    TEST_CHECK(policies[0].privilege != policies[1].privilege);
+    TEST_CHECK_EQUAL(std::string(policies[1].privilege), "http://tizen.org/privilege/test2");
+    TEST_CHECK_EQUAL(std::string(policies[2].client), LABEL);
+}
+
+} // namespace anonymous
+
+void registerCynaraTests(Runner &runner)
+{
+    runner.add("cynara/cache/lru-eviction", testCacheLruEviction);
+    runner.add("cynara/cache/expiry", testCacheExpiry);
+    runner.add("cynara/cache/key", testCacheKey);
+    runner.add("cynara/cache/shared-by-launches", testCacheSharedByLaunches);
+    runner.add("cynara/cache/skips-plugin-policies", testCacheSkipsPluginPolicies);
+    runner.add("cynara/cache/flush-on-set-policies", testCacheFlushOnSetPolicies);
+    runner.add("cynara/cache/flush-on-empty-bucket", testCacheFlushOnEmptyBucket);
+    runner.add("cynara/snapshot/matches-admin-check", testSnapshotMatchesAdminCheck);
+    runner.add("cynara/batch/shares-strings", testBatchSharesStrings);
+}
+
+} // namespace Test
+} // namespace SecurityManager
@@ -0,0 +1,101 @@
+/*
+ *  Copyright (c) 2014 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *  Contact: Rafal Krypa <r.krypa@samsung.com>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License
+ */
+/*
+ * @file        test.h
+ * @brief       Minimal test runner used by security-manager-tests
+ */
+
+#ifndef _SECURITY_MANAGER_TEST_
+#define _SECURITY_MANAGER_TEST_
+
+#include <functional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace SecurityManager {
+namespace Test {
+
+/* Thrown by failed TEST_CHECK, ends the test case */
+class Failure : public std::runtime_error {
+public:
+    explicit Failure(const std::string &message)
+      : std::runtime_error(message)
+    {
+    }
+};
+
+#define TEST_CHECK(expr)                                                  \
+    do {                                                                  \
+        if (!(expr)) {                                                    \
+            std::ostringstream message;                                   \
+            message << __FILE__ << ":" << __LINE__ << ": " << #expr;      \
+            throw SecurityManager::Test::Failure(message.str());          \
+        }                                                                 \
+    } while (0)
+
+#define TEST_CHECK_EQUAL(actual, expected)                                \
+    do {                                                                  \
+        auto actualValue = (actual);                                      \
+        auto expectedValue = (expected);                                  \
+        if (!(actualValue == expectedValue)) {                            \
+            std::ostringstream message;                                   \
+            message << __FILE__ << ":" << __LINE__ << ": " << #actual     \
+                << " is " << actualValue << ", expected " << expectedValue; \
+            throw SecurityManager::Test::Failure(message.str());          \
+        }                                                                 \
+    } while (0)
+
+class Runner {
+public:
+    typedef std::function<void()> Body;
+
+    /* Register test case, body fails by throwing any exception */
+    void add(const std::string &name, Body body);
+
+    /* Run only cases with name containing given substring */
+    void setFilter(const std::string &filter);
+
+    /*
+     * Run all registered cases matching the filter, reporting each to
+     * standard output.
+     *
+     * @return number of failed cases
+     */
+    size_t run();
+
+private:
+    struct Case {
+        std::string name;
+        Body body;
+    };
+
+    std::vector<Case> m_cases;
+    std::string m_filter;
+};
+
+/* Test suites, each registers its cases in the runner */
+void registerCynaraTests(Runner &runner);
+void registerPrivilegeDbIndexTests(Runner &runner);
+void registerPrivilegeDbTests(Runner &runner);
+
+} // namespace Test
+} // namespace SecurityManager
+
+#endif // _SECURITY_MANAGER_TEST_
@@ -0,0 +1,105 @@
+/*
+ *  Copyright (c) 2014 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *  Contact: Rafal Krypa <r.krypa@samsung.com>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License
+ */
+/*
+ * @file        privilege-db-index-test.cpp
+ * @brief       Tests of the in-memory copy of the privileges database
+ */
+
+#include <string>
+#include <vector>
+
+#include <privilege_db_index.h>
+
+#include <test.h>
+
+namespace SecurityManager {
+namespace Test {
+
+namespace {
+
+const uid_t UID = 5001;
+const size_t APP_COUNT = 1000;
+
+/* Applications with names, packages and privileges of their own */
+void installAndRemove(PrivilegeDbIndex &index, const std::string &prefix)
+{
+    for (size_t i = 0; i < APP_COUNT; ++i) {
+        std::string name = prefix + std::to_string(i);
+        index.addApplication(name, name + ".pkg", UID);
+        index.setAppPrivileges(name, UID, {name + ".privilege", "http://tizen.org/privilege/shared"});
+    }
+    for (size_t i = 0; i < APP_COUNT; ++i)
+        index.removeApplication(prefix + std::to_string(i), UID);
+}
+
+void testStringsFreedOnRemoval()
+{
+    PrivilegeDbIndex index;
+    installAndRemove(index, "org.tizen.first");
+    size_t memory = index.memoryUsage();
+
+    // Containers keep their buckets, strings of removed applications must go
+    installAndRemove(index, "org.tizen.second");
+    TEST_CHECK_EQUAL(index.memoryUsage(), memory);
+    TEST_CHECK_EQUAL(index.appCount(), 0u);
+    TEST_CHECK(!index.pkgIdExists("org.tizen.first0.pkg"));
+    TEST_CHECK(!index.pkgIdExists("org.tizen.second0.pkg"));
+}
+
+void testSharedStringsKept()
+{
+    const std::string shared = "http://tizen.org/privilege/shared";
+    const std::string own = "http://tizen.org/privilege/own";
+
+    PrivilegeDbIndex index;
+    index.addPrivilegeGroup(shared, "group");
+    index.addApplication("a", "pkg", UID);
+    index.addApplication("b", "pkg", UID);
+    index.setAppPrivileges("a", UID, {shared});
+    index.setAppPrivileges("b", UID, {own, shared, own});
+    index.addAppPrivilege("b", UID, shared);
+
+    std::vector<std::string> privileges;
+    index.getAppPrivileges("b", UID, privileges);
+    TEST_CHECK((privileges == std::vector<std::string>{own, shared}));
+
+    // Replaced privileges stay with the other application and the group
+    index.setAppPrivileges("b", UID, {shared});
+    index.removeApplication("a", UID);
+    index.getAppPrivileges("b", UID, privileges);
+    TEST_CHECK((privileges == std::vector<std::string>{shared}));
+    TEST_CHECK(index.pkgIdExists("pkg"));
+
+    index.removeApplication("b", UID);
+    TEST_CHECK(!index.pkgIdExists("pkg"));
+
+    std::vector<std::string> groups;
+    index.getPrivilegeGroups(shared, groups);
+    TEST_CHECK((groups == std::vector<std::string>{"group"}));
+}
+
+} // namespace anonymous
+
+void registerPrivilegeDbIndexTests(Runner &runner)
+{
+    runner.add("privilege-db-index/strings/freed-on-removal", testStringsFreedOnRemoval);
+    runner.add("privilege-db-index/strings/shared-kept", testSharedStringsKept);
+}
+
+} // namespace Test
+} // namespace SecurityManager
@@ -0,0 +1,216 @@
+/*
+ *  Copyright (c) 2014 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *  Contact: Rafal Krypa <r.krypa@samsung.com>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License
+ */
+/*
+ * @file        privilege-db-test.cpp
+ * @brief       Tests of query plans of the privileges database
+ */
+
+#include <sqlite3.h>
+#include <unistd.h>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+#include <privilege_db.h>
+
+#include <test.h>
+
+namespace SecurityManager {
+namespace Test {
+
+namespace {
+
+/* Queries reading all rows, the only ones allowed to scan */
+const char *const ALL_ROWS = "";
+
+/*
+ * Part of the plan each query must have, e.g. the index it searches.
+ * NULL for queries with nothing to search.
+ */
+const std::map<QueryType, const char *> EXPECTED_PLANS = {
+    { QueryType::EGetPkgPrivileges, "app_pkg_id_index (pkg_id=?)" },
+    { QueryType::EGetAppPrivileges, "sqlite_autoindex_app_1 (name=? AND uid=?)" },
+    { QueryType::EAddPkg, NULL },
+    { QueryType::EAddApplication, "sqlite_autoindex_pkg_1 (name=?)" },
+    { QueryType::EGetAppRowIds, "sqlite_autoindex_app_1 (name=? AND uid=?)" },
+    { QueryType::ERemoveApplication, "app USING INTEGER PRIMARY KEY (rowid=?)" },
+    { QueryType::EPkgHasApps, "app_pkg_id_index (pkg_id=?)" },
+    { QueryType::ERemovePkg, "pkg USING INTEGER PRIMARY KEY (rowid=?)" },
+    { QueryType::ERemoveAppPrivileges, "sqlite_autoindex_app_privilege_1 (app_id=?)" },
+    { QueryType::EGetPrivilegeId, "sqlite_autoindex_privilege_1 (name=?)" },
+    { QueryType::EAddPrivilege, NULL },
+    { QueryType::EPkgIdExists, "sqlite_autoindex_pkg_1 (name=?)" },
+    { QueryType::EGetPkgId, "sqlite_autoindex_app_1 (name=?)" },
+    { QueryType::EGetPrivilegeGroups, "sqlite_autoindex_privilege_group_1 (privilege_id=?)" },
+    { QueryType::EGetGroups, ALL_ROWS },
+    { QueryType::EGetUserApps, "app_uid_index (uid=?)" },
+    { QueryType::EGetAppsInPkg, "app_pkg_id_index (pkg_id=?)" },
+    { QueryType::EGetAllApps, ALL_ROWS },
+    { QueryType::EGetAllAppPrivileges, ALL_ROWS },
+    { QueryType::EGetAllPrivilegeGroups, ALL_ROWS },
+    { QueryType::EGetDataVersion, NULL },
+    { QueryType::EGetSmackRules, "smack_rule USING INDEX" },
+    { QueryType::EGetLabelSmackRules, "smack_rule USING INDEX" },
+    { QueryType::EAddSmackRule, NULL },
+    { QueryType::ERemoveSmackRules, "smack_rule USING INDEX" },
+    { QueryType::ERemoveLabelSmackRules, "smack_rule USING INDEX" },
+};
+
+/* Tables too big to be scanned by a query looking for some of their rows */
+const char *const LARGE_TABLES[] = {"app", "app_privilege", "smack_rule"};
+
+/* Statements turning a database created from db.sql back into version 0 */
+const char *const DOWNGRADE_TO_VERSION_0 =
+    "DROP INDEX app_uid_index;"
+    "DROP INDEX app_pkg_id_index;"
+    "DROP TABLE smack_rule;"
+    "PRAGMA user_version = 0;";
+
+/* Temporary database created from db.sql, removed on destruction */
+class TestDb {
+public:
+    explicit TestDb(const char *script = NULL)
+      : m_connection(NULL)
+    {
+        char path[] = "/tmp/security-manager-test-XXXXXX";
+        int fd = mkstemp(path);
+        if (fd < 0)
+            throw std::runtime_error("Cannot create temporary database");
+        close(fd);
+        m_path = path;
+
+        std::ifstream file(DB_SQL_PATH);
+        std::stringstream schema;
+        schema << file.rdbuf();
+        if (sqlite3_open(m_path.c_str(), &m_connection) != SQLITE_OK)
+            throw std::runtime_error("Cannot open temporary database");
+        exec(schema.str().c_str());
+        if (script)
+            exec(script);
+        sqlite3_close(m_connection);
+
+        // Migrations are run by the first instance opening the database.
+        // Query plans are not checked against the schema, the connection
+        // explaining them must be opened after they change it.
+        m_db.reset(new PrivilegeDb(m_path));
+        if (sqlite3_open_v2(m_path.c_str(), &m_connection, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK)
+            throw std::runtime_error("Cannot open temporary database");
+    }
+
+    ~TestDb()
+    {
+        m_db.reset();
+        sqlite3_close(m_connection);
+        for (const char *suffix : {"", "-wal", "-shm", "-journal"})
+            unlink((m_path + suffix).c_str());
+    }
+
+    PrivilegeDb &db() { return *m_db; }
+
+    /* Steps of the plan, e.g. "SEARCH app USING INDEX ...", one per line */
+    std::string plan(const char *query)
+    {
+        sqlite3_stmt *stmt;
+        std::string explain = std::string("EXPLAIN QUERY PLAN ") + query;
+        if (sqlite3_prepare_v2(m_connection, explain.c_str(), -1, &stmt, NULL) != SQLITE_OK)
+            throw std::runtime_error("Cannot prepare " + explain + ": " +
+                sqlite3_errmsg(m_connection));
+
+        // Last column of each row describes one step
+        std::string result;
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            const char *detail = reinterpret_cast<const char *>(
+                sqlite3_column_text(stmt, sqlite3_column_count(stmt) - 1));
+            if (detail)
+                result += std::string(detail) + "\n";
+        }
+        sqlite3_finalize(stmt);
+        return result;
+    }
+
+private:
+    void exec(const char *script)
+    {
+        if (sqlite3_exec(m_connection, script, NULL, NULL, NULL) != SQLITE_OK)
+            throw std::runtime_error(std::string("Cannot run SQL script: ") +
+                sqlite3_errmsg(m_connection));
+    }
+
+    std::string m_path;
+    sqlite3 *m_connection;
+    std::unique_ptr<PrivilegeDb> m_db;
+};
+
+bool scans(const std::string &plan, const char *table)
+{
+    // "SCAN app" or "SCAN app USING ..." but not "SCAN app_privilege"
+    std::string step = std::string("SCAN ") + table;
+    for (size_t pos = plan.find(step); pos != std::string::npos;
+            pos = plan.find(step, pos + 1)) {
+        char next = plan[pos + step.size()];
+        if (next == '\n' || next == ' ')
+            return true;
+    }
+    return false;
+}
+
+void checkQueryPlans(TestDb &testDb)
+{
+    for (const auto &query : testDb.db().GetQueries()) {
+        auto expected = EXPECTED_PLANS.find(query.first);
+        if (expected == EXPECTED_PLANS.end())
+            throw Failure(std::string("No expected plan for query: ") + query.second);
+        if (expected->second == ALL_ROWS)
+            continue;
+
+        std::string plan = testDb.plan(query.second);
+        if (expected->second && plan.find(expected->second) == std::string::npos)
+            throw Failure(std::string(query.second) + " doesn't use " + expected->second +
+                ", plan:\n" + plan);
+        for (const char *table : LARGE_TABLES)
+            if (scans(plan, table))
+                throw Failure(std::string(query.second) + " scans " + table + ", plan:\n" + plan);
+    }
+}
+
+void testQueryPlans()
+{
+    TestDb testDb;
+    checkQueryPlans(testDb);
+}
+
+void testQueryPlansAfterMigration()
+{
+    TestDb testDb(DOWNGRADE_TO_VERSION_0);
+    checkQueryPlans(testDb);
+}
+
+} // namespace anonymous
+
+void registerPrivilegeDbTests(Runner &runner)
+{
+    runner.add("privilege-db/query-plans/created", testQueryPlans);
+    runner.add("privilege-db/query-plans/migrated", testQueryPlansAfterMigration);
+}
+
+} // namespace Test
+} // namespace SecurityManager
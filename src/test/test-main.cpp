@@ -0,0 +1,54 @@
+/*
+ *  Copyright (c) 2014 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *  Contact: Rafal Krypa <r.krypa@samsung.com>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License
+ */
+/*
+ * @file        test-main.cpp
+ * @brief       Entry point of security-manager-tests
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include <test.h>
+
+using namespace SecurityManager;
+
+static void usage(const char *name)
+{
+    std::cerr << "Usage: " << name << " [--filter <substring>]" << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+    Test::Runner runner;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--filter") && i + 1 < argc)
+            runner.setFilter(argv[++i]);
+        else {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    Test::registerCynaraTests(runner);
+    Test::registerPrivilegeDbIndexTests(runner);
+    Test::registerPrivilegeDbTests(runner);
+
+    return runner.run() ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,74 @@
+/*
+ *  Copyright (c) 2014 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *  Contact: Rafal Krypa <r.krypa@samsung.com>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License
+ */
+/*
+ * @file        test.cpp
+ * @brief       Minimal test runner used by security-manager-tests
+ */
+
+#include <exception>
+#include <iostream>
+
+#include <dpl/exception.h>
+
+#include <test.h>
+
+namespace SecurityManager {
+namespace Test {
+
+void Runner::add(const std::string &name, Body body)
+{
+    m_cases.push_back({name, body});
+}
+
+void Runner::setFilter(const std::string &filter)
+{
+    m_filter = filter;
+}
+
+size_t Runner::run()
+{
+    size_t failed = 0;
+
+    for (const auto &testCase : m_cases) {
+        if (testCase.name.find(m_filter) == std::string::npos)
+            continue;
+
+        std::string error;
+        try {
+            testCase.body();
+        } catch (const SecurityManager::Exception &e) {
+            error = e.DumpToString();
+        } catch (const std::exception &e) {
+            error = e.what();
+        } catch (...) {
+            error = "unknown exception";
+        }
+
+        if (error.empty()) {
+            std::cout << "PASS " << testCase.name << std::endl;
+        } else {
+            std::cout << "FAIL " << testCase.name << ": " << error << std::endl;
+            ++failed;
+        }
+    }
+
+    return failed;
+}
+
+} // namespace Test
+} // namespace SecurityManager